@@ -19,14 +19,17 @@
 
 #include <kpathsea/config.h>
 #include <kpathsea/c-fopen.h>
+#include <kpathsea/c-stat.h>
 #include <kpathsea/c-ctype.h>
 #include <kpathsea/c-pathch.h>
 #include <kpathsea/cnf.h>
 #include <kpathsea/db.h>
+#include <kpathsea/fn.h>
 #include <kpathsea/hash.h>
 #include <kpathsea/line.h>
 #include <kpathsea/paths.h>
 #include <kpathsea/pathsearch.h>
+#include <kpathsea/str-list.h>
 #include <kpathsea/tex-file.h>
 #include <kpathsea/variable.h>
 
@@ -245,6 +248,502 @@ read_all_cnf (kpathsea kpse)
   }
 }
 
+/* A snapshot is the parsed cnf hash table written out as text, so that
+   later runs can skip finding and parsing the texmf.cnf files, together
+   with the variables as `kpathsea_var_value' expands them, so that they
+   need not be expanded again either.  It looks like this:
+
+     kpathsea cnf snapshot 2
+     path <expanded cnf path>
+     dir <mtime> <directory>     one per directory of the cnf path
+     file <mtime> <size> <file>  one per texmf.cnf that was read
+     var <key>=<value>           in hash table order
+     prog <program name>         the program the values were expanded for
+     env <name>=<value>          one per environment variable they depend
+     env <name>                    on, set or unset
+     exp <name>=<value>          one per variable of the cnf files, each
+     deps <n> <n> ...              with the `env' lines, counted from 0,
+                                   that its value depends on
+
+   The snapshot is only used when the cnf path is the same and none of
+   the directories and files has changed; a texmf.cnf added to or
+   removed from one of the directories changes the directory's mtime.
+   An expanded value is only used by the same program, and only while
+   the environment variables it depends on are as they were.  Set
+   KPATHSEA_SNAPSHOT to the snapshot file to use it; `kpsewhich
+   --cnf-snapshot' writes it.  */
+
+#define CNF_SNAPSHOT_MAGIC "kpathsea cnf snapshot 2"
+
+#ifdef WIN32
+#define HOMEVAR "USERPROFILE"
+#else
+#define HOMEVAR "HOME"
+#endif
+
+/* Return the `dir' lines describing the directories of CNF_PATH.  */
+
+static str_list_type
+cnf_snapshot_dirs (kpathsea kpse, const_string cnf_path)
+{
+  str_list_type lines = str_list_init ();
+  string elt;
+
+  for (elt = kpathsea_path_element (kpse, cnf_path); elt;
+       elt = kpathsea_path_element (kpse, NULL)) {
+    str_llist_type *dirs;
+    str_llist_elt_type *dir;
+
+    if (elt[0] == '!' && elt[1] == '!')
+      elt += 2;
+    kpathsea_normalize_path (kpse, elt);
+    dirs = kpathsea_element_dirs (kpse, elt);
+    if (!dirs || !*dirs) {
+      /* Record missing directories too, so creating one is noticed.  */
+      str_list_add (&lines, concat ("dir -1 ", elt));
+      continue;
+    }
+    for (dir = *dirs; dir; dir = STR_LLIST_NEXT (*dir)) {
+      struct stat st;
+      char buf[32];
+      sprintf (buf, "dir %ld ", stat (STR_LLIST (*dir), &st) == 0
+                                ? (long) st.st_mtime : -1L);
+      str_list_add (&lines, concat (buf, STR_LLIST (*dir)));
+    }
+  }
+
+  return lines;
+}
+
+/* Free the lines in L as well as L itself.  */
+
+static void
+cnf_snapshot_free (str_list_type *l)
+{
+  unsigned i;
+  for (i = 0; i < STR_LIST_LENGTH (*l); i++)
+    free (STR_LIST_ELT (*l, i));
+  str_list_free (l);
+}
+
+/* Return the `file' line for the cnf file NAME, or NULL if it can't
+   be stat'ed.  */
+
+static string
+cnf_snapshot_file (const_string name)
+{
+  struct stat st;
+  char buf[64];
+
+  if (stat (name, &st) != 0)
+    return NULL;
+  sprintf (buf, "file %ld %ld ", (long) st.st_mtime, (long) st.st_size);
+  return concat (buf, name);
+}
+
+/* Return whether the environment variable NAME is in DEPS, a list of
+   `env' lines without the `env '.  */
+
+static boolean
+cnf_snapshot_has_env (str_list_type *deps, const_string name)
+{
+  unsigned len = strlen (name);
+  unsigned i;
+
+  for (i = 0; i < STR_LIST_LENGTH (*deps); i++) {
+    const_string dep = STR_LIST_ELT (*deps, i);
+    if (strncmp (dep, name, len) == 0 && (dep[len] == 0 || dep[len] == '='))
+      return true;
+  }
+  return false;
+}
+
+/* Add the environment variable NAME with its current value to DEPS,
+   unless it is there already.  */
+
+static void
+cnf_snapshot_env (str_list_type *deps, const_string name)
+{
+  const_string value = getenv (name);
+
+  if (cnf_snapshot_has_env (deps, name))
+    return;
+  /* Empty and unset are the same to `kpathsea_var_value'.  */
+  str_list_add (deps, value && *value ? concat3 (name, "=", value)
+                                      : xstrdup (name));
+}
+
+/* Add to DEPS the environment variables that the expansion of the
+   variable NAME looks at: those that can set NAME, and those of the
+   variables its value refers to, and so on.  TOP is true for the
+   variable asked for, where `kpathsea_var_value' also looks at
+   NAME.progname.  */
+
+static void
+cnf_snapshot_deps (kpathsea kpse, str_list_type *deps, const_string name,
+                   boolean top)
+{
+  string vtry = concat3 (name, "_", kpse->program_name);
+  const_string value = NULL;
+  const_string s;
+
+  /* Each variable is looked at once; that also ends self-references.  */
+  if (cnf_snapshot_has_env (deps, vtry)) {
+    free (vtry);
+    return;
+  }
+
+  /* Look for the value the way `kpathsea_var_value' and `expand' do.  */
+  if (top) {
+    string dot = concat3 (name, ".", kpse->program_name);
+    cnf_snapshot_env (deps, dot);
+    value = getenv (dot);
+    free (dot);
+  }
+  cnf_snapshot_env (deps, vtry);
+  if (!value || !*value)
+    value = getenv (vtry);
+  free (vtry);
+  cnf_snapshot_env (deps, name);
+  if (!value || !*value)
+    value = getenv (name);
+  if (!value || !*value)
+    value = kpathsea_cnf_get (kpse, name);
+  if (!value)
+    return;
+
+  if (strchr (value, '~'))
+    cnf_snapshot_env (deps, HOMEVAR);
+
+  /* The references are `$VAR' and `${VAR}', as in `kpathsea_var_expand'.  */
+  for (s = value; *s; s++) {
+    const_string start, end;
+    string var;
+
+    if (*s != '$')
+      continue;
+    start = s + 1;
+    if (*start == '{') {
+      start++;
+      for (end = start; *end && *end != '}'; end++)
+        ;
+      if (!*end)
+        break;
+    } else {
+      for (end = start; ISALNUM (*end) || *end == '_'; end++)
+        ;
+    }
+    if (end > start) {
+      var = (string) xmalloc (end - start + 1);
+      strncpy (var, start, end - start);
+      var[end - start] = 0;
+      cnf_snapshot_deps (kpse, deps, var, false);
+      free (var);
+    }
+    s = end - 1;
+  }
+}
+
+/* Write the `env', `exp' and `deps' lines for the variables of the cnf
+   hash table to F.  Values with a newline can't be written, nor can
+   those depending on an environment variable with one; they are left
+   out.  */
+
+static void
+cnf_snapshot_write_expanded (kpathsea kpse, FILE *f)
+{
+  str_list_type names = str_list_init ();
+  str_list_type env = str_list_init ();
+  str_list_type exps = str_list_init ();
+  unsigned i, j, k;
+
+  for (i = 0; i < kpse->cnf_hash.size; i++) {
+    hash_element_type *p;
+    for (p = kpse->cnf_hash.buckets[i]; p; p = p->next) {
+      /* Values for another program are under `NAME.progname'.  */
+      const_string dot = strchr (p->key, '.');
+      string name = dot ? (string) xmalloc (dot - p->key + 1)
+                        : xstrdup (p->key);
+      if (dot) {
+        strncpy (name, p->key, dot - p->key);
+        name[dot - p->key] = 0;
+      }
+      for (j = 0; j < STR_LIST_LENGTH (names); j++) {
+        if (STREQ (STR_LIST_ELT (names, j), name))
+          break;
+      }
+      if (j < STR_LIST_LENGTH (names))
+        free (name);
+      else
+        str_list_add (&names, name);
+    }
+  }
+
+  /* Many values depend on the same variables, so the `env' lines are
+     shared and each `deps' line lists the numbers of those it needs.  */
+  for (i = 0; i < STR_LIST_LENGTH (names); i++) {
+    string name = STR_LIST_ELT (names, i);
+    string value = kpathsea_var_value (kpse, name);
+    str_list_type deps = str_list_init ();
+    boolean ok = value && !strchr (value, '\n');
+
+    if (ok) {
+      cnf_snapshot_deps (kpse, &deps, name, true);
+      for (j = 0; ok && j < STR_LIST_LENGTH (deps); j++)
+        ok = !strchr (STR_LIST_ELT (deps, j), '\n');
+    }
+    if (ok) {
+      fn_type line = fn_init ();
+      fn_grow (&line, "deps", 4);
+      for (j = 0; j < STR_LIST_LENGTH (deps); j++) {
+        string dep = STR_LIST_ELT (deps, j);
+        char buf[16];
+        for (k = 0; k < STR_LIST_LENGTH (env); k++) {
+          if (STREQ (STR_LIST_ELT (env, k), dep))
+            break;
+        }
+        if (k == STR_LIST_LENGTH (env))
+          str_list_add (&env, xstrdup (dep));
+        sprintf (buf, " %u", k);
+        fn_grow (&line, buf, strlen (buf));
+      }
+      fn_1grow (&line, 0);
+      str_list_add (&exps, concat3 (name, "=", value));
+      str_list_add (&exps, FN_STRING (line));
+    }
+    free (value);
+    cnf_snapshot_free (&deps);
+  }
+
+  for (i = 0; i < STR_LIST_LENGTH (env); i++)
+    fprintf (f, "env %s\n", STR_LIST_ELT (env, i));
+  for (i = 0; i + 1 < STR_LIST_LENGTH (exps); i += 2)
+    fprintf (f, "exp %s\n%s\n", STR_LIST_ELT (exps, i),
+             STR_LIST_ELT (exps, i + 1));
+
+  cnf_snapshot_free (&exps);
+  cnf_snapshot_free (&env);
+  cnf_snapshot_free (&names);
+}
+
+/* Return the rest of F.  */
+
+static string
+cnf_snapshot_rest (FILE *f)
+{
+  unsigned limit = 8192;
+  unsigned size = 0;
+  size_t n;
+  string buf = (string) xmalloc (limit + 1);
+
+  while ((n = fread (buf + size, 1, limit - size, f)) > 0) {
+    size += n;
+    if (size == limit) {
+      limit *= 2;
+      buf = (string) xrealloc (buf, limit + 1);
+    }
+  }
+  buf[size] = 0;
+  return buf;
+}
+
+/* Fill the expanded values table from BUF, the `env', `exp' and `deps'
+   lines of a snapshot, which it takes over.  The lines are split in
+   place: the table points into BUF.  Each value is followed by a null
+   and its `deps' line.  */
+
+static void
+cnf_snapshot_load_expanded (kpathsea kpse, string buf)
+{
+  string line, next, eq;
+
+  kpse->cnf_expanded = hash_create (CNF_HASH_SIZE);
+  kpse->cnf_expanded_buf = buf;
+  free (kpse->cnf_expanded_prog);
+  kpse->cnf_expanded_prog = xstrdup (kpse->program_name);
+
+  for (line = buf; *line; line = next) {
+    next = strchr (line, '\n');
+    if (next)
+      *next++ = 0;
+    else
+      next = line + strlen (line);
+    if (strncmp (line, "env ", 4) == 0) {
+      str_list_add (&(kpse->cnf_expanded_env), line + 4);
+    } else if (strncmp (line, "exp ", 4) == 0
+               && (eq = strchr (line, '=')) != NULL
+               && strncmp (next, "deps", 4) == 0) {
+      *eq = 0;
+      hash_insert (&(kpse->cnf_expanded), line + 4, eq + 1);
+    }
+  }
+}
+
+/* Fill the cnf hash table from the snapshot named by KPATHSEA_SNAPSHOT.
+   Return false, leaving the table alone, if there is none or it is out
+   of date.  */
+
+static boolean
+read_cnf_snapshot (kpathsea kpse)
+{
+  const_string snapshot = getenv ("KPATHSEA_SNAPSHOT");
+  const_string cnf_path;
+  str_list_type dirs, files, vars;
+  unsigned ndirs = 0;
+  boolean ok;
+  string line, exp = NULL;
+  FILE *f;
+  unsigned i;
+
+  if (!snapshot || !*snapshot)
+    return false;
+  f = fopen (snapshot, FOPEN_R_MODE);
+  if (!f)
+    return false;
+
+  cnf_path = kpathsea_init_format (kpse, kpse_cnf_format);
+  dirs = cnf_snapshot_dirs (kpse, cnf_path);
+  files = str_list_init ();
+  vars = str_list_init ();
+
+  line = read_line (f);
+  ok = line && STREQ (line, CNF_SNAPSHOT_MAGIC);
+  free (line);
+  if (ok) {
+    line = read_line (f);
+    ok = line && strncmp (line, "path ", 5) == 0
+         && STREQ (line + 5, cnf_path);
+    free (line);
+  }
+
+  while (ok && (line = read_line (f)) != NULL) {
+    if (strncmp (line, "dir ", 4) == 0) {
+      ok = ndirs < STR_LIST_LENGTH (dirs)
+           && STREQ (line, STR_LIST_ELT (dirs, ndirs));
+      ndirs++;
+    } else if (strncmp (line, "file ", 5) == 0) {
+      /* The name follows the mtime and size.  */
+      string name = strchr (line + 5, ' ');
+      string current;
+      name = name ? strchr (name + 1, ' ') : NULL;
+      current = name ? cnf_snapshot_file (name + 1) : NULL;
+      ok = current && STREQ (line, current);
+      free (current);
+      if (ok) {
+        str_list_add (&files, xstrdup (name + 1));
+      }
+    } else if (strncmp (line, "var ", 4) == 0 && strchr (line + 4, '=')) {
+      str_list_add (&vars, line);
+      continue;
+    } else if (strncmp (line, "prog ", 5) == 0) {
+      /* The expanded values come last; they are of no use to another
+         program.  */
+      if (STREQ (line + 5, kpse->program_name))
+        exp = cnf_snapshot_rest (f);
+      free (line);
+      break;
+    } else {
+      ok = false;
+    }
+    free (line);
+  }
+  xfclose (f, snapshot);
+  ok = ok && ndirs == STR_LIST_LENGTH (dirs) && !STR_LIST_EMPTY (files);
+
+  if (ok) {
+    kpse->cnf_hash = hash_create (CNF_HASH_SIZE);
+    for (i = 0; i < STR_LIST_LENGTH (vars); i++) {
+      string var = STR_LIST_ELT (vars, i);
+      string eq = strchr (var + 4, '=');
+      *eq = 0;
+      hash_insert (&(kpse->cnf_hash), xstrdup (var + 4), xstrdup (eq + 1));
+    }
+    if (exp) {
+      cnf_snapshot_load_expanded (kpse, exp);
+      exp = NULL;
+    }
+    if (kpse->record_input) {
+      for (i = 0; i < STR_LIST_LENGTH (files); i++)
+        kpse->record_input (STR_LIST_ELT (files, i));
+    }
+  }
+
+  free (exp);
+  cnf_snapshot_free (&vars);
+  cnf_snapshot_free (&files);
+  cnf_snapshot_free (&dirs);
+  return ok;
+}
+
+/* Write a snapshot of the cnf hash table to FILENAME, reading the cnf
+   files first if necessary.  Return false if it can't be written.  */
+
+boolean
+kpathsea_cnf_write_snapshot (kpathsea kpse, const_string filename)
+{
+  const_string cnf_path;
+  string *cnf_files, *cnf;
+  str_list_type dirs;
+  string tmp_filename;
+  boolean ok;
+  boolean followup;
+  unsigned i;
+  FILE *f;
+
+  kpathsea_cnf_get (kpse, "TEXMFCNF");
+  cnf_path = kpathsea_init_format (kpse, kpse_cnf_format);
+
+  /* Look for the cnf files the way `read_all_cnf' did: on disk only,
+     without variable lookups.  */
+  kpse->doing_cnf_init = true;
+  followup = kpse->followup_search;
+  kpse->followup_search = false;
+  dirs = cnf_snapshot_dirs (kpse, cnf_path);
+  cnf_files = kpathsea_all_path_search (kpse, cnf_path, CNF_NAME);
+  kpse->followup_search = followup;
+  kpse->doing_cnf_init = false;
+
+  tmp_filename = concat (filename, ".tmp");
+  f = fopen (tmp_filename, FOPEN_W_MODE);
+  ok = f != NULL && cnf_files && *cnf_files;
+  if (ok) {
+    fprintf (f, "%s\npath %s\n", CNF_SNAPSHOT_MAGIC, cnf_path);
+    for (i = 0; i < STR_LIST_LENGTH (dirs); i++)
+      fprintf (f, "%s\n", STR_LIST_ELT (dirs, i));
+    for (cnf = cnf_files; ok && *cnf; cnf++) {
+      string line = cnf_snapshot_file (*cnf);
+      ok = line != NULL;
+      if (ok)
+        fprintf (f, "%s\n", line);
+      free (line);
+    }
+    for (i = 0; ok && i < kpse->cnf_hash.size; i++) {
+      hash_element_type *p;
+      for (p = kpse->cnf_hash.buckets[i]; p; p = p->next)
+        fprintf (f, "var %s=%s\n", p->key, p->value);
+    }
+    if (ok) {
+      fprintf (f, "prog %s\n", kpse->program_name);
+      cnf_snapshot_write_expanded (kpse, f);
+    }
+  }
+  if (f) {
+    ok = fclose (f) == 0 && ok;
+    ok = ok && rename (tmp_filename, filename) == 0;
+    if (!ok)
+      unlink (tmp_filename);
+  }
+  free (tmp_filename);
+
+  if (cnf_files) {
+    for (cnf = cnf_files; *cnf; cnf++)
+      free (*cnf);
+    free (cnf_files);
+  }
+  cnf_snapshot_free (&dirs);
+  return ok;
+}
+
 /* Read the cnf files on the first call.  Return the first value in the
    returned list -- this will be from the last-read cnf file.  */
 
@@ -266,7 +765,8 @@ kpathsea_cnf_get (kpathsea kpse, const_string name)
   if (kpse->cnf_hash.size == 0) {
     /* Read configuration files and initialize databases.  */
     kpse->doing_cnf_init = true;
-    read_all_cnf (kpse);
+    if (!read_cnf_snapshot (kpse))
+      read_all_cnf (kpse);
     kpse->doing_cnf_init = false;
 
     /* Since `kpse_init_db' recursively calls us, we must call it from
@@ -296,6 +796,62 @@ kpathsea_cnf_get (kpathsea kpse, const_string name)
   return ret;
 }
 
+/* Return the expanded value of NAME from the snapshot, or NULL if there
+   is none for this program or the environment has changed since.  */
+
+string
+kpathsea_cnf_expanded (kpathsea kpse, const_string name)
+{
+  const_string *ret_list;
+  const_string block, deps;
+
+  /* The snapshot is read with the cnf files, on the first lookup, which
+     may well be this one.  */
+  if (kpse->cnf_hash.size == 0 && !kpse->doing_cnf_init) {
+    const_string snapshot = getenv ("KPATHSEA_SNAPSHOT");
+    if (!snapshot || !*snapshot)
+      return NULL;
+    kpathsea_cnf_get (kpse, name);
+  }
+  if (kpse->cnf_expanded.size == 0
+      || !STREQ (kpse->cnf_expanded_prog, kpse->program_name))
+    return NULL;
+  ret_list = hash_lookup (kpse->cnf_expanded, name);
+  if (!ret_list)
+    return NULL;
+  block = *ret_list;
+  free (ret_list);
+
+  /* The value is followed by its `deps' line, the numbers of the `env'
+     lines describing the environment it was expanded in.  */
+  for (deps = block + strlen (block) + 1 + 4; *deps; ) {
+    string end;
+    unsigned long n = strtoul (deps, &end, 10);
+    const_string dep, eq, value;
+
+    if (end == deps || n >= STR_LIST_LENGTH (kpse->cnf_expanded_env))
+      return NULL;
+    deps = end;
+    dep = STR_LIST_ELT (kpse->cnf_expanded_env, n);
+    eq = strchr (dep, '=');
+    if (eq) {
+      string var = (string) xmalloc (eq - dep + 1);
+      strncpy (var, dep, eq - dep);
+      var[eq - dep] = 0;
+      value = getenv (var);
+      free (var);
+      if (!value || !STREQ (value, eq + 1))
+        return NULL;
+    } else {
+      value = getenv (dep);
+      if (value && *value)
+        return NULL;
+    }
+  }
+
+  return xstrdup (block);
+}
+
 #if defined(KPSE_COMPAT_API)
 const_string
 kpse_cnf_get (const_string name)
@@ -32,6 +32,21 @@ extern "C" {
 
 extern KPSEDLL const_string kpathsea_cnf_get (kpathsea kpse, const_string name);
 
+/* Write the cnf values, as read from the `texmf.cnf' files and as
+   expanded for the current program, to the snapshot FILENAME.  When the
+   environment variable KPATHSEA_SNAPSHOT names it, later runs load the
+   values from the snapshot as long as the cnf files are unchanged, and
+   use the expanded ones as long as the environment variables they
+   depend on are too.  Return false if it can't be written.  */
+
+extern KPSEDLL boolean kpathsea_cnf_write_snapshot (kpathsea kpse,
+                                                    const_string filename);
+
+#ifdef MAKE_KPSE_DLL /* for inside the DLL */
+/* Return the expanded value of VAR from the snapshot, or NULL.  */
+extern string kpathsea_cnf_expanded (kpathsea kpse, const_string var);
+#endif /* MAKE_KPSE_DLL */
+
 #if defined(KPSE_COMPAT_API)
 extern KPSEDLL const_string kpse_cnf_get (const_string var);
 #endif
@@ -31,6 +31,10 @@
 #include <kpathsea/tex-file.h>
 #include <kpathsea/variable.h>
 
+#if !defined (WIN32)
+#include <sys/mman.h>
+#endif
+
 #ifndef DB_HASH_SIZE
 /* Based on the size of 2014 texmf-dist/ls-R, about 130,000 entries.  */
 #define DB_HASH_SIZE 64007
@@ -86,7 +90,8 @@ ignore_dir_p (const_string dirname)
    Otherwise, add entries from DB_FILENAME to TABLE, and return true.  */
 
 static boolean
-db_build (kpathsea kpse, hash_table_type *table,  const_string db_filename)
+db_build (kpathsea kpse, hash_table_type *table,  const_string db_filename,
+          cstr_list_type *dirs)
 {
   string line;
   unsigned dir_count = 0, file_count = 0, ignore_dir_count = 0;
@@ -131,6 +136,8 @@ db_build (kpathsea kpse, hash_table_type *table,  const_string db_filename)
              won't work there, either, so it doesn't matter.  */
           cur_dir = *line == '.' ? concat (top_dir, line + 2) : xstrdup (line);
           dir_count++;
+          if (dirs)
+            cstr_list_add (dirs, cur_dir);
         } else {
           cur_dir = NULL;
           ignore_dir_count++;
@@ -190,6 +197,406 @@ db_build (kpathsea kpse, hash_table_type *table,  const_string db_filename)
   return db_file != NULL;
 }
 
+/* The binary form of an ls-R file, written by `kpsewhich -compile-db'
+   (and hence `mktexlsr --binary') next to it as ls-R.idx.  It holds
+   exactly the entries db_build would make, so the file can be mapped
+   and searched without parsing.  All numbers are unsigned 32-bit in
+   native byte order; strings are null-terminated in one pool.
+
+     header   db_index_header, below
+     dirs     dir_count offsets of the full directory names
+     buckets  bucket_count + 1 entry numbers; bucket B holds the
+              entries from buckets[B] up to buckets[B+1]
+     entries  entry_count (name offset, dir number) pairs, in ls-R
+              order within each bucket
+     pool     the strings
+
+   The index is only used when it still describes its ls-R (same size
+   and modification time) and that ls-R lives in the same directory as
+   when the index was written.  Otherwise, or if any ls-R lacks an
+   index, we read all of them as text.  */
+
+#ifndef DB_INDEX_SUFFIX
+#define DB_INDEX_SUFFIX ".idx"
+#endif
+#define DB_INDEX_MAGIC "kpsedb\n"
+#define DB_INDEX_VERSION 1
+
+typedef struct
+{
+  char magic[8];
+  unsigned version;
+  unsigned word_size;           /* sizeof (unsigned), as a byte order check */
+  unsigned file_size;
+  unsigned lsr_size;
+  unsigned lsr_mtime_lo, lsr_mtime_hi;
+  unsigned top_dir;             /* pool offset of the top directory */
+  unsigned dir_count, bucket_count, entry_count;
+  unsigned dirs, buckets, entries, pool;    /* section offsets */
+} db_index_header;
+
+struct db_index_struct
+{
+  const char *base;             /* the mapped (or read) file */
+  unsigned size;
+  const db_index_header *header;
+  const unsigned *dirs, *buckets, *entries;
+  const char *pool;
+};
+
+/* The same hash is used for writing and reading, so it only has to be
+   consistent with FILESTRCASEEQ, hence the TRANSFORM.  */
+
+static unsigned
+db_index_hash (const_string key)
+{
+  unsigned h = 2166136261U;
+  while (*key)
+    h = (h ^ (unsigned) TRANSFORM ((unsigned char) *key++)) * 16777619U;
+  return h;
+}
+
+static void
+db_index_close (db_index_type *idx)
+{
+#if defined (WIN32)
+  free ((void *) idx->base);
+#else
+  munmap ((void *) idx->base, idx->size);
+#endif
+  free (idx);
+}
+
+void
+kpathsea_db_index_free (kpathsea kpse)
+{
+  while (kpse->db_index_count > 0)
+    db_index_close (kpse->db_index[--kpse->db_index_count]);
+  free (kpse->db_index);
+  kpse->db_index = NULL;
+}
+
+/* Return true if COUNT words at OFFSET are within the file IDX.  */
+
+static boolean
+db_index_section_ok (const db_index_type *idx, unsigned offset, unsigned count)
+{
+  return offset >= sizeof (db_index_header) && offset <= idx->size
+         && offset % sizeof (unsigned) == 0
+         && count <= (idx->size - offset) / sizeof (unsigned);
+}
+
+/* Check that the sections of IDX are within the file, that the buckets
+   are in order and that all entries point into the pool and the
+   directory list.  A damaged index is ignored, not trusted.  */
+
+static boolean
+db_index_valid (const db_index_type *idx)
+{
+  const db_index_header *h = idx->header;
+  unsigned pool_size, b, d, e;
+
+  if (h->bucket_count == 0 || (h->bucket_count & (h->bucket_count - 1)) != 0
+      || h->bucket_count == ~0U
+      || h->entry_count > ~0U / 2
+      || !db_index_section_ok (idx, h->dirs, h->dir_count)
+      || !db_index_section_ok (idx, h->buckets, h->bucket_count + 1)
+      || !db_index_section_ok (idx, h->entries, 2 * h->entry_count)
+      || h->pool < sizeof (db_index_header) || h->pool >= idx->size
+      || idx->base[idx->size - 1] != 0)
+    return false;
+  pool_size = idx->size - h->pool;
+  for (d = 0; d < h->dir_count; d++)
+    if (idx->dirs[d] >= pool_size)
+      return false;
+  if (idx->buckets[0] != 0 || idx->buckets[h->bucket_count] != h->entry_count)
+    return false;
+  for (b = 0; b < h->bucket_count; b++)
+    if (idx->buckets[b] > idx->buckets[b + 1])
+      return false;
+  for (e = 0; e < h->entry_count; e++)
+    if (idx->entries[2 * e] >= pool_size
+        || idx->entries[2 * e + 1] >= h->dir_count)
+      return false;
+  return true;
+}
+
+/* Return the index belonging to DB_FILENAME, or NULL if there is none,
+   it is damaged, or it doesn't describe the ls-R as it is now.  */
+
+static db_index_type *
+db_index_open (const_string db_filename)
+{
+  string idx_filename = concat (db_filename, DB_INDEX_SUFFIX);
+  unsigned len = strlen (db_filename) - sizeof (DB_NAME) + 1;
+  db_index_type *idx = NULL;
+  const db_index_header *h;
+  struct stat lsr_st, idx_st;
+  const char *base = NULL;
+  FILE *f;
+
+  if (stat (db_filename, &lsr_st) != 0
+      || (f = fopen (idx_filename, FOPEN_RBIN_MODE)) == NULL) {
+    free (idx_filename);
+    return NULL;
+  }
+  if (fstat (fileno (f), &idx_st) == 0
+      && idx_st.st_size >= (off_t) sizeof (db_index_header)) {
+#if defined (WIN32)
+    char *buf = (char *) xmalloc (idx_st.st_size);
+    if (fread (buf, 1, idx_st.st_size, f) == (size_t) idx_st.st_size)
+      base = buf;
+    else
+      free (buf);
+#else
+    base = (const char *) mmap (NULL, idx_st.st_size, PROT_READ, MAP_SHARED,
+                                fileno (f), 0);
+    if (base == (const char *) MAP_FAILED)
+      base = NULL;
+#endif
+  }
+  fclose (f);
+  free (idx_filename);
+  if (!base)
+    return NULL;
+
+  idx = XTALLOC1 (db_index_type);
+  idx->base = base;
+  idx->size = idx_st.st_size;
+  h = idx->header = (const db_index_header *) base;
+  if (memcmp (h->magic, DB_INDEX_MAGIC, sizeof (h->magic)) != 0
+      || h->version != DB_INDEX_VERSION
+      || h->word_size != sizeof (unsigned)
+      || h->file_size != idx->size
+      || h->lsr_size != (unsigned) lsr_st.st_size
+      || h->lsr_mtime_lo != (unsigned) lsr_st.st_mtime
+      || h->lsr_mtime_hi != (unsigned) ((lsr_st.st_mtime >> 16) >> 16)
+      || h->entry_count == 0) {
+    db_index_close (idx);
+    return NULL;
+  }
+  idx->dirs = (const unsigned *) (base + h->dirs);
+  idx->buckets = (const unsigned *) (base + h->buckets);
+  idx->entries = (const unsigned *) (base + h->entries);
+  idx->pool = base + h->pool;
+  if (!db_index_valid (idx)
+      || h->top_dir >= idx->size - h->pool
+      || strlen (idx->pool + h->top_dir) != len
+      || strncmp (idx->pool + h->top_dir, db_filename, len) != 0) {
+    db_index_close (idx);
+    return NULL;
+  }
+  return idx;
+}
+
+/* Add the directories of NAME in IDX to RET.  */
+
+static void
+db_index_lookup (db_index_type *idx, const_string name, cstr_list_type *ret)
+{
+  unsigned b = db_index_hash (name) & (idx->header->bucket_count - 1);
+  unsigned e;
+
+  for (e = idx->buckets[b]; e < idx->buckets[b + 1]; e++) {
+    if (FILESTRCASEEQ (name, idx->pool + idx->entries[2 * e]))
+      cstr_list_add (ret, idx->pool + idx->dirs[idx->entries[2 * e + 1]]);
+  }
+}
+
+/* Like hash_lookup on the db: all directories of NAME, in ls-R order,
+   followed by those added at runtime.  */
+
+static const_string *
+db_lookup (kpathsea kpse, const_string name)
+{
+  cstr_list_type ret;
+  const_string *extra, *r;
+  unsigned i;
+
+  if (kpse->db_index_count == 0)
+    return hash_lookup (kpse->db, name);
+
+  ret = cstr_list_init ();
+  for (i = 0; i < kpse->db_index_count; i++)
+    db_index_lookup (kpse->db_index[i], name, &ret);
+  extra = hash_lookup (kpse->db, name);
+  if (extra) {
+    for (r = extra; *r; r++)
+      cstr_list_add (&ret, *r);
+    free ((void *) extra);
+  }
+  if (STR_LIST (ret))
+    cstr_list_add (&ret, NULL);
+  return STR_LIST (ret);
+}
+
+typedef struct
+{
+  const_string dir;
+  unsigned number;
+} db_dir_ref;
+
+static int
+db_compare_dirs (const void *a, const void *b)
+{
+  const_string x = ((const db_dir_ref *) a)->dir;
+  const_string y = ((const db_dir_ref *) b)->dir;
+  return x < y ? -1 : x > y;
+}
+
+/* Write the index for DB_FILENAME.  Return false if it can't be read
+   or the index can't be written.  */
+
+boolean
+kpathsea_db_compile (kpathsea kpse, const_string db_filename)
+{
+  hash_table_type table;
+  cstr_list_type dirs = cstr_list_init ();
+  db_dir_ref *sorted_dirs;
+  db_index_header h;
+  unsigned *buckets, *entries, *dir_offsets, *fill, *names;
+  unsigned entry_count = 0, pool_size, top_len, b, d, e, k;
+  unsigned len = strlen (db_filename) - sizeof (DB_NAME) + 1;
+  hash_element_type *p;
+  struct stat lsr_st;
+  string idx_filename, tmp_filename;
+  FILE *f;
+  boolean ok;
+
+  if (stat (db_filename, &lsr_st) != 0)
+    return false;
+  table = hash_create (DB_HASH_SIZE);
+  if (!db_build (kpse, &table, db_filename, &dirs))
+    return false;
+
+  /* Lay out the pool: the top directory, the directories, then the
+     names.  A name is stored once; its other entries are in the same
+     bucket of TABLE, so that is where we look for it.  */
+  for (b = 0; b < table.size; b++)
+    for (p = table.buckets[b]; p; p = p->next)
+      entry_count++;
+  names = XTALLOC (entry_count + 1, unsigned);
+  top_len = len + 1;
+  pool_size = top_len;
+  for (d = 0; d < STR_LIST_LENGTH (dirs); d++)
+    pool_size += strlen (STR_LIST_ELT (dirs, d)) + 1;
+  for (k = 0, b = 0; b < table.size; b++) {
+    unsigned first = k;
+    for (p = table.buckets[b]; p; p = p->next, k++) {
+      hash_element_type *q = table.buckets[b];
+      unsigned i = first;
+      while (q != p && !STREQ (q->key, p->key)) {
+        q = q->next;
+        i++;
+      }
+      if (q != p) {
+        names[k] = names[i];
+      } else {
+        names[k] = pool_size;
+        pool_size += strlen (p->key) + 1;
+      }
+    }
+  }
+
+  memset (&h, 0, sizeof (h));
+  memcpy (h.magic, DB_INDEX_MAGIC, sizeof (h.magic));
+  h.version = DB_INDEX_VERSION;
+  h.word_size = sizeof (unsigned);
+  h.lsr_size = lsr_st.st_size;
+  h.lsr_mtime_lo = (unsigned) lsr_st.st_mtime;
+  h.lsr_mtime_hi = (unsigned) ((lsr_st.st_mtime >> 16) >> 16);
+  h.top_dir = 0;
+  h.dir_count = STR_LIST_LENGTH (dirs);
+  for (h.bucket_count = 1; h.bucket_count < entry_count; h.bucket_count <<= 1)
+    ;
+  h.entry_count = entry_count;
+  h.dirs = sizeof (h);
+  h.buckets = h.dirs + h.dir_count * sizeof (unsigned);
+  h.entries = h.buckets + (h.bucket_count + 1) * sizeof (unsigned);
+  h.pool = h.entries + 2 * entry_count * sizeof (unsigned);
+  h.file_size = h.pool + pool_size;
+
+  dir_offsets = XTALLOC (h.dir_count + 1, unsigned);
+  buckets = XTALLOC (h.bucket_count + 1, unsigned);
+  entries = XTALLOC (2 * entry_count + 1, unsigned);
+  fill = XTALLOC (h.bucket_count + 1, unsigned);
+
+  /* Directory numbers are found by address, the values in TABLE are
+     the very strings collected in DIRS.  */
+  sorted_dirs = XTALLOC (h.dir_count + 1, db_dir_ref);
+  for (d = 0, pool_size = top_len; d < h.dir_count; d++) {
+    sorted_dirs[d].dir = STR_LIST_ELT (dirs, d);
+    sorted_dirs[d].number = d;
+    dir_offsets[d] = pool_size;
+    pool_size += strlen (STR_LIST_ELT (dirs, d)) + 1;
+  }
+  dir_offsets[h.dir_count] = pool_size;   /* where the names start */
+  qsort (sorted_dirs, h.dir_count, sizeof (db_dir_ref), db_compare_dirs);
+
+  /* Counting sort into the buckets; walking TABLE bucket by bucket keeps
+     the ls-R order of equal names.  */
+  for (b = 0; b <= h.bucket_count; b++)
+    buckets[b] = 0;
+  for (b = 0; b < table.size; b++)
+    for (p = table.buckets[b]; p; p = p->next)
+      buckets[(db_index_hash (p->key) & (h.bucket_count - 1)) + 1]++;
+  for (b = 0; b < h.bucket_count; b++) {
+    buckets[b + 1] += buckets[b];
+    fill[b] = buckets[b];
+  }
+  for (k = 0, b = 0; b < table.size; b++) {
+    for (p = table.buckets[b]; p; p = p->next, k++) {
+      db_dir_ref key, *found;
+      key.dir = p->value;
+      found = (db_dir_ref *) bsearch (&key, sorted_dirs, h.dir_count,
+                                      sizeof (db_dir_ref), db_compare_dirs);
+      e = fill[db_index_hash (p->key) & (h.bucket_count - 1)]++;
+      entries[2 * e] = names[k];
+      entries[2 * e + 1] = found->number;
+    }
+  }
+
+  idx_filename = concat (db_filename, DB_INDEX_SUFFIX);
+  tmp_filename = concat (idx_filename, ".tmp");
+  f = fopen (tmp_filename, FOPEN_WBIN_MODE);
+  ok = f != NULL;
+  if (ok) {
+    fwrite (&h, sizeof (h), 1, f);
+    fwrite (dir_offsets, sizeof (unsigned), h.dir_count, f);
+    fwrite (buckets, sizeof (unsigned), h.bucket_count + 1, f);
+    fwrite (entries, sizeof (unsigned), 2 * entry_count, f);
+    fwrite (db_filename, 1, len, f);
+    putc (0, f);
+    for (d = 0; d < h.dir_count; d++)
+      fwrite (STR_LIST_ELT (dirs, d), 1, strlen (STR_LIST_ELT (dirs, d)) + 1, f);
+    pool_size = dir_offsets[h.dir_count];
+    /* The names, in the order their offsets were handed out.  */
+    for (k = 0, b = 0; b < table.size; b++) {
+      for (p = table.buckets[b]; p; p = p->next, k++) {
+        if (names[k] == pool_size) {
+          fwrite (p->key, 1, strlen (p->key) + 1, f);
+          pool_size += strlen (p->key) + 1;
+        }
+      }
+    }
+    ok = !ferror (f);
+    ok = fclose (f) == 0 && ok;
+    ok = ok && rename (tmp_filename, idx_filename) == 0;
+    if (!ok)
+      unlink (tmp_filename);
+  }
+
+  free (tmp_filename);
+  free (idx_filename);
+  free ((void *) STR_LIST (dirs));
+  free (sorted_dirs);
+  free (fill);
+  free (names);
+  free (entries);
+  free (buckets);
+  free (dir_offsets);
+  return ok;
+}
 
 /* Insert FNAME into the hash table.  This is for files that get built
    during a run.  We wouldn't want to reread all of ls-R, even if it got
@@ -454,17 +861,53 @@ kpathsea_init_db (kpathsea kpse)
   db_files = STR_LIST (unique_list);
   orig_db_files = db_files;
 
+  /* Use the binary indexes if every ls-R has an up to date one;
+     mixing them with text ones would lose the ls-R order.  */
+  for (dbi = 0; db_files[dbi]; dbi++)
+    ;
+  kpse->db_index = XTALLOC (dbi + 1, db_index_type *);
+  kpse->db_index_count = 0;
+  for (dbi = 0; db_files[dbi]; dbi++) {
+    db_index_type *idx = db_index_open (db_files[dbi]);
+    if (!idx)
+      break;
+    kpse->db_index[kpse->db_index_count++] = idx;
+  }
+  if (db_files[dbi]) {
+    while (kpse->db_index_count > 0)
+      db_index_close (kpse->db_index[--kpse->db_index_count]);
+  }
+
   /* Must do this after the path searching (which ends up calling
-     kpse_db_search recursively), so kpse->db.buckets stays NULL.  */
-  kpse->db = hash_create (DB_HASH_SIZE);
+     kpse_db_search recursively), so kpse->db.buckets stays NULL.  With
+     indexes it only holds the files added at runtime.  */
+  if (kpse->db_index_count > 0) {
+    kpse->db = hash_create (ALIAS_HASH_SIZE);
+    for (dbi = 0; dbi < (int) kpse->db_index_count; dbi++) {
+      db_index_type *idx = kpse->db_index[dbi];
+      str_list_add (&(kpse->db_dir_list),
+                    xstrdup (idx->pool + idx->header->top_dir));
+#ifdef KPSE_DEBUG
+      if (KPATHSEA_DEBUG_P (KPSE_DEBUG_HASH)) {
+        DEBUGF3 ("%s%s: %u entries.\n", db_files[dbi], DB_INDEX_SUFFIX,
+                 idx->header->entry_count);
+      }
+#endif
+    }
+    ok = true;
+  } else {
+    kpse->db = hash_create (DB_HASH_SIZE);
+  }
 
-  while (db_files && *db_files) {
-    if (db_build (kpse, &(kpse->db), *db_files))
+  while (kpse->db_index_count == 0 && db_files && *db_files) {
+    if (db_build (kpse, &(kpse->db), *db_files, NULL))
       ok = true;
-    free (*db_files);
     db_files++;
   }
 
+  for (db_files = orig_db_files; *db_files; db_files++)
+    free (*db_files);
+
   if (!ok) {
     /* If db can't be built, leave `size' nonzero (so we don't
        rebuild it), but clear `buckets' (so we don't look in it).  */
@@ -577,7 +1020,7 @@ kpathsea_db_search (kpathsea kpse, const_string name,
     const_string ctry = *r;
 
     /* We have an ls-R db.  Look up `try'.  */
-    orig_dirs = db_dirs = hash_lookup (kpse->db, ctry);
+    orig_dirs = db_dirs = db_lookup (kpse, ctry);
 
     ret = XTALLOC1 (str_list_type);
     *ret = str_list_init ();
@@ -738,7 +1181,7 @@ kpathsea_db_search_list (kpathsea kpse, string* names,
           const_string ctry = *r;
 
           /* We have an ls-R db.  Look up `try'.  */
-          orig_dirs = db_dirs = hash_lookup (kpse->db, ctry);
+          orig_dirs = db_dirs = db_lookup (kpse, ctry);
 
           /* For each filename found, see if it matches the path element.  For
              example, if we have .../cx/cmr10.300pk and .../ricoh/cmr10.300pk,
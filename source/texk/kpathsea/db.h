@@ -19,10 +19,17 @@
 #ifndef KPATHSEA_DB_H
 #define KPATHSEA_DB_H
 
-#ifdef MAKE_KPSE_DLL /* libkpathsea internal only */
-
 #include <kpathsea/c-proto.h>
 #include <kpathsea/types.h>
+
+/* Write the binary index DB_FILENAME.idx for the ls-R DB_FILENAME, to
+   be used instead of the text form as long as the ls-R is unchanged.
+   Return false if that fails.  */
+extern KPSEDLL boolean kpathsea_db_compile (kpathsea kpse,
+                                            const_string db_filename);
+
+#ifdef MAKE_KPSE_DLL /* libkpathsea internal only */
+
 #include <kpathsea/str-list.h>
 
 /* Initialize the database.  Until this is called, no ls-R matches will
@@ -48,6 +55,9 @@ extern str_list_type *kpathsea_db_search_list (kpathsea kpse,
    Called by mktex() in tex-make.c.  */
 extern void kpathsea_db_insert (kpathsea kpse, const_string fname);
 
+/* Unmap the binary ls-R indexes.  Called by kpathsea_finish.  */
+extern void kpathsea_db_index_free (kpathsea kpse);
+
 #endif /* MAKE_KPSE_DLL */
 
 #endif /* not KPATHSEA_DB_H */
@@ -23,6 +23,7 @@
  */
 
 #include <kpathsea/config.h>
+#include <kpathsea/db.h>
 
 kpathsea
 kpathsea_new (void)
@@ -71,9 +72,15 @@ kpathsea_finish (kpathsea kpse)
 #endif /* KPATHSEA_CAN_FREE */
     if (kpse==NULL)
         return;
+    /* the ls-R indexes are mappings, not just memory */
+    kpathsea_db_index_free (kpse);
 #if KPATHSEA_CAN_FREE
     /* free internal stuff */
     hash_free (kpse->cnf_hash);
+    /* the keys and values of cnf_expanded are in cnf_expanded_buf */
+    string_free (kpse->cnf_expanded_buf);
+    string_free (kpse->cnf_expanded_prog);
+    str_list_free (&kpse->cnf_expanded_env);
     hash_free (kpse->db);
     hash_free (kpse->alias_db);
     str_list_free (&kpse->db_dir_list);
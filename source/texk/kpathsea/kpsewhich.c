@@ -19,6 +19,8 @@
 #include <kpathsea/config.h>
 #include <kpathsea/c-ctype.h>
 #include <kpathsea/c-pathch.h>
+#include <kpathsea/cnf.h>
+#include <kpathsea/db.h>
 #include <kpathsea/expand.h>
 #include <kpathsea/getopt.h>
 #include <kpathsea/line.h>
@@ -38,6 +40,12 @@ string path_to_expand = NULL;
 string path_to_show = NULL;
 string var_to_value = NULL;
 
+/* The ls-R to write a binary index for.  (-compile-db) */
+string db_to_compile = NULL;
+
+/* The file to write a cnf snapshot to.  (-cnf-snapshot) */
+string cnf_snapshot = NULL;
+
 /* Base resolution. (-D, -dpi) */
 unsigned dpi = 600;
 
@@ -473,6 +481,9 @@ to also use -engine, or nothing will be returned; in particular,\n\
 \n\
 -all                   output all matches, one per line (no effect with pk/gf).\n\
 [-no]-casefold-search  fall back to case-insensitive search if no exact match.\n\
+-cnf-snapshot=FILE     write the texmf.cnf values, read and expanded, to FILE\n\
+                       (see KPATHSEA_SNAPSHOT).\n\
+-compile-db=FILE       write the binary index FILE.idx for the ls-R FILE.\n\
 -debug=NUM             set debugging flags.\n\
 -D, -dpi=NUM           use a base resolution of NUM; default 600.\n\
 -engine=STRING         set engine name to STRING.\n\
@@ -586,6 +597,8 @@ static struct option long_options[]
   = { { "D",                    1, 0, 0 },
       { "all",                  0, (int *) &show_all, 1 },
       { "casefold-search",      0, 0, 0 },
+      { "cnf-snapshot",         1, 0, 0 },
+      { "compile-db",           1, 0, 0 },
       { "debug",                1, 0, 0 },
       { "dpi",                  1, 0, 0 },
       { "engine",               1, 0, 0 },
@@ -634,6 +647,12 @@ read_command_line (kpathsea kpse, int argc, string *argv)
          (by default).  */
       xputenv ("texmf_casefold_search", "1");      
 
+    } else if (ARGUMENT_IS ("cnf-snapshot")) {
+      cnf_snapshot = optarg;
+
+    } else if (ARGUMENT_IS ("compile-db")) {
+      db_to_compile = optarg;
+
     } else if (ARGUMENT_IS ("debug")) {
       kpse->debug |= atoi (optarg);
 
@@ -719,7 +738,8 @@ There is NO WARRANTY, to the extent permitted by law.\n");
   if (optind == argc
       && !var_to_expand && !braces_to_expand && !path_to_expand
       && !path_to_show && !var_to_value
-      && !safe_in_name && !safe_out_name) {
+      && !safe_in_name && !safe_out_name && !db_to_compile
+      && !cnf_snapshot) {
     fputs ("Missing argument. Try `kpsewhich --help' for more information.\n",
            stderr);
     exit (1);
@@ -855,6 +875,21 @@ main (int argc,  string *argv)
 #endif
   }
 
+  if (db_to_compile) {
+    if (!kpathsea_db_compile (kpse, db_to_compile)) {
+      WARNING1 ("kpsewhich: Could not write an index for `%s'", db_to_compile);
+      unfound++;
+    }
+  }
+
+  if (cnf_snapshot) {
+    if (!kpathsea_cnf_write_snapshot (kpse, cnf_snapshot)) {
+      WARNING1 ("kpsewhich: Could not write the cnf snapshot `%s'",
+                cnf_snapshot);
+      unfound++;
+    }
+  }
+
   if (safe_in_name) {
     if (!kpathsea_in_name_ok_silent (kpse, safe_in_name))
       unfound++;
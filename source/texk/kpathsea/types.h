@@ -217,6 +217,9 @@ struct passwd {
 
 typedef struct kpathsea_instance *kpathsea;
 
+/* A mapped binary ls-R index, see db.c.  */
+typedef struct db_index_struct db_index_type;
+
 typedef struct kpathsea_instance {
     /* from cnf.c */
     p_record_input record_input;        /* for --recorder */
@@ -302,6 +305,14 @@ typedef struct kpathsea_instance {
     char st_buff[5];
     char *st_str;
 #endif
+    /* from db.c, added last to keep the layout of the fields above */
+    db_index_type **db_index;           /* binary indexes of the ls-R's */
+    unsigned db_index_count;            /* zero if using the text ones */
+    /* from cnf.c, likewise */
+    hash_table_type cnf_expanded;       /* expanded values of the snapshot */
+    string cnf_expanded_prog;           /* the program they were made for */
+    str_list_type cnf_expanded_env;     /* the environment they need */
+    string cnf_expanded_buf;            /* where both of these point to */
 } kpathsea_instance;
 
 /* these come from kpathsea.c */
@@ -35,6 +35,11 @@ kpathsea_var_value (kpathsea kpse, const_string var)
 
   assert (kpse->program_name);
 
+  /* A cnf snapshot may have the value expanded already.  */
+  ret = kpathsea_cnf_expanded (kpse, var);
+  if (ret)
+    goto done;
+
   /* First look for VAR.progname. */
   vtry = concat3 (var, ".", kpse->program_name);
   value = getenv (vtry);
@@ -62,6 +67,7 @@ kpathsea_var_value (kpathsea kpse, const_string var)
      worry about doing the ~ expansion.  */
   ret = value ? kpathsea_expand (kpse, value) : NULL;
 
+done:
 #ifdef KPSE_DEBUG
   if (KPATHSEA_DEBUG_P (KPSE_DEBUG_VARS))
     DEBUGF2("variable: %s = %s\n", var, ret ? ret : "(nil)");
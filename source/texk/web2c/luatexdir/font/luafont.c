@@ -985,6 +985,326 @@ static void read_char_packets(lua_State * L, int *l_fonts, charinfo * co, intern
     return;
 }
 
+/*tex
+
+    The optional |shaping| table provides lookups that are applied natively to
+    the glyphs of this font, in the given order:
+
+    \starttyping
+    shaping = {
+        { type = "single",   data = { [a] = b } },
+        { type = "multiple", data = { [a] = { b, c } } },
+        { type = "ligature", data = { [a] = { { b, c, abc }, { b, ab } } } },
+        { type = "context",  data = { { before = { }, current = { }, after = { }, lookups = { } } } },
+        { type = "pair",     data = { [a] = { [b] = kern } } },
+        { type = "mark",     data = { [m] = { [a] = { dx, dy } } } },
+    }
+    \stoptyping
+
+    A ligature sequence lists the following characters and ends with the
+    result. The classes in a contextual rule are characters or lists of
+    characters and |lookups| maps positions in |current| onto (the index of) a
+    single substitution lookup in the same table. Such a lookup can be flagged
+    with |active = false| when it should only be applied via these rules. Mark
+    offsets are relative to the origin of the base character. All dimensions
+    are scaled points.
+
+*/
+
+#define max_shaping_classes 32
+
+static const char *shaping_type_strings[] = {
+    "unknown", "single", "multiple", "ligature", "context", "pair", "mark", NULL
+};
+
+static int shaping_compare(const void *a, const void *b)
+{
+    return ((const shapestep *) a)->key - ((const shapestep *) b)->key;
+}
+
+static int *new_shaping_data(shapestep * step, int size)
+{
+    step->size = size;
+    step->data = xmalloc((unsigned) ((unsigned) size * sizeof(int)));
+    font_bytes += (int) ((unsigned) size * sizeof(int));
+    return step->data;
+}
+
+static int shaping_class_size(lua_State * L)
+{
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        return 2;
+    } else if (lua_istable(L, -1)) {
+        return 1 + (int) lua_rawlen(L, -1);
+    } else {
+        return 1;
+    }
+}
+
+static int *store_shaping_class(lua_State * L, int *d)
+{
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        *d++ = 1;
+        *d++ = (int) lua_tointeger(L, -1);
+    } else if (lua_istable(L, -1)) {
+        int i;
+        int n = (int) lua_rawlen(L, -1);
+        *d++ = n;
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            *d++ = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+    } else {
+        *d++ = 0;
+    }
+    return d;
+}
+
+static int shaping_classes_size(lua_State * L, int name_index, int *n)
+{
+    int i;
+    int size = 0;
+    *n = 0;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, name_index);
+    lua_rawget(L, -2);
+    if (lua_istable(L, -1)) {
+        *n = (int) lua_rawlen(L, -1);
+        for (i = 1; i <= *n; i++) {
+            lua_rawgeti(L, -1, i);
+            size += shaping_class_size(L);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return size;
+}
+
+static int *store_shaping_classes(lua_State * L, int name_index, int *d)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, name_index);
+    lua_rawget(L, -2);
+    if (lua_istable(L, -1)) {
+        int i;
+        int n = (int) lua_rawlen(L, -1);
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            d = store_shaping_class(L, d);
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return d;
+}
+
+/*tex
+
+    A contextual rule is stored as the number of |before|, |current| and
+    |after| classes, followed by the classes themselves (each prefixed by its
+    size) and finally the lookup index per |current| position.
+
+*/
+
+static int read_shaping_rule(lua_State * L, shapestep * step)
+{
+    int i, nb, nc, na, size;
+    int *d;
+    if (!lua_istable(L, -1))
+        return 0;
+    size = 3;
+    size += shaping_classes_size(L, lua_key_index(before), &nb);
+    size += shaping_classes_size(L, lua_key_index(current), &nc);
+    size += shaping_classes_size(L, lua_key_index(after), &na);
+    if (nc == 0 || nb + nc + na > max_shaping_classes)
+        return 0;
+    size += nc;
+    d = new_shaping_data(step, size);
+    step->key = 0;
+    *d++ = nb;
+    *d++ = nc;
+    *d++ = na;
+    d = store_shaping_classes(L, lua_key_index(before), d);
+    d = store_shaping_classes(L, lua_key_index(current), d);
+    d = store_shaping_classes(L, lua_key_index(after), d);
+    lua_key_rawgeti(lookups);
+    for (i = 1; i <= nc; i++) {
+        d[i-1] = 0;
+        if (lua_istable(L, -1)) {
+            lua_rawgeti(L, -1, i);
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                d[i-1] = (int) lua_tointeger(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+    }
+    lua_pop(L, 1);
+    return 1;
+}
+
+/*tex The key is at |-2| and the value at |-1|. */
+
+static int read_shaping_step(lua_State * L, int type, shapestep * step)
+{
+    int i, n;
+    int size = 0;
+    int *d;
+    if (lua_type(L, -2) != LUA_TNUMBER)
+        return 0;
+    step->key = (int) lua_tointeger(L, -2);
+    if (type == single_shaping) {
+        if (lua_type(L, -1) != LUA_TNUMBER)
+            return 0;
+        d = new_shaping_data(step, 1);
+        d[0] = (int) lua_tointeger(L, -1);
+        return 1;
+    }
+    if (!lua_istable(L, -1))
+        return 0;
+    if (type == multiple_shaping) {
+        n = (int) lua_rawlen(L, -1);
+        if (n == 0)
+            return 0;
+        d = new_shaping_data(step, n);
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            d[i-1] = (int) lua_tointeger(L, -1);
+            lua_pop(L, 1);
+        }
+    } else if (type == ligature_shaping) {
+        /*tex Each sequence becomes its length, the following characters and the result. */
+        n = (int) lua_rawlen(L, -1);
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            if (lua_istable(L, -1) && lua_rawlen(L, -1) > 1) {
+                size += 1 + (int) lua_rawlen(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+        if (size == 0)
+            return 0;
+        d = new_shaping_data(step, size);
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, -1, i);
+            if (lua_istable(L, -1) && lua_rawlen(L, -1) > 1) {
+                int j;
+                int m = (int) lua_rawlen(L, -1);
+                *d++ = m - 1;
+                for (j = 1; j <= m; j++) {
+                    lua_rawgeti(L, -1, j);
+                    *d++ = (int) lua_tointeger(L, -1);
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 1);
+        }
+    } else if (type == pair_shaping || type == mark_shaping) {
+        /*tex A pair becomes the second character and a kern, a mark the base and two offsets. */
+        int width = (type == pair_shaping) ? 2 : 3;
+        n = 0;
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            if (lua_type(L, -2) == LUA_TNUMBER) {
+                n++;
+            }
+            lua_pop(L, 1);
+        }
+        if (n == 0)
+            return 0;
+        d = new_shaping_data(step, width * n);
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            if (lua_type(L, -2) == LUA_TNUMBER) {
+                *d++ = (int) lua_tointeger(L, -2);
+                if (type == pair_shaping) {
+                    *d++ = (int) lua_roundnumber(L, -1);
+                } else if (lua_istable(L, -1)) {
+                    lua_rawgeti(L, -1, 1);
+                    *d++ = (int) lua_roundnumber(L, -1);
+                    lua_rawgeti(L, -2, 2);
+                    *d++ = (int) lua_roundnumber(L, -1);
+                    lua_pop(L, 2);
+                } else {
+                    *d++ = 0;
+                    *d++ = 0;
+                }
+            }
+            lua_pop(L, 1);
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static void read_shaping_lookup(lua_State * L, shapelookup * l)
+{
+    int n = 0;
+    if (l->type == context_shaping) {
+        int i;
+        int m = (int) lua_rawlen(L, -1);
+        l->steps = xcalloc((unsigned) (m + 1), sizeof(shapestep));
+        for (i = 1; i <= m; i++) {
+            lua_rawgeti(L, -1, i);
+            if (read_shaping_rule(L, &(l->steps[n]))) {
+                n++;
+            }
+            lua_pop(L, 1);
+        }
+    } else {
+        int m = 0;
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            m++;
+            lua_pop(L, 1);
+        }
+        l->steps = xcalloc((unsigned) (m + 1), sizeof(shapestep));
+        lua_pushnil(L);
+        while (lua_next(L, -2) != 0) {
+            if (read_shaping_step(L, l->type, &(l->steps[n]))) {
+                n++;
+            }
+            lua_pop(L, 1);
+        }
+        qsort(l->steps, (size_t) n, sizeof(shapestep), shaping_compare);
+    }
+    font_bytes += (int) ((unsigned) n * sizeof(shapestep));
+    l->nofsteps = n;
+}
+
+static void read_lua_shaping(lua_State * L, int f)
+{
+    lua_key_rawgeti(shaping);
+    if (lua_istable(L, -1)) {
+        int n = (int) lua_rawlen(L, -1);
+        if (n > 0) {
+            int i;
+            shapeinfo *s = xmalloc(sizeof(shapeinfo));
+            s->references = 1;
+            s->noflookups = n;
+            s->lookups = xcalloc((unsigned) n, sizeof(shapelookup));
+            font_bytes += (int) (sizeof(shapeinfo) + (unsigned) n * sizeof(shapelookup));
+            for (i = 1; i <= n; i++) {
+                /*tex Invalid lookups keep their slot because contextual rules refer to them. */
+                shapelookup *l = &(s->lookups[i-1]);
+                lua_rawgeti(L, -1, i);
+                if (lua_istable(L, -1)) {
+                    l->type = n_enum_field(L, lua_key_index(type), unknown_shaping, shaping_type_strings);
+                    l->enabled = n_boolean_field(L, lua_key_index(active), 1);
+                    lua_key_rawgeti(data);
+                    if (lua_istable(L, -1) && l->type != unknown_shaping) {
+                        read_shaping_lookup(L, l);
+                    }
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+            release_shapeinfo(font_shaping(f));
+            set_font_shaping(f, s);
+        }
+    }
+    lua_pop(L, 1);
+}
+
 static void read_lua_cidinfo(lua_State * L, int f)
 {
     int i;
@@ -1529,7 +1849,7 @@ int font_from_lua(lua_State * L, int f)
     set_font_used(f, (char) i);
     s = n_string_field_copy(L, lua_key_index(attributes), NULL);
     if (s != NULL && strlen(s) > 0) {
-        i = maketexstring(s);
+        i = maketexlstring_shared(s, strlen(s));
         set_pdf_font_attr(f, i);
     }
     free(s);
@@ -1618,6 +1938,7 @@ int font_from_lua(lua_State * L, int f)
         set_font_oldmath(f,true);
     }
     read_lua_cidinfo(L, f);
+    read_lua_shaping(L, f);
     /*tex The characters. */
     lua_key_rawgeti(characters);
     if (lua_istable(L, -1)) {
@@ -2262,16 +2583,25 @@ halfword handle_ligaturing(halfword head, halfword tail)
 }
 
 
-/*tex Kerning starts here: */
+/*tex
+
+    Kerning starts here. A kern injected by a pair lookup in the shaping pass
+    wins over the \TFM\ kern of the same pair. Other font kerns that happen to
+    be present are left alone as before.
+
+*/
 
 static void add_kern_before(halfword left, halfword right)
 {
+    halfword prev = alink(right);
+    if (type(prev) == kern_node && shaping_kern(prev)) {
+        return;
+    }
     if ((!is_rightghost(right)) &&
         font(left) == font(right) && has_kern(font(left), character(left))) {
         int k = raw_get_kern(font(left), character(left), character(right));
         if (k != 0) {
             halfword kern = new_kern(k);
-            halfword prev = alink(right);
             couple_nodes(prev, kern);
             couple_nodes(kern, right);
             /*tex Update the attribute list (inherit from left): */
@@ -2392,6 +2722,340 @@ halfword handle_kerning(halfword head, halfword tail)
     return tail;
 }
 
+/*tex
+
+    Native shaping starts here. A run is a sequence of glyphs in the same font
+    that carries shaping lookups. Each lookup is applied to the whole run before
+    the next one is looked at, as \OPENTYPE\ prescribes. Font kerns that got
+    injected by pair lookups are skipped when moving through the run.
+
+*/
+
+static int shaping_glyph(halfword p, internal_font_number f)
+{
+    return (p != null && type(p) == glyph_node && font(p) == f && character(p) >= 0 && !is_ghost(p));
+}
+
+static halfword shaping_next(halfword p, internal_font_number f)
+{
+    p = vlink(p);
+    while (p != null && type(p) == kern_node && subtype(p) == font_kern) {
+        p = vlink(p);
+    }
+    return shaping_glyph(p, f) ? p : null;
+}
+
+static halfword shaping_prev(halfword p, internal_font_number f)
+{
+    p = alink(p);
+    while (p != null && type(p) == kern_node && subtype(p) == font_kern) {
+        p = alink(p);
+    }
+    return shaping_glyph(p, f) ? p : null;
+}
+
+static shapestep *shaping_step(shapelookup * l, int c)
+{
+    int lo = 0;
+    int hi = l->nofsteps - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int k = l->steps[mid].key;
+        if (k == c) {
+            return &(l->steps[mid]);
+        } else if (k < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+static int shaping_in_class(int *d, int c)
+{
+    int i;
+    for (i = 1; i <= d[0]; i++) {
+        if (d[i] == c) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static halfword shaping_copy(halfword p, int c)
+{
+    halfword g = copy_node(p);
+    if (lig_ptr(g) != null) {
+        flush_node_list(lig_ptr(g));
+        lig_ptr(g) = null;
+    }
+    character(g) = c;
+    return g;
+}
+
+static halfword shaping_multiple(halfword p, shapestep * step)
+{
+    int i;
+    character(p) = step->data[0];
+    for (i = 1; i < step->size; i++) {
+        halfword g = shaping_copy(p, step->data[i]);
+        halfword next = vlink(p);
+        couple_nodes(p, g);
+        try_couple_nodes(g, next);
+        p = g;
+    }
+    return p;
+}
+
+/*tex The components of the ligature end up in its |lig_ptr| like in |try_ligature|. */
+
+static void shaping_ligature(halfword first, halfword last, int c)
+{
+    halfword comp = copy_node(first);
+    halfword after = vlink(last);
+    alink(comp) = null;
+    vlink(comp) = null;
+    if (last != first) {
+        couple_nodes(comp, vlink(first));
+        vlink(last) = null;
+    }
+    flush_node_list(lig_ptr(first));
+    lig_ptr(first) = comp;
+    try_couple_nodes(first, after);
+    character(first) = c;
+    set_is_ligature(first);
+}
+
+static void shaping_try_ligature(halfword p, shapestep * step, internal_font_number f)
+{
+    int *d = step->data;
+    int *e = d + step->size;
+    int found = 0;
+    int result = 0;
+    halfword last = null;
+    while (d < e) {
+        int j;
+        int n = d[0];
+        halfword q = p;
+        for (j = 1; j <= n; j++) {
+            q = shaping_next(q, f);
+            if (q == null || character(q) != d[j]) {
+                break;
+            }
+        }
+        if (j > n && n > found) {
+            found = n;
+            result = d[n+1];
+            last = q;
+        }
+        d += n + 2;
+    }
+    if (found) {
+        shaping_ligature(p, last, result);
+    }
+}
+
+static void shaping_context(shapeinfo * s, shapelookup * l, halfword p, internal_font_number f)
+{
+    int r;
+    for (r = 0; r < l->nofsteps; r++) {
+        int i, nb, nc, na;
+        int *classes[max_shaping_classes];
+        halfword current[max_shaping_classes];
+        int *d = l->steps[r].data;
+        halfword q = p;
+        nb = *d++;
+        nc = *d++;
+        na = *d++;
+        for (i = 0; i < nb + nc + na; i++) {
+            classes[i] = d;
+            d += d[0] + 1;
+        }
+        /*tex We're now at the lookups. */
+        for (i = 0; i < nc; i++) {
+            if (q == null || !shaping_in_class(classes[nb+i], character(q))) {
+                break;
+            }
+            current[i] = q;
+            q = shaping_next(q, f);
+        }
+        if (i < nc) {
+            continue;
+        }
+        for (i = 0; i < na; i++) {
+            if (q == null || !shaping_in_class(classes[nb+nc+i], character(q))) {
+                break;
+            }
+            q = shaping_next(q, f);
+        }
+        if (i < na) {
+            continue;
+        }
+        q = shaping_prev(p, f);
+        for (i = nb - 1; i >= 0; i--) {
+            if (q == null || !shaping_in_class(classes[i], character(q))) {
+                break;
+            }
+            q = shaping_prev(q, f);
+        }
+        if (i >= 0) {
+            continue;
+        }
+        for (i = 0; i < nc; i++) {
+            int k = d[i];
+            if (k > 0 && k <= s->noflookups && s->lookups[k-1].type == single_shaping) {
+                shapestep *step = shaping_step(&(s->lookups[k-1]), character(current[i]));
+                if (step != NULL) {
+                    character(current[i]) = step->data[0];
+                }
+            }
+        }
+        return;
+    }
+}
+
+static void shaping_pair(halfword p, shapestep * step, internal_font_number f)
+{
+    int i;
+    halfword q = shaping_next(p, f);
+    if (q == null) {
+        return;
+    }
+    for (i = 0; i < step->size; i += 2) {
+        if (step->data[i] == character(q)) {
+            /*tex
+                A zero kern is not injected, so then the \TFM\ kern of the
+                pair, if any, is added by the kerning pass.
+            */
+            halfword kern, next;
+            if (step->data[i+1] == 0) {
+                return;
+            }
+            kern = new_kern(step->data[i+1]);
+            shaping_kern(kern) = 1;
+            next = vlink(p);
+            couple_nodes(p, kern);
+            couple_nodes(kern, next);
+            /*tex Update the attribute list (inherit from left): */
+            delete_attribute_ref(node_attr(kern));
+            add_node_attr_ref(node_attr(p));
+            node_attr(kern) = node_attr(p);
+            return;
+        }
+    }
+}
+
+/*tex
+
+    The mark is positioned relative to the nearest preceding base that the
+    lookup knows about, so we need to compensate for what is in between.
+
+*/
+
+static void shaping_mark(halfword p, shapestep * step, internal_font_number f)
+{
+    scaled w = 0;
+    halfword q = alink(p);
+    while (q != null) {
+        if (shaping_glyph(q, f)) {
+            int i;
+            w += char_width(f, character(q));
+            for (i = 0; i < step->size; i += 3) {
+                if (step->data[i] == character(q)) {
+                    x_displace(p) = x_displace(q) + step->data[i+1] - w;
+                    y_displace(p) = y_displace(q) + step->data[i+2];
+                    return;
+                }
+            }
+        } else if (type(q) == kern_node && subtype(q) == font_kern) {
+            w += width(q);
+        } else {
+            return;
+        }
+        q = alink(q);
+    }
+}
+
+static halfword shaping_run(halfword first)
+{
+    int i;
+    internal_font_number f = font(first);
+    shapeinfo *s = font_shaping(f);
+    halfword p, last;
+    for (i = 0; i < s->noflookups; i++) {
+        shapelookup *l = &(s->lookups[i]);
+        if (l->nofsteps == 0 || ! l->enabled) {
+            continue;
+        }
+        p = first;
+        while (p != null) {
+            if (l->type == context_shaping) {
+                shaping_context(s, l, p, f);
+            } else {
+                shapestep *step = shaping_step(l, character(p));
+                if (step != NULL) {
+                    switch (l->type) {
+                        case single_shaping:
+                            character(p) = step->data[0];
+                            break;
+                        case multiple_shaping:
+                            p = shaping_multiple(p, step);
+                            break;
+                        case ligature_shaping:
+                            shaping_try_ligature(p, step, f);
+                            break;
+                        case pair_shaping:
+                            shaping_pair(p, step, f);
+                            break;
+                        case mark_shaping:
+                            shaping_mark(p, step, f);
+                            break;
+                    }
+                }
+            }
+            p = shaping_next(p, f);
+        }
+    }
+    last = first;
+    while ((p = shaping_next(last, f)) != null) {
+        last = p;
+    }
+    return last;
+}
+
+halfword handle_shaping(halfword head, halfword tail)
+{
+    /*tex A trick to allow explicit |node==null| tests. */
+    halfword save_tail1 = null;
+    halfword cur, prev;
+    if (vlink(head) == null)
+        return tail;
+    if (tail != null) {
+        save_tail1 = vlink(tail);
+        vlink(tail) = null;
+    }
+    prev = head;
+    cur = vlink(prev);
+    while (cur != null) {
+        if (type(cur) == glyph_node) {
+            if (font_shaping(font(cur)) != NULL && shaping_glyph(cur, font(cur))) {
+                cur = shaping_run(cur);
+            }
+        } else if (type(cur) == disc_node) {
+            tlink(pre_break(cur)) = handle_shaping(pre_break(cur), null);
+            tlink(post_break(cur)) = handle_shaping(post_break(cur), null);
+            tlink(no_break(cur)) = handle_shaping(no_break(cur), null);
+        }
+        prev = cur;
+        cur = vlink(cur);
+    }
+    if (tail != null) {
+        try_couple_nodes(prev, save_tail1);
+    }
+    return prev;
+}
+
 /*tex The ligaturing and kerning \LUA\ interface: */
 
 static halfword run_lua_ligkern_callback(halfword head, halfword tail, int callback_id)
@@ -2428,6 +3092,7 @@ halfword new_ligkern(halfword head, halfword tail)
         if (tail == null)
             tail = tail_of_list(head);
     } else if (callback_id == 0) {
+        tail = handle_shaping(head, tail);
         tail = handle_ligaturing(head, tail);
     }
     callback_id = callback_defined(kerning_callback);
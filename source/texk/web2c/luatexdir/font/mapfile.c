@@ -34,7 +34,7 @@ static unsigned char *fm_buffer = NULL;
 static int fm_size = 0;
 static int fm_curbyte = 0;
 
-#define fm_open(a)        (fm_file = fopen((char *)(a), FOPEN_RBIN_MODE))
+#define fm_open(a)        (fm_file = texmf_fopen((char *)(a), FOPEN_RBIN_MODE))
 #define fm_read_file()    readbinfile(fm_file,&fm_buffer,&fm_size)
 #define fm_close()        xfclose(fm_file, cur_file_name)
 #define fm_getchar()      fm_buffer[fm_curbyte++]
@@ -32,7 +32,7 @@ static int sfd_curbyte = 0;
 #define SFD_BUF_SIZE    SMALL_BUF_SIZE
 
 #define sfd_close()     xfclose(sfd_file, cur_file_name)
-#define sfd_open(a)     (sfd_file = fopen((char *)(a), FOPEN_RBIN_MODE))
+#define sfd_open(a)     (sfd_file = texmf_fopen((char *)(a), FOPEN_RBIN_MODE))
 
 #define sfd_read_file() readbinfile(sfd_file,&sfd_buffer,&sfd_size)
 #define sfd_getchar()   sfd_buffer[sfd_curbyte++]
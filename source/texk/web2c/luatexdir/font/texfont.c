@@ -230,6 +230,7 @@ charinfo *copy_charinfo(charinfo * ci)
     co->name = NULL;
     co->tounicode = NULL;
     co->packets = NULL;
+    co->program = NULL;
     co->ligatures = NULL;
     co->kerns = NULL;
     co->vert_variants = NULL;
@@ -592,6 +593,7 @@ void set_charinfo_kerns(charinfo * ci, kerninfo * val)
 void set_charinfo_packets(charinfo * ci, eight_bits * val)
 {
     dxfree(ci->packets, val);
+    free_vf_program(ci);
 }
 
 void set_charinfo_ef(charinfo * ci, scaled val)
@@ -1133,11 +1135,31 @@ int copy_font(int f)
         ci = copy_charinfo(right_boundary(f));
         set_charinfo(k, right_boundarychar, ci);
     }
+    /*tex The shaping lookups don't depend on the size so we can share them. */
+    if (font_shaping(k) != NULL) {
+        font_shaping(k)->references++;
+    }
     /*tex Not updated yet: */
     font_tables[k]->charinfo_count = font_tables[f]->charinfo_count;
     return k;
 }
 
+void release_shapeinfo(shapeinfo * s)
+{
+    int i, j;
+    if (s == NULL || --s->references > 0)
+        return;
+    for (i = 0; i < s->noflookups; i++) {
+        shapelookup *l = &(s->lookups[i]);
+        for (j = 0; j < l->nofsteps; j++) {
+            free(l->steps[j].data);
+        }
+        free(l->steps);
+    }
+    free(s->lookups);
+    free(s);
+}
+
 void delete_font(int f)
 {
     int i;
@@ -1154,6 +1176,8 @@ void delete_font(int f)
         set_font_cidordering(f, NULL);
         set_left_boundary(f, NULL);
         set_right_boundary(f, NULL);
+        release_shapeinfo(font_shaping(f));
+        set_font_shaping(f, NULL);
         for (i = font_bc(f); i <= font_ec(f); i++) {
             if (quick_char_exists(f, i)) {
                 co = char_info(f, i);
@@ -1893,7 +1917,7 @@ void new_letterspaced_font(small_number a)
     if (u >= hash_base)
         t = cs_text(u);
     else
-        t = maketexstring("FONT");
+        t = maketexlstring_shared("FONT", 4);
     define(u, set_font_cmd, null_font);
     scan_optional_equals();
     scan_font_ident();
@@ -1924,7 +1948,7 @@ void make_font_copy(small_number a)
     if (u >= hash_base)
         t = cs_text(u);
     else
-        t = maketexstring("FONT");
+        t = maketexlstring_shared("FONT", 4);
     define(u, set_font_cmd, null_font);
     scan_optional_equals();
     scan_font_ident();
@@ -85,6 +85,7 @@ typedef struct charinfo {
     liginfo *ligatures;         /* ligature items */
     kerninfo *kerns;            /* kern items */
     eight_bits *packets;        /* virtual commands.  */
+    struct vf_program *program; /* compiled virtual commands, see vfpacket.c */
     unsigned short index;       /* CID index */
     int remainder;              /* spare value for odd items, could be union-ed with extensible */
     scaled width;               /* width */
@@ -128,6 +129,43 @@ extern extinfo *new_variant(int glyph, int startconnect, int endconnect, int adv
 
 extern scaled_whd get_charinfo_whd(internal_font_number f, int c);
 
+/*
+    Native shaping data: an ordered list of lookups, each with steps that are
+    sorted on their (first) character. The meaning of the |data| array depends
+    on the lookup type. The information is shared between copies of a font.
+*/
+
+typedef enum {
+    unknown_shaping = 0,
+    single_shaping,
+    multiple_shaping,
+    ligature_shaping,
+    context_shaping,
+    pair_shaping,
+    mark_shaping,
+} shaping_types;
+
+typedef struct shapestep {
+    int key;                    /* (first) character */
+    int size;                   /* number of entries in |data| */
+    int *data;                  /* lookup type specific */
+} shapestep;
+
+typedef struct shapelookup {
+    int type;
+    int enabled;                /* false when only used in contextual rules */
+    int nofsteps;
+    shapestep *steps;
+} shapelookup;
+
+typedef struct shapeinfo {
+    int references;
+    int noflookups;
+    shapelookup *lookups;
+} shapeinfo;
+
+extern void release_shapeinfo(shapeinfo * s);
+
 typedef struct texfont {
     int _font_size;
     int _font_dsize;
@@ -188,6 +226,8 @@ typedef struct texfont {
     int *charinfo_cache;
     int ligatures_disabled;
 
+    shapeinfo *_font_shaping;   /* native shaping lookups */
+
     int _pdf_font_num;          /* maps to a PDF resource ID */
     str_number _pdf_font_attr;  /* pointer to additional attributes */
 } texfont;
@@ -379,6 +419,9 @@ boolean cmp_font_area(int, str_number);
 #  define font_natural_dir(a)            font_tables[a]->_font_natural_dir
 #  define set_font_natural_dir(a,b)      font_natural_dir(a) = b
 
+#  define font_shaping(a)                font_tables[a]->_font_shaping
+#  define set_font_shaping(a,b)          font_shaping(a) = b
+
 #  define pdf_font_num(a)                font_tables[a]->_pdf_font_num
 #  define set_pdf_font_num(a,b)          pdf_font_num(a) = b
 
@@ -651,10 +694,33 @@ typedef enum { packet_char_code,
     packet_pdf_mode
 } packet_command_codes;
 
+/*
+    A packet is compiled into an array of instructions the first time it is
+    shipped out: offsets are scaled and font switches are folded into the
+    character instructions. Strings point into the packet itself.
+*/
+
+typedef struct vf_instruction {
+    int cmd;                    /* a packet command code */
+    int a;                      /* font, amount, width, mode or reference */
+    int b;                      /* character, height or string length */
+    union {
+        float f;                /* scale factor */
+        eight_bits *s;          /* special or pdf literal */
+    } v;
+} vf_instruction;
+
+typedef struct vf_program {
+    int size;                   /* the font size the amounts are scaled for */
+    int count;
+    vf_instruction code[1];
+} vf_program;
+
 extern scaled store_scaled_f(scaled sq, int fw);
 
 extern void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex);
 extern int vf_packet_bytes(charinfo * co);
+extern void free_vf_program(charinfo * co);
 
 extern charinfo *copy_charinfo(charinfo * ci);
 
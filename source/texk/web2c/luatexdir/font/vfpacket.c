@@ -150,6 +150,145 @@ static float packet_float(eight_bits ** vfpp)
     return u.a;
 }
 
+/*tex
+
+    A packet is compiled into a |vf_program| the first time it is needed. Scaled
+    amounts are converted with the size of the virtual font, so the program is
+    redone when that size is not the one it was made for. Font switches are
+    folded into the character instructions. When there is \LUA\ code in the
+    packet we keep them, because the code can query and change the current font;
+    characters that come after the code use the font that is current at that
+    moment.
+
+*/
+
+#define vf_program_step 16
+
+static vf_program *compile_vf_packet(eight_bits * vfp, int fs)
+{
+    int cmd, lf = 0, dynamic = 0, lua = 0;
+    int n = 0, m = vf_program_step;
+    unsigned k;
+    vf_instruction *ip;
+    vf_program *vpr = xmalloc(sizeof(vf_program) + (size_t) (m - 1) * sizeof(vf_instruction));
+    /*tex We need to know in advance if there is \LUA\ code involved. */
+    {
+        eight_bits *p = vfp;
+        while ((cmd = *(vfp++)) != packet_end_code) {
+            switch (cmd) {
+                case packet_lua_code:
+                    lua = 1;
+                    vfp += 4;
+                    break;
+                case packet_nop_code:
+                case packet_pop_code:
+                case packet_push_code:
+                    break;
+                case packet_char_code:
+                case packet_down_code:
+                case packet_font_code:
+                case packet_image_code:
+                case packet_node_code:
+                case packet_right_code:
+                case packet_pdf_mode:
+                case packet_scale_code:
+                    vfp += 4;
+                    break;
+                case packet_rule_code:
+                    vfp += 8;
+                    break;
+                case packet_pdf_code:
+                    vfp += 4;
+                    /*tex Plus a string so we fall through: */
+                case packet_special_code:
+                    packet_number(k);
+                    vfp += (int) k;
+                    break;
+                default:
+                    normal_error("vf", "invalid DVI command (5)");
+            }
+        }
+        vfp = p;
+    }
+    while ((cmd = *(vfp++)) != packet_end_code) {
+        if (n == m) {
+            m += vf_program_step;
+            vpr = xrealloc(vpr, sizeof(vf_program) + (size_t) (m - 1) * sizeof(vf_instruction));
+        }
+        ip = &(vpr->code[n]);
+        ip->cmd = cmd;
+        ip->a = 0;
+        ip->b = 0;
+        ip->v.s = NULL;
+        switch (cmd) {
+            case packet_font_code:
+                packet_number(lf);
+                dynamic = 0;
+                if (! lua) {
+                    continue;
+                }
+                ip->a = lf;
+                break;
+            case packet_push_code:
+            case packet_pop_code:
+                break;
+            case packet_char_code:
+                packet_number(k);
+                ip->a = dynamic ? -1 : lf;
+                ip->b = (int) k;
+                break;
+            case packet_rule_code:
+                packet_scaled(ip->b, fs);
+                packet_scaled(ip->a, fs);
+                break;
+            case packet_right_code:
+            case packet_down_code:
+                packet_scaled(ip->a, fs);
+                break;
+            case packet_pdf_code:
+                packet_number(ip->a);
+                packet_number(k);
+                ip->b = (int) k;
+                ip->v.s = vfp;
+                vfp += (int) k;
+                break;
+            case packet_pdf_mode:
+                packet_number(ip->a);
+                break;
+            case packet_special_code:
+                packet_number(k);
+                ip->b = (int) k;
+                ip->v.s = vfp;
+                vfp += (int) k;
+                break;
+            case packet_lua_code:
+                packet_number(ip->a);
+                dynamic = 1;
+                break;
+            case packet_image_code:
+            case packet_node_code:
+                packet_number(ip->a);
+                break;
+            case packet_nop_code:
+                continue;
+            case packet_scale_code:
+                ip->v.f = packet_float(&vfp);
+                break;
+            default:
+                normal_error("vf", "invalid DVI command (2)");
+        }
+        n++;
+    }
+    vpr->size = fs;
+    vpr->count = n;
+    return vpr;
+}
+
+void free_vf_program(charinfo * co)
+{
+    xfree(co->program);
+}
+
 /*tex
 
     The |do_vf_packet| procedure is called in order to interpret the character
@@ -162,17 +301,27 @@ static float packet_float(eight_bits ** vfpp)
 
 void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex_glyph)
 {
-    eight_bits *vfp;
+    charinfo *co = get_charinfo(vf_f, c);
+    vf_program *vpr;
+    vf_instruction *ip, *ie;
     posstructure *save_posstruct, localpos;
     vf_struct *save_vfstruct, localvfstruct, *vp;
-    int cmd, w, mode;
+    int w, lf;
     unsigned k;
+    eight_bits *vfp;
     scaledpos size;
     scaled i;
     str_number s;
     float f;
     packet_stack_record *mat_p;
-    vfp = get_charinfo_packets(get_charinfo(vf_f, c));
+    if (get_charinfo_packets(co) == NULL) {
+        return;
+    }
+    vpr = co->program;
+    if (vpr == NULL || vpr->size != font_size(vf_f)) {
+        free_vf_program(co);
+        vpr = co->program = compile_vf_packet(get_charinfo_packets(co), font_size(vf_f));
+    }
     save_posstruct = pdf->posstruct;
     /*tex use local structure for recursion */
     pdf->posstruct = &localpos;
@@ -198,10 +347,10 @@ void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex_glyph)
     mat_p->c3 = 1.0;
     mat_p->pos.h = 0;
     mat_p->pos.v = 0;
-    while ((cmd = *(vfp++)) != packet_end_code) {
-        switch (cmd) {
+    for (ip = vpr->code, ie = ip + vpr->count; ip < ie; ip++) {
+        switch (ip->cmd) {
             case packet_font_code:
-                packet_number(vp->lf);
+                vp->lf = ip->a;
                 break;
             case packet_push_code:
                 vp->packet_stack_level++;
@@ -217,23 +366,25 @@ void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex_glyph)
                 mat_p = &(vp->packet_stack[vp->packet_stack_level]);
                 break;
             case packet_char_code:
-                packet_number(k);
+                lf = ip->a < 0 ? vp->lf : ip->a;
+                k = (unsigned) ip->b;
+                vp->lf = lf;
                 /*tex We also check if |c == k| and |font(c) == font(k)| */
-                if (!char_exists(vp->lf, (int) k)) {
-                    char_warning(vp->lf, (int) k);
-                } else if (! ((c == k && vp->lf == vf_f)) && (has_packet(vp->lf, (int) k))) {
-                    do_vf_packet(pdf, vp->lf, (int) k, ex_glyph);
+                if (!char_exists(lf, (int) k)) {
+                    char_warning(lf, (int) k);
+                } else if (! ((c == k && lf == vf_f)) && (has_packet(lf, (int) k))) {
+                    do_vf_packet(pdf, lf, (int) k, ex_glyph);
                 } else {
-                    backend_out[glyph_node] (pdf, vp->lf, (int) k, ex_glyph);
+                    backend_out[glyph_node] (pdf, lf, (int) k, ex_glyph);
                 }
-                w = char_width(vp->lf, (int) k);
+                w = char_width(lf, (int) k);
                 if (ex_glyph != 0 && w != 0)
                     w = round_xn_over_d(w, 1000 + ex_glyph, 1000);
                 mat_p->pos.h += w;
                 break;
             case packet_rule_code:
-                packet_scaled(size.v, vp->fs_f);
-                packet_scaled(size.h, vp->fs_f);
+                size.h = ip->a;
+                size.v = ip->b;
                 if (ex_glyph != 0 && size.h > 0)
                     size.h = round_xn_over_d(size.h, 1000 + ex_glyph, 1000);
                 if (size.h > 0 && size.v > 0)
@@ -241,46 +392,33 @@ void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex_glyph)
                 mat_p->pos.h += size.h;
                 break;
             case packet_right_code:
-                packet_scaled(i, vp->fs_f);
+                i = ip->a;
                 if (ex_glyph != 0 && i != 0)
                     i = round_xn_over_d(i, 1000 + ex_glyph, 1000);
                 mat_p->pos.h += i;
                 break;
             case packet_down_code:
-                packet_scaled(i, vp->fs_f);
-                mat_p->pos.v += i;
+                mat_p->pos.v += ip->a;
                 break;
             case packet_pdf_code:
-                packet_number(mode);
-                packet_number(k);
+            case packet_special_code:
+                k = (unsigned) ip->b;
+                vfp = ip->v.s;
                 str_room(k);
                 while (k > 0) {
                     k--;
                     append_char(*(vfp++));
                 }
                 s = make_string();
-                pdf_literal(pdf, s, mode, false);
+                pdf_literal(pdf, s, ip->cmd == packet_pdf_code ? ip->a : scan_special, false);
                 flush_str(s);
                 break;
             case packet_pdf_mode:
-                packet_number(mode);
-                pdf_literal_set_mode(pdf, mode);
-                break;
-            case packet_special_code:
-                packet_number(k);
-                str_room(k);
-                while (k > 0) {
-                    k--;
-                    append_char(*(vfp++));
-                }
-                s = make_string();
-                pdf_literal(pdf, s, scan_special, false);
-                flush_str(s);
+                pdf_literal_set_mode(pdf, ip->a);
                 break;
             case packet_lua_code:
-                packet_number(k);
                 vp->vflua = true;
-                luacall_vf(k, vf_f, c);
+                luacall_vf(ip->a, vf_f, c);
                 /*tex
 
                     We don't release as we (can ) flush multiple times, so no:
@@ -295,18 +433,14 @@ void do_vf_packet(PDF pdf, internal_font_number vf_f, int c, int ex_glyph)
                 vp->vflua = false;
                 break;
             case packet_image_code:
-                packet_number(k);
-                vf_out_image(pdf, k);
+                vf_out_image(pdf, (unsigned) ip->a);
                 break;
             case packet_node_code:
-                packet_number(k);
-                hlist_out(pdf, (halfword) k, 0);
-                break;
-            case packet_nop_code:
+                hlist_out(pdf, (halfword) ip->a, 0);
                 break;
             case packet_scale_code:
                 /*tex This is not yet supported in the backend. */
-                f = packet_float(&vfp);
+                f = ip->v.f;
                 mat_p->c0 = mat_p->c0 * f;
                 mat_p->c3 = mat_p->c3 * f;
                 /* pdf->pstruct->scale = f; */
@@ -394,6 +528,8 @@ void replace_packet_fonts(internal_font_number f, int *old_fontid, int *new_font
             vfp = vf_packets = get_charinfo_packets(co);
             if (vf_packets == NULL)
                 continue;
+            /*tex The compiled packet has the old font ids. */
+            free_vf_program(co);
             while ((cmd = *(vfp++)) != packet_end_code) {
                 switch (cmd) {
                     case packet_font_code:
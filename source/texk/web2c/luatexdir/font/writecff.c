@@ -3123,7 +3123,7 @@ void writetype1w(PDF pdf, fd_entry * fd)
     unsigned char *tfm_buffer = NULL;
     int tfm_size = 0;
     ff = check_ff_exist(fd->fm->ff_name, 0);
-    fp = fopen(ff->ff_path, "rb");
+    fp = texmf_fopen(ff->ff_path, "rb");
     cur_file_name = ff->ff_path;
     if (!fp) {
         formatted_error("cff","could not open Type1 font: %s", cur_file_name);
@@ -63,7 +63,7 @@ static unsigned char *enc_buffer = NULL;
 static int enc_size = 0;
 static int enc_curbyte = 0;
 
-#define enc_open(a)     (enc_file = fopen((char *)(a), FOPEN_RBIN_MODE))
+#define enc_open(a)     (enc_file = texmf_fopen((char *)(a), FOPEN_RBIN_MODE))
 #define enc_read_file() readbinfile(enc_file,&enc_buffer,&enc_size)
 #define enc_close()     xfclose(enc_file,cur_file_name)
 #define enc_getchar()   enc_buffer[enc_curbyte++]
@@ -879,7 +879,7 @@ static boolean t1_open_fontfile(int open_name_prefix)
             return false;
         }
     } else {
-        t1_file = xfopen(cur_file_name, FOPEN_RBIN_MODE);
+        t1_file = texmf_xfopen(cur_file_name, FOPEN_RBIN_MODE);
         t1_read_file();
         t1_close();
     }
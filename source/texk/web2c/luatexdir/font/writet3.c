@@ -130,7 +130,7 @@ static boolean writepk(PDF pdf, internal_font_number f)
             return false;
         }
     } else {
-        t3_file = xfopen(name, FOPEN_RBIN_MODE);
+        t3_file = texmf_xfopen(name, FOPEN_RBIN_MODE);
         recorder_record_input(name);
         t3_read_file();
         t3_close();
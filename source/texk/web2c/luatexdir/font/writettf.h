@@ -162,9 +162,9 @@ extern void ttf_read_post(void);
 extern FILE *ttf_file;
 
 #  define ttf_open(a)      \
-    (ttf_file = fopen((char *) (a), FOPEN_RBIN_MODE))
+    (ttf_file = texmf_fopen((char *) (a), FOPEN_RBIN_MODE))
 #  define otf_open(a)      \
-    (ttf_file = fopen((char *) (a), FOPEN_RBIN_MODE))
+    (ttf_file = texmf_fopen((char *) (a), FOPEN_RBIN_MODE))
 #  define ttf_read_file()  \
     readbinfile(ttf_file,&ttf_buffer,&ttf_size)
 #  define ttf_close()      xfclose(ttf_file,cur_file_name)
@@ -159,7 +159,10 @@ PdfDocument *refPdfDocument(const char *file_path, file_error_mode fe, const cha
         free(path_copy);
     }
     if (pdf_doc->pdfe == NULL) {
+        /*tex We only copy the objects reachable from the included page. */
+        int lazy = ppdoc_lazy(1);
         pdfe = ppdoc_load(file_path);
+        ppdoc_lazy(lazy);
         pdf_doc->pc++;
         /* todo: check if we might print the document */
         if (pdfe == NULL) {
@@ -250,7 +253,9 @@ PdfDocument *refMemStreamPdfDocument(char *docstream, unsigned long long streams
         free(checksum);
     }
     if (pdf_doc->pdfe == NULL) {
+        int lazy = ppdoc_lazy(1);
         pdfe = ppdoc_mem(docstream, streamsize);
+        ppdoc_lazy(lazy);
         pdf_doc->pc++;
         if (pdfe == NULL) {
             normal_error("pdf inclusion","reading pdf Stream failed");
@@ -413,32 +418,78 @@ static void copyDict(PDF pdf, PdfDocument * pdf_doc, ppdict *dict)
     pdf_end_dict(pdf);
 }
 
-static void copyStreamStream(PDF pdf, ppstream * stream, int decode, int callback_id)
+/*tex
+
+    The stream is fetched as a whole and moved to the output buffer in one go;
+    when |decode| is zero the raw (compressed) bytes are copied.
+
+*/
+
+static void copyStreamStream(PDF pdf, ppstream * stream, int decode)
+{
+    size_t size = 0;
+    uint8_t *data = ppstream_all(stream, &size, decode);
+    if (data != NULL) {
+        pdf_out_block(pdf, (const char *) data, size);
+    }
+    ppstream_done(stream);
+}
+
+/*tex
+
+    The |process_pdf_image_content| callback gets the decoded page content
+    stream. As before it is only called when the content is decompressed anyway,
+    that is when the compress level is zero or when we recompress. When it
+    returns a string, that becomes the new content. When it returns |nil|,
+    |false| or |true| the content is unchanged and we write the decoded data we
+    already have, so that the stream is not decoded twice. The return value
+    tells if the stream has been written.
+
+*/
+
+static int contentCallback(PDF pdf, ppstream * stream)
 {
-    uint8_t *data = NULL;
+    int callback_id = callback_defined(process_pdf_image_content_callback);
+    int top, i;
     size_t size = 0;
-    if (0) {
-        for (data = ppstream_first(stream, &size, decode); data != NULL; data = ppstream_next(stream, &size)) {
-            pdf_out_block(pdf, (const char *) data, size);
+    uint8_t *data;
+    if (callback_id <= 0) {
+        return 0;
+    }
+    data = ppstream_all(stream, &size, 1);
+    if (data == NULL) {
+        ppstream_done(stream);
+        return 0;
+    }
+    top = lua_gettop(Luas);
+    if (get_callback(Luas, callback_id)) {
+        lua_pushlstring(Luas, (const char *) data, size);
+        if ((i = lua_pcall(Luas, 1, 1, 0)) != 0) {
+            formatted_warning("pdf inclusion", "error in content callback: %s", lua_tostring(Luas, -1));
+            lua_settop(Luas, top);
+            ppstream_done(stream);
+            luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
+            return 0;
         }
-    } else {
-        data = ppstream_all(stream,&size,decode);
-        if (data != NULL) {
-            /*tex We only do this when we recompress in which case we fetch the whole stream. */
-            if (callback_id == 1) {
-                callback_id = callback_defined(process_pdf_image_content_callback);
-            }
-            if (callback_id) {
-                char *result = NULL;
-                run_callback(callback_id, "S->S",(char *) data,&result);
-                pdf_out_block(pdf, (const char *) (uint8_t *) result, size);
-                xfree(result);
-            } else {
-                pdf_out_block(pdf, (const char *) data, size);
-            }
+        if (lua_type(Luas, -1) == LUA_TSTRING) {
+            size_t l = 0;
+            const char *s = lua_tolstring(Luas, -1, &l);
+            pdf_dict_add_streaminfo(pdf);
+            pdf_end_dict(pdf);
+            pdf_begin_stream(pdf);
+            pdf_out_block(pdf, s, l);
+            lua_settop(Luas, top);
+            ppstream_done(stream);
+            return 1;
         }
     }
+    lua_settop(Luas, top);
+    pdf_dict_add_streaminfo(pdf);
+    pdf_end_dict(pdf);
+    pdf_begin_stream(pdf);
+    pdf_out_block(pdf, (const char *) data, size);
     ppstream_done(stream);
+    return 1;
 }
 
 static void copyStream(PDF pdf, PdfDocument * pdf_doc, ppstream * stream)
@@ -486,7 +537,7 @@ static void copyStream(PDF pdf, PdfDocument * pdf_doc, ppstream * stream)
             pdf_dict_add_streaminfo(pdf);
             pdf_end_dict(pdf);
             pdf_begin_stream(pdf);
-            copyStreamStream(pdf, stream, 1, 0);
+            copyStreamStream(pdf, stream, 1);
             pdf_end_stream(pdf);
             return ;
         }
@@ -494,7 +545,7 @@ static void copyStream(PDF pdf, PdfDocument * pdf_doc, ppstream * stream)
     /* copy as-is */
     copyDict(pdf, pdf_doc, dict);
     pdf_begin_stream(pdf);
-    copyStreamStream(pdf, stream, 0, 0);
+    copyStreamStream(pdf, stream, 0);
     pdf_end_stream(pdf);
 }
 
@@ -888,10 +939,12 @@ void write_epdf(PDF pdf, image_dict * idict, int suppress_optional_info)
     content = ppdict_rget_obj(pageDict, "Contents");
     if (content && content->type == PPSTREAM) {
         if (pdf->compress_level == 0 || pdf->recompress) {
-            pdf_dict_add_streaminfo(pdf);
-            pdf_end_dict(pdf);
-            pdf_begin_stream(pdf);
-            copyStreamStream(pdf, content->stream, 1, 1); /* decompress */
+            if (! contentCallback(pdf, content->stream)) {
+                pdf_dict_add_streaminfo(pdf);
+                pdf_end_dict(pdf);
+                pdf_begin_stream(pdf);
+                copyStreamStream(pdf, content->stream, 1); /* decompress */
+            }
         } else {
             /* copies compressed stream */
             ppstream * stream = content->stream;
@@ -915,12 +968,12 @@ void write_epdf(PDF pdf, image_dict * idict, int suppress_optional_info)
                 }
                pdf_end_dict(pdf);
                 pdf_begin_stream(pdf);
-                copyStreamStream(pdf, stream, 0, 0);
+                copyStreamStream(pdf, stream, 0);
             } else {
                 pdf_dict_add_streaminfo(pdf);
                 pdf_end_dict(pdf);
                 pdf_begin_stream(pdf);
-                copyStreamStream(pdf, stream, 1, 0);
+                copyStreamStream(pdf, stream, 1);
             }
         }
         pdf_end_stream(pdf);
@@ -948,7 +1001,7 @@ void write_epdf(PDF pdf, image_dict * idict, int suppress_optional_info)
                     } else {
                         b = 1;
                     }
-                    copyStreamStream(pdf, (ppstream *) o->stream, 1, 0);
+                    copyStreamStream(pdf, (ppstream *) o->stream, 1);
                 }
             }
         }
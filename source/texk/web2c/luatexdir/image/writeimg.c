@@ -33,6 +33,8 @@ LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 #include "lua.h"
 #include "lauxlib.h"
 
+#include "luapplib/util/utiliof.h"
+
 /*tex
 
 The function |readimage| performs some basic initializations. Then it looks at
@@ -800,12 +802,30 @@ scaled_whd scan_alt_rule(void)
 /*tex
 
     This copy a file of arbitrary size to the buffer and flushed as needed.
+    Larger blocks (the data of \JPEG\ and \JPEGTWO\ files, \PNG\ chunks) are
+    copied from a mapping of just the requested range, which saves the
+    intermediate |fread| copy. Small blocks, and files that can't be mapped, are
+    read as usual.
 
 */
 
+#define mapped_copy_threshold 65536
+
 size_t read_file_to_buf(PDF pdf, FILE * f, size_t len)
 {
     size_t i, j, k = 0;
+    if (len >= mapped_copy_threshold) {
+        long pos = ftell(f);
+        void *map = NULL;
+        size_t mapsize = 0;
+        uint8_t *data = pos >= 0 ? iof_map_file_range(f, (size_t) pos, len, &map, &mapsize) : NULL;
+        if (data != NULL) {
+            pdf_out_block(pdf, (const char *) data, len);
+            iof_unmap_data(map, mapsize);
+            fseek(f, pos + (long) len, SEEK_SET);
+            return len;
+        }
+    }
     while (len > 0) {
         i = (size_t) (len > pdf->buf->size) ? (size_t) pdf->buf->size : len;
         pdf_room(pdf, (int) i);
@@ -715,7 +715,7 @@ static void wr_jbig2(PDF pdf, image_dict * idict, FILEINFO * fip, unsigned long
     LITEM *slip;
     PAGEINFO *pip;
     SEGINFO *sip;
-    unsigned long i;
+    size_t len;
     if (page > 0) {
         assert(idict != NULL);
         pip = find_pageinfo(&(fip->pages), page);
@@ -765,8 +765,14 @@ static void wr_jbig2(PDF pdf, image_dict * idict, FILEINFO * fip, unsigned long
             /*tex Mark refered-to page 0 segments, change segpages > 1 to 1. */
             writeseghdr(pdf, fip, sip);
             xfseeko(fip->file, (off_t) sip->datastart, SEEK_SET, fip->filepath);
-            for (i = sip->datastart; i < sip->dataend; i++)
-                pdf_out(pdf, ygetc(fip->file));
+            /*tex
+                The segment data goes in one block, large blocks are copied
+                from a mapping of the file. The header above is read bytewise
+                because it gets patched.
+            */
+            len = (size_t) (sip->dataend - sip->datastart);
+            if (read_file_to_buf(pdf, fip->file, len) != len)
+                normal_error("readjbig2","premature end file");
         }
     }
     pdf_end_stream(pdf);
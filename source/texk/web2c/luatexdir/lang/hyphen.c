@@ -709,10 +709,61 @@ void hnj_hyphen_load(HyphenDict * dict, const unsigned char *f)
 
 extern halfword insert_syllable_discretionary(halfword t, lang_variables * lan);
 
-void hnj_hyphen_hyphenate(HyphenDict * dict, halfword first1, halfword last1,
-    int length, halfword left, halfword right, lang_variables * lan)
+/*tex
+
+    One step of the finite state machine: we feed it character |ch| at position
+    |char_num| of the (dotted) word and merge the matching pattern values into
+    |hyphens|.
+
+*/
+
+static int hnj_hyphen_step(HyphenDict * dict, int state, int ch, int char_num, char *hyphens)
+{
+    while (state != -1) {
+        HyphenState *hstate = &dict->states[state];
+        int k;
+        for (k = 0; k < hstate->num_trans; k++) {
+            if (hstate->trans[k].uni_ch == ch) {
+                char *match;
+                state = hstate->trans[k].new_state;
+                match = dict->states[state].match;
+                if (match) {
+                    /*tex
+
+                        We add +2 because 1 string length is one bigger than offset
+                        and 1 hyphenation starts before first character.
+                    */
+                    int offset = (int) (char_num + 2 - (int) strlen(match));
+                    int m;
+                    for (m = 0; match[m]; m++) {
+                        if (hyphens[offset + m] < match[m])
+                            hyphens[offset + m] = match[m];
+                    }
+                }
+                return state;
+            }
+        }
+        state = hstate->fallback_state;
+    }
+    /*tex Nothing worked, let's go to the next character. */
+    return 0;
+}
+
+/*tex
+
+    The pattern run itself doesn't touch the list, it only collects the offsets
+    (relative to |first1|) of the characters after which a discretionary can go
+    in |positions|, which has to have room for |length| entries. The number of
+    positions is returned. This permits the caller to keep the result around
+    and apply it to the next occurrence of the same word.
+
+*/
+
+int hnj_hyphen_positions(HyphenDict * dict, halfword first1, halfword last1,
+    int length, halfword left, halfword right, int *positions)
 {
     int char_num;
+    int nofpositions = 0;
     halfword here;
     int state = 0;
     /*tex +2 for dots at each end, +1 for points outside characters. */
@@ -738,35 +789,7 @@ void hnj_hyphen_hyphenate(HyphenDict * dict, halfword first1, halfword last1,
                 ch = character(here);
             }
         }
-        while (state != -1) {
-            HyphenState *hstate = &dict->states[state];
-            int k;
-            for (k = 0; k < hstate->num_trans; k++) {
-                if (hstate->trans[k].uni_ch == ch) {
-                    char *match;
-                    state = hstate->trans[k].new_state;
-                    match = dict->states[state].match;
-                    if (match) {
-                        /*tex
-
-                            We add +2 because 1 string length is one bigger than offset
-                            and 1 hyphenation starts before first character.
-                        */
-                        int offset = (int) (char_num + 2 - (int) strlen(match));
-                        int m;
-                        for (m = 0; match[m]; m++) {
-                            if (hyphens[offset + m] < match[m])
-                                hyphens[offset + m] = match[m];
-                        }
-                    }
-                    goto try_next_letter;
-                }
-            }
-            state = hstate->fallback_state;
-        }
-        /*tex Nothing worked, let's go to the next character. */
-        state = 0;
-    try_next_letter:;
+        state = hnj_hyphen_step(dict, state, ch, char_num, hyphens);
         char_num++;
     }
     /*tex Restore the correct pointers. */
@@ -781,8 +804,80 @@ void hnj_hyphen_hyphenate(HyphenDict * dict, halfword first1, halfword last1,
         char_num++;
     for (; here != right; here = vlink(here)) {
         if (hyphens[char_num] & 1)
-            here = insert_syllable_discretionary(here, lan);
+            positions[nofpositions++] = char_num - 2;
         char_num++;
     }
     hnj_free(hyphens);
+    return nofpositions;
+}
+
+/*tex
+
+    The same run but now on a word given as array of (already |\hjcode|
+    mapped) characters, as used by the \LUA\ interface to hyphenate strings.
+    The positions are again offsets of the characters after which we can break,
+    limited by |lhmin| and |rhmin|.
+
+*/
+
+int hnj_hyphen_word(HyphenDict * dict, const unsigned *word, int length,
+    int lhmin, int rhmin, int *positions)
+{
+    int char_num;
+    int nofpositions = 0;
+    int state = 0;
+    int hyphen_len = length + 3;
+    char *hyphens;
+    if (lhmin < 1)
+        lhmin = 1;
+    if (rhmin < 1)
+        rhmin = 1;
+    if (length < lhmin + rhmin)
+        return 0;
+    hyphens = hnj_malloc(hyphen_len + 1);
+    for (char_num = 0; char_num < hyphen_len; char_num++) {
+        hyphens[char_num] = '0';
+    }
+    hyphens[hyphen_len] = 0;
+    state = hnj_hyphen_step(dict, state, '.', 0, hyphens);
+    for (char_num = 1; char_num <= length; char_num++) {
+        state = hnj_hyphen_step(dict, state, (int) word[char_num - 1], char_num, hyphens);
+    }
+    (void) hnj_hyphen_step(dict, state, '.', char_num, hyphens);
+    for (char_num = lhmin + 1; char_num < length - rhmin + 2; char_num++) {
+        if (hyphens[char_num] & 1)
+            positions[nofpositions++] = char_num - 2;
+    }
+    hnj_free(hyphens);
+    return nofpositions;
+}
+
+/*tex
+
+    Inserting the discretionaries at given offsets has to skip the ones that
+    we added already.
+
+*/
+
+void hnj_hyphen_insert(halfword first1, int *positions, int nofpositions, lang_variables * lan)
+{
+    int i;
+    int char_num = 0;
+    halfword here = first1;
+    for (i = 0; i < nofpositions; i++) {
+        while (char_num < positions[i]) {
+            here = vlink(here);
+            char_num++;
+        }
+        here = insert_syllable_discretionary(here, lan);
+    }
+}
+
+void hnj_hyphen_hyphenate(HyphenDict * dict, halfword first1, halfword last1,
+    int length, halfword left, halfword right, lang_variables * lan)
+{
+    int *positions = hnj_malloc((length + 1) * (int) sizeof(int));
+    int nofpositions = hnj_hyphen_positions(dict, first1, last1, length, left, right, positions);
+    hnj_hyphen_insert(first1, positions, nofpositions, lan);
+    hnj_free(positions);
 }
@@ -49,6 +49,13 @@ extern "C" {
     void hnj_hyphen_hyphenate(HyphenDict * dict, halfword first, halfword last,
                               int size, halfword left, halfword right,
                               lang_variables * lan);
+    int hnj_hyphen_positions(HyphenDict * dict, halfword first, halfword last,
+                             int size, halfword left, halfword right,
+                             int *positions);
+    int hnj_hyphen_word(HyphenDict * dict, const unsigned *word, int size,
+                        int lhmin, int rhmin, int *positions);
+    void hnj_hyphen_insert(halfword first, int *positions, int size,
+                           lang_variables * lan);
     unsigned char *hnj_serialize(HyphenDict *);
     void hnj_free_serialize(unsigned char *);
 
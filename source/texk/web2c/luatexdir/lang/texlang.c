@@ -60,6 +60,7 @@ struct tex_language *new_language(int n)
         lang->pre_exhyphen_char = 0;
         lang->post_exhyphen_char = 0;
         lang->hyphenation_min = -1;
+        lang->cache = NULL;
         if (saving_hyph_codes_par) {
             /*tex
                 For now, we might just use specific value for whatever task.
@@ -85,6 +86,17 @@ struct tex_language *get_language(int n)
     }
 }
 
+/*tex Unlike |get_language| this one doesn't create a language that is not there. */
+
+struct tex_language *find_language(int n)
+{
+    if (n >= 0 && n < MAX_TEX_LANGUAGES) {
+        return tex_languages[n];
+    } else {
+        return NULL;
+    }
+}
+
 void set_pre_hyphen_char(int n, int v)
 {
     struct tex_language *l = get_language((int) n);
@@ -160,10 +172,165 @@ int get_hyphenation_min(int n)
     return (int) l->hyphenation_min;
 }
 
+/*tex
+
+    The same words show up over and over in a document, so per language we keep
+    the outcome of hyphenating a word around: the exception that applies or the
+    positions that the patterns gave. The key is the word as the hyphenator sees
+    it, so after applying the |\hjcode|s, combined with the left and right
+    hyphenmins that limit the positions. At most |hyphenation_cache_size| words
+    are kept and when we run out of room the least recently used one goes.
+    Loading or clearing patterns and exceptions flushes the cache of a language.
+
+*/
+
+#define hyphenation_cache_size  1024
+#define hyphenation_cache_slots 2048
+
+typedef struct hyphenation_cache_entry {
+    struct hyphenation_cache_entry *next;
+    struct hyphenation_cache_entry *newer;
+    struct hyphenation_cache_entry *older;
+    unsigned hash;
+    int lhmin;
+    int rhmin;
+    char *word;
+    char *exception;
+    int nofpositions;
+    int *positions;
+} hyphenation_cache_entry;
+
+struct hyphenation_cache {
+    hyphenation_cache_entry *slots[hyphenation_cache_slots];
+    hyphenation_cache_entry *newest;
+    hyphenation_cache_entry *oldest;
+    int count;
+};
+
+int hyphenation_cache_hits = 0;
+int hyphenation_cache_misses = 0;
+
+static unsigned hyphenation_cache_hash(const char *word, int lhmin, int rhmin)
+{
+    unsigned h = 2166136261U;
+    while (*word) {
+        h = (h ^ (unsigned char) *word++) * 16777619U;
+    }
+    h = (h ^ (unsigned) lhmin) * 16777619U;
+    h = (h ^ (unsigned) rhmin) * 16777619U;
+    return h;
+}
+
+static void hyphenation_cache_unlink(hyphenation_cache *c, hyphenation_cache_entry *e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        c->newest = e->older;
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        c->oldest = e->newer;
+}
+
+static void hyphenation_cache_push(hyphenation_cache *c, hyphenation_cache_entry *e)
+{
+    e->newer = NULL;
+    e->older = c->newest;
+    if (c->newest != NULL)
+        c->newest->newer = e;
+    else
+        c->oldest = e;
+    c->newest = e;
+}
+
+static void hyphenation_cache_free(hyphenation_cache_entry *e)
+{
+    free(e->word);
+    free(e->exception);
+    free(e->positions);
+    free(e);
+}
+
+static void flush_hyphenation_cache(struct tex_language *lang)
+{
+    if (lang->cache != NULL) {
+        hyphenation_cache_entry *e = lang->cache->newest;
+        while (e != NULL) {
+            hyphenation_cache_entry *older = e->older;
+            hyphenation_cache_free(e);
+            e = older;
+        }
+        free(lang->cache);
+        lang->cache = NULL;
+    }
+}
+
+static hyphenation_cache_entry *hyphenation_cache_lookup(struct tex_language *lang, const char *word, int lhmin, int rhmin)
+{
+    hyphenation_cache *c = lang->cache;
+    if (c != NULL) {
+        unsigned h = hyphenation_cache_hash(word, lhmin, rhmin);
+        hyphenation_cache_entry *e = c->slots[h % hyphenation_cache_slots];
+        while (e != NULL) {
+            if (e->hash == h && e->lhmin == lhmin && e->rhmin == rhmin && strcmp(e->word, word) == 0) {
+                if (e != c->newest) {
+                    hyphenation_cache_unlink(c, e);
+                    hyphenation_cache_push(c, e);
+                }
+                hyphenation_cache_hits++;
+                return e;
+            }
+            e = e->next;
+        }
+    }
+    hyphenation_cache_misses++;
+    return NULL;
+}
+
+/*tex The cache takes over the (allocated) |exception| string. */
+
+static hyphenation_cache_entry *hyphenation_cache_store(struct tex_language *lang, const char *word, int lhmin, int rhmin, char *exception)
+{
+    hyphenation_cache *c = lang->cache;
+    hyphenation_cache_entry *e;
+    unsigned h = hyphenation_cache_hash(word, lhmin, rhmin);
+    if (c == NULL) {
+        c = xcalloc(1, sizeof(hyphenation_cache));
+        lang->cache = c;
+    } else if (c->count >= hyphenation_cache_size) {
+        hyphenation_cache_entry **p;
+        e = c->oldest;
+        p = &c->slots[e->hash % hyphenation_cache_slots];
+        while (*p != e) {
+            p = &((*p)->next);
+        }
+        *p = e->next;
+        hyphenation_cache_unlink(c, e);
+        hyphenation_cache_free(e);
+        c->count--;
+    }
+    e = xmalloc(sizeof(hyphenation_cache_entry));
+    e->hash = h;
+    e->lhmin = lhmin;
+    e->rhmin = rhmin;
+    e->word = xstrdup(word);
+    e->exception = exception;
+    /*tex The positions are determined when we first need them. */
+    e->nofpositions = -1;
+    e->positions = NULL;
+    e->next = c->slots[h % hyphenation_cache_slots];
+    c->slots[h % hyphenation_cache_slots] = e;
+    hyphenation_cache_push(c, e);
+    c->count++;
+    return e;
+}
+
 void load_patterns(struct tex_language *lang, const unsigned char *buff)
 {
     if (lang == NULL || buff == NULL || strlen((const char *) buff) == 0)
         return;
+    flush_hyphenation_cache(lang);
     if (lang->patterns == NULL) {
         lang->patterns = hnj_hyphen_new();
     }
@@ -174,6 +341,7 @@ void clear_patterns(struct tex_language *lang)
 {
     if (lang == NULL)
         return;
+    flush_hyphenation_cache(lang);
     if (lang->patterns != NULL) {
         hnj_hyphen_clear(lang->patterns);
     }
@@ -287,6 +455,7 @@ void load_hyphenation(struct tex_language *lang, const unsigned char *buff)
     int id ;
     if (lang == NULL)
         return;
+    flush_hyphenation_cache(lang);
     if (lang->exceptions == 0) {
         lua_newtable(Luas);
         lang->exceptions = luaL_ref(Luas, LUA_REGISTRYINDEX);
@@ -320,6 +489,7 @@ void clear_hyphenation(struct tex_language *lang)
 {
     if (lang == NULL)
         return;
+    flush_hyphenation_cache(lang);
     if (lang->exceptions != 0) {
         luaL_unref(Luas, LUA_REGISTRYINDEX, lang->exceptions);
         lang->exceptions = 0;
@@ -936,7 +1106,6 @@ void hnj_hyphenation(halfword head, halfword tail)
     char utf8word[(4 * MAX_WORD_LEN) + 1] = { 0 };
     int wordlen = 0;
     char *hy = utf8word;
-    char *replacement = NULL;
     boolean explicit_hyphen = false;
     boolean valid_word = false;
     halfword first_language = first_valid_language_par;
@@ -977,6 +1146,7 @@ void hnj_hyphenation(halfword head, halfword tail)
         /*tex This could be |while(1)|, but let's be paranoid: */
         int clang, lhmin, rhmin, hmin;
         halfword hyf_font;
+        hyphenation_cache_entry *cached = NULL;
         halfword end_word = r;
         wordstart = r;
         assert(is_simple_character(wordstart));
@@ -1065,18 +1235,27 @@ void hnj_hyphenation(halfword head, halfword tail)
               && (lang = tex_languages[clang]) != NULL
            ) {
             *hy = 0;
+            if (lang->exceptions != 0 || lang->patterns != NULL) {
+                cached = hyphenation_cache_lookup(lang, utf8word, lhmin, rhmin);
+                if (cached == NULL) {
+                    char *replacement = NULL;
+                    if (lang->exceptions != 0) {
+                        replacement = hyphenation_exception(lang->exceptions, utf8word);
+                    }
+                    cached = hyphenation_cache_store(lang, utf8word, lhmin, rhmin, replacement);
+                }
+            }
             /*tex
                 this is messy and nasty: we can have a word with a - in it which
                 is why we have two branches
             */
-            if (lang->exceptions != 0 && (replacement = hyphenation_exception(lang->exceptions, utf8word)) != NULL) {
+            if (cached != NULL && cached->exception != NULL) {
                 /*tex handle the exception and go on to the next word */
                 if (expstart == null) {
-                    do_exception(wordstart, r, replacement);
+                    do_exception(wordstart, r, cached->exception);
                 } else {
-                    do_exception(expstart,r,replacement);
+                    do_exception(expstart, r, cached->exception);
                 }
-                free(replacement);
             } else if (expstart != null) {
                 /*tex We're done already */
             } else if (lang->patterns != NULL) {
@@ -1118,7 +1297,11 @@ void hnj_hyphenation(halfword head, halfword tail)
                         }
                     }
                     if (valid_word && expstart == null) {
-                        (void) hnj_hyphen_hyphenate(lang->patterns, wordstart, end_word, wordlen, left, right, &langdata);
+                        if (cached->nofpositions < 0) {
+                            cached->positions = xmalloc((unsigned) ((wordlen + 1) * (int) sizeof(int)));
+                            cached->nofpositions = hnj_hyphen_positions(lang->patterns, wordstart, end_word, wordlen, left, right, cached->positions);
+                        }
+                        hnj_hyphen_insert(wordstart, cached->positions, cached->nofpositions, &langdata);
                     } else {
                         /*tex nothing yet */
                     }
@@ -1165,6 +1348,132 @@ void new_hyphenation(halfword head, halfword tail)
     }
 }
 
+/*tex
+
+    The \LUA\ interface can also ask for the hyphenation points of a word that
+    is given as an array of \UNICODE\ characters, so that no node list has to be
+    made. The word is normalized with the |\hjcode|s and we use the same cache
+    as the node list variant. The offsets returned in |positions| (which needs
+    room for |length| entries) are those of the characters after which we can
+    break.
+
+    An exception has the same syntax as in |\hyphenation|; a |{}{}{}| specifier
+    counts as a break before its replacement characters.
+
+*/
+
+static int exception_positions(const char *exception, int length, int *positions)
+{
+    int n = 0;
+    int count = 0;
+    int i = 0;
+    unsigned *uword = xmalloc((unsigned) ((strlen(exception) + 1) * sizeof(unsigned)));
+    utf2uni_strcpy(uword, exception);
+    while (uword[i] > 0 && n < length) {
+        unsigned u = uword[i++];
+        if (u == '-') {
+            if (count > 0 && count < length)
+                positions[n++] = count - 1;
+        } else if (u == '{') {
+            /*tex We skip the |pre| and |post| parts and count the |replace| part. */
+            int items = 0;
+            while (uword[i] > 0 && items < 2) {
+                if (uword[i++] == '}')
+                    items++;
+            }
+            if (uword[i] == '{')
+                i++;
+            if (count > 0 && count < length)
+                positions[n++] = count - 1;
+            while (uword[i] > 0 && uword[i] != '}') {
+                count++;
+                i++;
+            }
+            if (uword[i] == '}')
+                i++;
+            if (uword[i] == '[' && uword[i+1] >= '0' && uword[i+1] <= '9' && uword[i+2] == ']')
+                i += 3;
+        } else {
+            /*tex This includes the |=| that stands for an explicit hyphen. */
+            count++;
+        }
+    }
+    free(uword);
+    return n;
+}
+
+int hyphenate_characters(struct tex_language *lang, const unsigned *word, int length, int lhmin, int rhmin, int *positions)
+{
+    int i, hmin;
+    int n = 0;
+    unsigned *hjword;
+    char *utf8word, *hy;
+    hyphenation_cache_entry *cached;
+    if (lang == NULL || length <= 0 || (lang->exceptions == 0 && lang->patterns == NULL))
+        return 0;
+    lhmin = norm_min(lhmin);
+    rhmin = norm_min(rhmin);
+    hmin = lang->hyphenation_min;
+    hjword = xmalloc((unsigned) (length * (int) sizeof(unsigned)));
+    utf8word = xmalloc((unsigned) (4 * length + 1));
+    hy = utf8word;
+    for (i = 0; i < length; i++) {
+        int lchar = get_hj_code(lang->id, (int) word[i]);
+        if (lchar <= 0) {
+            lchar = (int) word[i];
+        } else if (lchar <= 32) {
+            /*tex The same hyphenmin adjustments as in |new_hyphenation|. */
+            int wordlen = i + 1;
+            if (lchar == 32) {
+                lchar = 0 ;
+            }
+            if (wordlen <= lhmin) {
+                lhmin = lhmin - lchar + 1 ;
+                if (lhmin < 0)
+                    lhmin = 1;
+            }
+            if (wordlen >= rhmin) {
+                rhmin = rhmin - lchar + 1 ;
+                if (rhmin < 0)
+                    rhmin = 1;
+            }
+            hmin = hmin - lchar + 1 ;
+            if (hmin < 0)
+                rhmin = 1;
+            lchar = (int) word[i];
+        }
+        hjword[i] = (unsigned) lchar;
+        hy = uni2string(hy, (unsigned) lchar);
+    }
+    *hy = 0;
+    if (length < lhmin + rhmin || (hmin > 0 && length < hmin)) {
+        free(utf8word);
+        free(hjword);
+        return 0;
+    }
+    cached = hyphenation_cache_lookup(lang, utf8word, lhmin, rhmin);
+    if (cached == NULL) {
+        char *replacement = NULL;
+        if (lang->exceptions != 0) {
+            replacement = hyphenation_exception(lang->exceptions, utf8word);
+        }
+        cached = hyphenation_cache_store(lang, utf8word, lhmin, rhmin, replacement);
+    }
+    if (cached->exception != NULL) {
+        n = exception_positions(cached->exception, length, positions);
+    } else if (lang->patterns != NULL) {
+        if (cached->nofpositions < 0) {
+            cached->positions = xmalloc((unsigned) ((length + 1) * (int) sizeof(int)));
+            cached->nofpositions = hnj_hyphen_word(lang->patterns, hjword, length, lhmin, rhmin, cached->positions);
+        }
+        n = cached->nofpositions;
+        memcpy(positions, cached->positions, (size_t) n * sizeof(int));
+    }
+    free(utf8word);
+    free(hjword);
+    return n;
+}
+
 /*tex
 
     Dumping and undumping languages:
@@ -1205,6 +1514,7 @@ static void dump_one_language(int i)
     if (s != NULL) {
         free(s);
     }
+    flush_hyphenation_cache(lang);
     free(lang);
 }
 
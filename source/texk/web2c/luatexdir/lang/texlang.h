@@ -29,6 +29,8 @@ typedef struct _lang_variables {
 
 #  include "lang/hyphen.h"
 
+typedef struct hyphenation_cache hyphenation_cache;
+
 struct tex_language {
     HyphenDict *patterns;
     int exceptions;             /* lua registry pointer, should be replaced */
@@ -38,12 +40,14 @@ struct tex_language {
     int pre_exhyphen_char;
     int post_exhyphen_char;
     int hyphenation_min;
+    hyphenation_cache *cache;   /* recently hyphenated words, not dumped */
 };
 
 #  define MAX_WORD_LEN 65536      /* in chars */
 
 extern struct tex_language *new_language(int n);
 extern struct tex_language *get_language(int n);
+extern struct tex_language *find_language(int n);
 extern void load_patterns(struct tex_language *lang, const unsigned char *buf);
 extern void load_hyphenation(struct tex_language *lang, const unsigned char *buf);
 extern int hyphenate_string(struct tex_language *lang, char *w, char **ret);
@@ -53,6 +57,10 @@ extern void clear_patterns(struct tex_language *lang);
 extern void clear_hyphenation(struct tex_language *lang);
 extern const char *clean_hyphenation(int id, const char *buffer, char **cleaned);
 extern void hnj_hyphenation(halfword head, halfword tail);
+extern int hyphenate_characters(struct tex_language *lang, const unsigned *word, int length, int lhmin, int rhmin, int *positions);
+
+extern int hyphenation_cache_hits;
+extern int hyphenation_cache_misses;
 
 extern void set_pre_hyphen_char(int lan, int val);
 extern void set_post_hyphen_char(int lan, int val);
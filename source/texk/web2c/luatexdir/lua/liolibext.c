@@ -924,6 +924,44 @@ static int readline(lua_State *L)
     }
 }
 
+#ifndef LuajitTeX
+
+/*
+    Files that were found in a \TEX\ pack (see |texmf_find_file|) are opened
+    from memory by |io.open|, other files are left to the original function.
+*/
+
+static int pack_fclose(lua_State *L)
+{
+    luaL_Stream *p = (luaL_Stream *) luaL_checkudata(L, 1, LUA_FILEHANDLE);
+    int res = fclose(p->f);
+    return luaL_fileresult(L, (res == 0), NULL);
+}
+
+static int pack_open(lua_State *L)
+{
+    const char *filename = luaL_checkstring(L, 1);
+    const char *mode = luaL_optstring(L, 2, "r");
+    size_t size;
+    if (mode[0] == 'r' && strchr(mode, '+') == NULL && texmf_pack_data(filename, &size) != NULL) {
+        luaL_Stream *p = (luaL_Stream *) lua_newuserdata(L, sizeof(luaL_Stream));
+        p->closef = NULL;
+        luaL_setmetatable(L, LUA_FILEHANDLE);
+        p->f = texmf_fopen(filename, mode);
+        if (p->f == NULL) {
+            return luaL_fileresult(L, 0, filename);
+        }
+        p->closef = &pack_fclose;
+        return 1;
+    }
+    lua_pushvalue(L, lua_upvalueindex(1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+#endif
+
 static const luaL_Reg fiolib[] = {
     /* helpers */
     { "readcardinal1",     readcardinal1 },
@@ -984,5 +1022,12 @@ static const luaL_Reg siolib[] = {
 int luaopen_fio(lua_State *L) {
     luaL_openlib(L, "fio", fiolib, 0);
     luaL_openlib(L, "sio", siolib, 0);
+#ifndef LuajitTeX
+    lua_getglobal(L, "io");
+    lua_getfield(L, -1, "open");
+    lua_pushcclosure(L, pack_open, 1);
+    lua_setfield(L, -2, "open");
+    lua_pop(L, 1);
+#endif
     return 1;
 }
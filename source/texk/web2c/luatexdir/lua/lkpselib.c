@@ -26,6 +26,8 @@
 #endif
 #include <kpathsea/version.h>
 #define xfree(p) do { if (p != NULL) free(p); p = NULL; } while (0)
+#define texmf_find_file(name, format, must_exist) \
+    kpse_find_file(name, (kpse_file_format_type) (format), must_exist)
 #else
 #include "ptexlib.h"
 #include "lua/luatex-api.h"
@@ -218,11 +220,47 @@ static int find_file(lua_State * L)
             mexist = 1;
         if (mexist < 0)
             mexist = 0;
-        lua_pushstring(L, kpse_find_file(st, ftype, mexist));
+        lua_pushstring(L, texmf_find_file(st, ftype, mexist));
     }
     return 1;
 }
 
+#ifndef MF_LUA
+
+/*tex
+
+    Write a pack with the given files, see |texmf_find_file|. The file names are
+    stored as given, so normally one passes full names.
+
+*/
+
+static int write_pack(lua_State * L)
+{
+    const char *packname = luaL_checkstring(L, 1);
+    unsigned count, i;
+    const char **files;
+    boolean ok;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    count = (unsigned) lua_rawlen(L, 2);
+    files = xmalloc((count ? count : 1) * sizeof(char *));
+    for (i = 0; i < count; i++) {
+        lua_rawgeti(L, 2, (int) i + 1);
+        if (lua_type(L, -1) != LUA_TSTRING) {
+            free(files);
+            return luaL_error(L, "file name expected");
+        }
+        /*tex The strings stay anchored in the table. */
+        files[i] = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
+    ok = texmf_pack_write(packname, files, count);
+    free(files);
+    lua_pushboolean(L, ok);
+    return 1;
+}
+
+#endif
+
 
 static int lua_kpathsea_find_file(lua_State * L)
 {
@@ -847,6 +885,9 @@ static const struct luaL_Reg kpselib_l[] = {
     {"init_prog", init_prog},
     {"readable_file", readable_file},
     {"find_file", find_file},
+#ifndef MF_LUA
+    {"write_pack", write_pack},
+#endif
     {"expand_path", expand_path},
     {"expand_var", expand_var},
     {"expand_braces", expand_braces},
@@ -258,6 +258,241 @@ static int do_lang_hyphenate(lua_State * L)
     return 1;
 }
 
+/*tex
+
+    The next functions hyphenate words that come as \UTF8\ strings instead of
+    node lists, for instance when one wants to know break candidates before
+    making nodes:
+
+    \starttyping
+    lang.hyphenatestrings(language,{ word, word, ... },[lefthyphenmin],[righthyphenmin])
+    lang.hyphenatebuffer (language,buffer,[lefthyphenmin],[righthyphenmin])
+    lang.hyphenatestream (language,[lefthyphenmin],[righthyphenmin])
+    \stoptyping
+
+    The first one returns a flat array with per word the number of breaks
+    followed by the number of characters before each break. The second one
+    splits the buffer into words (runs of characters with a positive |\hjcode|)
+    and returns a flat array with the byte positions of the characters that can
+    start a new line. The third one returns a function that does the same for a
+    buffer that comes in pieces: each call gets the next piece and returns the
+    positions, counted from the start of the first piece, in the words that are
+    complete. A word (or character) that runs up to the end of a piece waits
+    for the next one; a call without a piece ends the stream.
+
+    The hyphenmin values are clamped like |norm_min| does for the node lists.
+
+*/
+
+static int lang_hyphenmin_argument(lua_State * L, int i, int d)
+{
+    lua_Integer h = luaL_optinteger(L, i, d);
+    return (int) norm_min(h < 0 ? 0 : (h > 255 ? 255 : (int) h));
+}
+
+static struct tex_language *lang_argument(lua_State * L, int i)
+{
+    if (lua_type(L, i) == LUA_TNUMBER) {
+        return find_language((int) lua_tointeger(L, i));
+    } else {
+        struct tex_language **lang_ptr = check_islang(L, i);
+        return *lang_ptr;
+    }
+}
+
+static int lang_decode(const unsigned char *s, size_t l, unsigned *word, size_t *offsets)
+{
+    size_t i = 0;
+    int n = 0;
+    while (i < l) {
+        unsigned c = s[i];
+        size_t k = 1;
+        if (c >= 0xF0 && i + 3 < l) {
+            c = ((c & 0x07) << 18) | ((s[i+1] & 0x3F) << 12) | ((s[i+2] & 0x3F) << 6) | (s[i+3] & 0x3F);
+            k = 4;
+        } else if (c >= 0xE0 && i + 2 < l) {
+            c = ((c & 0x0F) << 12) | ((s[i+1] & 0x3F) << 6) | (s[i+2] & 0x3F);
+            k = 3;
+        } else if (c >= 0xC0 && i + 1 < l) {
+            c = ((c & 0x1F) << 6) | (s[i+1] & 0x3F);
+            k = 2;
+        }
+        if (offsets != NULL) {
+            offsets[n] = i;
+        }
+        word[n++] = c;
+        i += k;
+    }
+    return n;
+}
+
+static int lang_hyphenate_strings(lua_State * L)
+{
+    struct tex_language *lang = lang_argument(L, 1);
+    int lhmin = lang_hyphenmin_argument(L, 3, left_hyphen_min_par);
+    int rhmin = lang_hyphenmin_argument(L, 4, right_hyphen_min_par);
+    int nofwords, i, j;
+    int k = 0;
+    size_t size = 0;
+    unsigned *word = NULL;
+    int *positions = NULL;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    nofwords = (int) lua_rawlen(L, 2);
+    lua_createtable(L, 2 * nofwords, 0);
+    for (i = 1; i <= nofwords; i++) {
+        int n = 0;
+        lua_rawgeti(L, 2, i);
+        if (lua_type(L, -1) == LUA_TSTRING) {
+            size_t l;
+            const char *s = lua_tolstring(L, -1, &l);
+            int length;
+            if (l > size) {
+                size = l;
+                word = xrealloc(word, (unsigned) ((size + 1) * sizeof(unsigned)));
+                positions = xrealloc(positions, (unsigned) ((size + 1) * sizeof(int)));
+            }
+            length = lang_decode((const unsigned char *) s, l, word, NULL);
+            n = hyphenate_characters(lang, word, length, lhmin, rhmin, positions);
+        }
+        lua_pop(L, 1);
+        lua_pushinteger(L, n);
+        lua_rawseti(L, -2, ++k);
+        for (j = 0; j < n; j++) {
+            lua_pushinteger(L, positions[j] + 1);
+            lua_rawseti(L, -2, ++k);
+        }
+    }
+    free(word);
+    free(positions);
+    return 1;
+}
+
+/*tex
+
+    This hyphenates the words in the |length| characters of |word|, that start
+    at the byte |offsets|, and appends the byte positions plus |base| to the
+    table on top of the stack. When |partial| is set, a word that runs up to the
+    end is left for later. The number of characters dealt with is returned.
+
+*/
+
+static int lang_hyphenate_words(lua_State * L, struct tex_language *lang,
+    const unsigned *word, const size_t *offsets, int length, int lhmin, int rhmin,
+    size_t base, int partial, int *k)
+{
+    int *positions = xmalloc((unsigned) ((length + 1) * sizeof(int)));
+    int i = 0;
+    while (i < length) {
+        int first;
+        while (i < length && get_hj_code(lang->id, (int) word[i]) <= 0)
+            i++;
+        first = i;
+        while (i < length && get_hj_code(lang->id, (int) word[i]) > 0)
+            i++;
+        if (partial && i == length) {
+            i = first;
+            break;
+        } else if (i > first) {
+            int n = hyphenate_characters(lang, word + first, i - first, lhmin, rhmin, positions);
+            int j;
+            for (j = 0; j < n; j++) {
+                lua_pushinteger(L, (lua_Integer) (base + offsets[first + positions[j] + 1]) + 1);
+                lua_rawseti(L, -2, ++*k);
+            }
+        }
+    }
+    free(positions);
+    return i;
+}
+
+static int lang_hyphenate_buffer(lua_State * L)
+{
+    struct tex_language *lang = lang_argument(L, 1);
+    size_t l;
+    const char *s = luaL_checklstring(L, 2, &l);
+    int lhmin = lang_hyphenmin_argument(L, 3, left_hyphen_min_par);
+    int rhmin = lang_hyphenmin_argument(L, 4, right_hyphen_min_par);
+    lua_newtable(L);
+    if (lang != NULL) {
+        unsigned *word = xmalloc((unsigned) ((l + 1) * sizeof(unsigned)));
+        size_t *offsets = xmalloc((unsigned) ((l + 1) * sizeof(size_t)));
+        int length = lang_decode((const unsigned char *) s, l, word, offsets);
+        int k = 0;
+        lang_hyphenate_words(L, lang, word, offsets, length, lhmin, rhmin, 0, 0, &k);
+        free(word);
+        free(offsets);
+    }
+    return 1;
+}
+
+/*tex
+
+    The stream function keeps the language number, the hyphenmin values, the
+    position of the bytes not yet dealt with, and those bytes as upvalues.
+
+*/
+
+static int lang_stream_next(lua_State * L)
+{
+    size_t l = 0;
+    const char *s = luaL_optlstring(L, 1, NULL, &l);
+    struct tex_language *lang = find_language((int) lua_tointeger(L, lua_upvalueindex(1)));
+    int lhmin = (int) lua_tointeger(L, lua_upvalueindex(2));
+    int rhmin = (int) lua_tointeger(L, lua_upvalueindex(3));
+    size_t base = (size_t) lua_tointeger(L, lua_upvalueindex(4));
+    size_t p;
+    const char *pending = lua_tolstring(L, lua_upvalueindex(5), &p);
+    size_t total = p + l;
+    size_t usable = total;
+    size_t done = total;
+    char *buffer = xmalloc((unsigned) (total + 1));
+    memcpy(buffer, pending, p);
+    if (l > 0) {
+        memcpy(buffer + p, s, l);
+    }
+    lua_newtable(L);
+    if (s != NULL) {
+        /*tex A \UTF8\ sequence cut at the end waits for its last bytes. */
+        size_t i = total;
+        while (i > 0 && i + 3 > total && (((unsigned char) buffer[i-1]) & 0xC0) == 0x80)
+            i--;
+        if (i > 0) {
+            unsigned c = (unsigned char) buffer[i-1];
+            size_t k = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+            if (i - 1 + k > total)
+                usable = i - 1;
+        }
+    }
+    if (lang != NULL) {
+        unsigned *word = xmalloc((unsigned) ((usable + 1) * sizeof(unsigned)));
+        size_t *offsets = xmalloc((unsigned) ((usable + 1) * sizeof(size_t)));
+        int length = lang_decode((const unsigned char *) buffer, usable, word, offsets);
+        int k = 0;
+        int n = lang_hyphenate_words(L, lang, word, offsets, length, lhmin, rhmin, base, s != NULL, &k);
+        done = n < length ? offsets[n] : usable;
+        free(word);
+        free(offsets);
+    }
+    lua_pushinteger(L, (lua_Integer) (base + done));
+    lua_replace(L, lua_upvalueindex(4));
+    lua_pushlstring(L, buffer + done, total - done);
+    lua_replace(L, lua_upvalueindex(5));
+    free(buffer);
+    return 1;
+}
+
+static int lang_hyphenate_stream(lua_State * L)
+{
+    struct tex_language *lang = lang_argument(L, 1);
+    lua_pushinteger(L, lang != NULL ? lang->id : -1);
+    lua_pushinteger(L, lang_hyphenmin_argument(L, 2, left_hyphen_min_par));
+    lua_pushinteger(L, lang_hyphenmin_argument(L, 3, right_hyphen_min_par));
+    lua_pushinteger(L, 0);
+    lua_pushliteral(L, "");
+    lua_pushcclosure(L, lang_stream_next, 5);
+    return 1;
+}
+
 static const struct luaL_Reg langlib_d[] = {
     {"clear_patterns",    lang_clear_patterns},
     {"clear_hyphenation", lang_clear_hyphenation},
@@ -290,6 +525,9 @@ static const struct luaL_Reg langlib[] = {
     {"id",                lang_id},
     {"clean",             do_lang_clean},
     {"hyphenate",         do_lang_hyphenate},
+    {"hyphenatestrings",  lang_hyphenate_strings},
+    {"hyphenatebuffer",   lang_hyphenate_buffer},
+    {"hyphenatestream",   lang_hyphenate_stream},
     {"new",               lang_new},
     /*tex sentinel */
     {NULL,                NULL}
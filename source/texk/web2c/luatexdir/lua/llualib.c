@@ -379,6 +379,72 @@ static int get_call_level(lua_State * L) /* hh */
     return 1;
 }
 
+/*tex
+
+    The garbage collection policy: |step| is the size in kilobytes of the
+    incremental step that is done at the points that are enabled, |pause| and
+    |stepmul| are passed to the collector itself.
+
+*/
+
+static void set_gc_point(lua_State * L, const char *name, int point)
+{
+    lua_getfield(L, 1, name);
+    if (lua_type(L, -1) == LUA_TBOOLEAN) {
+        if (lua_toboolean(L, -1))
+            lua_gc_points |= point;
+        else
+            lua_gc_points &= ~point;
+    }
+    lua_pop(L, 1);
+}
+
+static int set_gc_policy(lua_State * L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_getfield(L, 1, "step");
+    if (lua_type(L, -1) == LUA_TNUMBER) {
+        int s = (int) lua_tointeger(L, -1);
+        lua_gc_step_size = s > 0 ? s : 0;
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "pause");
+    if (lua_type(L, -1) == LUA_TNUMBER)
+        lua_gc(L, LUA_GCSETPAUSE, (int) lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "stepmul");
+    if (lua_type(L, -1) == LUA_TNUMBER)
+        lua_gc(L, LUA_GCSETSTEPMUL, (int) lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    set_gc_point(L, "shipout", lua_gc_point_shipout);
+    set_gc_point(L, "page", lua_gc_point_page);
+    set_gc_point(L, "input", lua_gc_point_input);
+    return 0;
+}
+
+static int get_gc_policy(lua_State * L)
+{
+    int pause = lua_gc(L, LUA_GCSETPAUSE, 0);
+    int stepmul = lua_gc(L, LUA_GCSETSTEPMUL, 0);
+    /*tex There is no getter so we restore the values. */
+    lua_gc(L, LUA_GCSETPAUSE, pause);
+    lua_gc(L, LUA_GCSETSTEPMUL, stepmul);
+    lua_createtable(L, 0, 6);
+    lua_pushinteger(L, lua_gc_step_size);
+    lua_setfield(L, -2, "step");
+    lua_pushinteger(L, pause);
+    lua_setfield(L, -2, "pause");
+    lua_pushinteger(L, stepmul);
+    lua_setfield(L, -2, "stepmul");
+    lua_pushboolean(L, lua_gc_points & lua_gc_point_shipout);
+    lua_setfield(L, -2, "shipout");
+    lua_pushboolean(L, lua_gc_points & lua_gc_point_page);
+    lua_setfield(L, -2, "page");
+    lua_pushboolean(L, lua_gc_points & lua_gc_point_input);
+    lua_setfield(L, -2, "input");
+    return 1;
+}
+
 static const struct luaL_Reg lualib[] = {
     /* *INDENT-OFF* */
     {"getluaname",  get_luaname},
@@ -389,6 +455,8 @@ static const struct luaL_Reg lualib[] = {
     {"get_functions_table",lua_functions_get_table},
     {"getstacktop",get_stack_top},
     {"getcalllevel", get_call_level},
+    {"setgcpolicy", set_gc_policy},
+    {"getgcpolicy", get_gc_policy},
     /* *INDENT-ON* */
     {NULL, NULL}                /* sentinel */
 };
@@ -78,46 +78,79 @@
 
 /*
 
-    When the first argument to an accessor is a node, we can use it's metatable
-    entry when we are returning nodes, which saves a lookup.
+    A node userdata only carries the index of the node and is never changed
+    after it has been created, so we can hand out the same userdata each time a
+    node is pushed. The userdata are kept in a table with weak values, indexed by
+    node, so one that is no longer used by \LUA\ can be collected. Apart from
+    saving an allocation (and later a collection) per push this also makes the
+    same node the same key in a table.
 
 */
 
-#define fast_metatable(n) do {                              \
-     a = (halfword *) lua_newuserdata(L, sizeof(halfword)); \
-     *a = n;                                                \
-     lua_getmetatable(L,1);                                 \
-     lua_setmetatable(L,-2);                                \
+static int node_userdata_cache = LUA_NOREF;
+
+int node_userdata_hits = 0;
+int node_userdata_misses = 0;
+
+static void lua_nodelib_push_cached(lua_State * L, halfword n)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, node_userdata_cache);
+    lua_rawgeti(L, -1, n);
+    if (lua_type(L, -1) == LUA_TUSERDATA) {
+        node_userdata_hits++;
+    } else {
+        halfword *a;
+        lua_pop(L, 1);
+        a = (halfword *) lua_newuserdata(L, sizeof(halfword));
+        *a = n;
+        lua_get_metatablelua(luatex_node);
+        lua_setmetatable(L, -2);
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, -3, n);
+        node_userdata_misses++;
+    }
+    lua_remove(L, -2);
+}
+
+static void lua_new_userdata_cache(lua_State * L)
+{
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushstring(L, "v");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    node_userdata_cache = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+/*
+
+    These are used by accessors that return nodes.
+
+*/
+
+#define fast_metatable(n) do {           \
+     lua_nodelib_push_cached(L, n);      \
 } while (0)
 
-#define fast_metatable_or_nil(n) do {                          \
-     if (n) {                                                  \
-        a = (halfword *) lua_newuserdata(L, sizeof(halfword)); \
-        *a = n;                                                \
-        lua_getmetatable(L,1);                                 \
-        lua_setmetatable(L,-2);                                \
-    } else {                                                   \
-        lua_pushnil(L);                                        \
-    }                                                          \
+#define fast_metatable_or_nil(n) do {       \
+     if (n) {                               \
+        lua_nodelib_push_cached(L, n);      \
+    } else {                                \
+        lua_pushnil(L);                     \
+    }                                       \
 } while (0)
 
-#define fast_metatable_or_nil_alink(n) do {                    \
-     if (n) {                                                  \
-        alink(n) = null;                                       \
-        a = (halfword *) lua_newuserdata(L, sizeof(halfword)); \
-        *a = n;                                                \
-        lua_getmetatable(L,1);                                 \
-        lua_setmetatable(L,-2);                                \
-    } else {                                                   \
-        lua_pushnil(L);                                        \
-   }                                                           \
+#define fast_metatable_or_nil_alink(n) do { \
+     if (n) {                               \
+        alink(n) = null;                    \
+        lua_nodelib_push_cached(L, n);      \
+    } else {                                \
+        lua_pushnil(L);                     \
+   }                                        \
 } while (0)
 
-#define fast_metatable_top(n) do {                          \
-     a = (halfword *) lua_newuserdata(L, sizeof(halfword)); \
-     *a = n;                                                \
-     lua_getmetatable(L,-2);                                \
-     lua_setmetatable(L,-2);                                \
+#define fast_metatable_top(n) do {       \
+     lua_nodelib_push_cached(L, n);      \
 } while (0)
 
 /*
@@ -410,7 +443,6 @@ static int lua_nodelib_prev(lua_State * L)
 void lua_nodelib_push(lua_State * L)
 {
     halfword n;
-    halfword *a;
     n = -1;
     if (lua_type(L, -1) == LUA_TNUMBER)
         n = (int) lua_tointeger(L, -1);
@@ -418,22 +450,15 @@ void lua_nodelib_push(lua_State * L)
     if ((n == null) || (n < 0) || (n > var_mem_max)) {
         lua_pushnil(L);
     } else {
-        a = lua_newuserdata(L, sizeof(halfword));
-        *a = n;
-        lua_get_metatablelua(luatex_node);
-        lua_setmetatable(L, -2);
+        lua_nodelib_push_cached(L, n);
     }
     return;
 }
 
 void lua_nodelib_push_fast(lua_State * L, halfword n)
 {
-    halfword *a;
     if (n) {
-        a = lua_newuserdata(L, sizeof(halfword));
-        *a = n;
-        lua_get_metatablelua(luatex_node);
-        lua_setmetatable(L, -2);
+        lua_nodelib_push_cached(L, n);
     } else {
         lua_pushnil(L);
     }
@@ -1237,7 +1262,6 @@ static int lua_nodelib_direct_setdisc(lua_State * L)
 
     static int lua_nodelib_getdisc(lua_State * L)
     {
-        halfword *a;
         halfword *n = lua_touserdata(L, 1);
         if ((n != NULL) && (type(*n) == disc_node)) {
             fast_metatable_or_nil(vlink(pre_break(*n)));
@@ -1441,7 +1465,6 @@ static int lua_nodelib_direct_setlist(lua_State * L)
 
     static int lua_nodelib_getlist(lua_State * L)
     {
-        halfword *a;
         halfword *n = lua_touserdata(L, 1);
         if ((n == NULL) || (! lua_getmetatable(L,1))) {
             lua_pushnil(L);
@@ -1490,7 +1513,6 @@ static int lua_nodelib_direct_setleader(lua_State * L)
 
     static int lua_nodelib_getleader(lua_State * L)
     {
-        halfword *a;
         halfword *n = lua_touserdata(L, 1);
         if ((n == NULL) || (! lua_getmetatable(L,1)) ) {
             lua_pushnil(L);
@@ -1768,7 +1790,6 @@ static int lua_nodelib_direct_setnext(lua_State * L)
 
     static int lua_nodelib_getnext(lua_State * L)
     {
-        halfword *a;
         /* [given-node] [...]*/
         halfword *p = lua_touserdata(L, 1);
         if ( (p == NULL) || (! lua_getmetatable(L,1)) ) {
@@ -1817,7 +1838,6 @@ static int lua_nodelib_direct_setprev(lua_State * L)
 
     static int lua_nodelib_getprev(lua_State * L)
     {
-        halfword *a;
         halfword *p = lua_touserdata(L, 1);
         if ( (p == NULL) || (! lua_getmetatable(L,1)) ) {
             lua_pushnil(L);
@@ -1870,7 +1890,6 @@ static int lua_nodelib_direct_setboth(lua_State * L)
 
     static int lua_nodelib_getboth(lua_State * L)
     {
-        halfword *a;
         halfword *p = lua_touserdata(L, 1);
         if ( (p == NULL) || (! lua_getmetatable(L,1)) ) {
             lua_pushnil(L);
@@ -4123,7 +4142,6 @@ static int lua_nodelib_direct_traverse_list(lua_State * L)
 static int nodelib_aux_next(lua_State * L)
 {
     halfword t;
-    halfword *a;
     if (lua_isnil(L, 2)) {
         t = *check_isnode(L, 1);
         lua_settop(L,1);
@@ -4160,7 +4178,6 @@ static int lua_nodelib_traverse(lua_State * L)
 static int nodelib_aux_next_filtered(lua_State * L)
 {
     halfword t;        /* traverser */
-    halfword *a;
     int i = (int) lua_tointeger(L, lua_upvalueindex(1));
     if (lua_isnil(L, 2)) {      /* first call */
         t = *check_isnode(L, 1);
@@ -4201,7 +4218,6 @@ static int lua_nodelib_traverse_filtered(lua_State * L)
 static int nodelib_aux_next_char(lua_State * L)
 {
     halfword t;            /* traverser */
-    halfword *a;
     if (lua_isnil(L, 2)) { /* first call */
         t = *check_isnode(L, 1);
         lua_settop(L,1);
@@ -4241,7 +4257,6 @@ static int lua_nodelib_traverse_char(lua_State * L)
 static int nodelib_aux_next_glyph(lua_State * L)
 {
     halfword t;            /* traverser */
-    halfword *a;
     if (lua_isnil(L, 2)) { /* first call */
         t = *check_isnode(L, 1);
         lua_settop(L,1);
@@ -4281,7 +4296,6 @@ static int lua_nodelib_traverse_glyph(lua_State * L)
 static int nodelib_aux_next_list(lua_State * L)
 {
     halfword t;        /* traverser */
-    halfword *a;
     if (lua_isnil(L, 2)) {      /* first call */
         t = *check_isnode(L, 1);
         lua_settop(L,1);
@@ -4390,6 +4404,161 @@ static int lua_nodelib_count(lua_State * L)
     return do_lua_nodelib_count(L, m, i, n);
 }
 
+/* node.direct.getlistdata */
+/* node.direct.setlistdata */
+
+/*
+
+    These bulk accessors fill (or consult) flat arrays in one pass so that for
+    instance an OpenType handler doesn't have to cross the C boundary for each
+    field of each node. The given table gets the nodes at its array positions
+    and the subtables |id|, |char|, |font|, |width|, |xoffset|, |yoffset| and
+    |attr| are filled when present. Fields that make no sense for a node get
+    the value |false| so that the arrays stay dense. The setter only writes
+    back the |char|, |xoffset| and |yoffset| of glyphs.
+
+*/
+
+static int nodelib_getdatatable(lua_State * L, int t, int index)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, index);
+    lua_rawget(L, t);
+    if (lua_type(L, -1) == LUA_TTABLE) {
+        return lua_gettop(L);
+    }
+    lua_pop(L, 1);
+    return 0;
+}
+
+static int lua_nodelib_direct_getlistdata(lua_State * L)
+{
+    halfword n = (halfword) lua_tointeger(L, 1);
+    halfword m = (halfword) lua_tointeger(L, 2);
+    int a = (int) luaL_optinteger(L, 4, -1);
+    int i = 0;
+    int ids, chars, fonts, widths, xoffsets, yoffsets, attrs;
+    luaL_checktype(L, 3, LUA_TTABLE);
+    ids = nodelib_getdatatable(L, 3, lua_key_index(id));
+    chars = nodelib_getdatatable(L, 3, lua_key_index(char));
+    fonts = nodelib_getdatatable(L, 3, lua_key_index(font));
+    widths = nodelib_getdatatable(L, 3, lua_key_index(width));
+    xoffsets = nodelib_getdatatable(L, 3, lua_key_index(xoffset));
+    yoffsets = nodelib_getdatatable(L, 3, lua_key_index(yoffset));
+    attrs = a >= 0 ? nodelib_getdatatable(L, 3, lua_key_index(attr)) : 0;
+    while (n != null && n != m) {
+        halfword t = type(n);
+        i++;
+        lua_pushinteger(L, n);
+        lua_rawseti(L, 3, i);
+        if (ids) {
+            lua_pushinteger(L, t);
+            lua_rawseti(L, ids, i);
+        }
+        if (t == glyph_node) {
+            if (chars) {
+                lua_pushinteger(L, character(n));
+                lua_rawseti(L, chars, i);
+            }
+            if (fonts) {
+                lua_pushinteger(L, font(n));
+                lua_rawseti(L, fonts, i);
+            }
+            if (widths) {
+                lua_pushinteger(L, char_width(font(n), character(n)));
+                lua_rawseti(L, widths, i);
+            }
+            if (xoffsets) {
+                lua_pushinteger(L, x_displace(n));
+                lua_rawseti(L, xoffsets, i);
+            }
+            if (yoffsets) {
+                lua_pushinteger(L, y_displace(n));
+                lua_rawseti(L, yoffsets, i);
+            }
+        } else {
+            if (chars) {
+                lua_pushboolean(L, 0);
+                lua_rawseti(L, chars, i);
+            }
+            if (fonts) {
+                lua_pushboolean(L, 0);
+                lua_rawseti(L, fonts, i);
+            }
+            if (widths) {
+                if (t == hlist_node || t == vlist_node || t == rule_node || t == glue_node || t == kern_node ||
+                        t == math_node || t == margin_kern_node || t == unset_node) {
+                    lua_pushinteger(L, width(n));
+                } else {
+                    lua_pushboolean(L, 0);
+                }
+                lua_rawseti(L, widths, i);
+            }
+            if (xoffsets) {
+                lua_pushboolean(L, 0);
+                lua_rawseti(L, xoffsets, i);
+            }
+            if (yoffsets) {
+                lua_pushboolean(L, 0);
+                lua_rawseti(L, yoffsets, i);
+            }
+        }
+        if (attrs) {
+            int v = has_attribute(n, a, UNUSED_ATTRIBUTE);
+            if (v > UNUSED_ATTRIBUTE) {
+                lua_pushinteger(L, v);
+            } else {
+                lua_pushboolean(L, 0);
+            }
+            lua_rawseti(L, attrs, i);
+        }
+        n = vlink(n);
+    }
+    lua_pushinteger(L, i);
+    return 1;
+}
+
+static int lua_nodelib_direct_setlistdata(lua_State * L)
+{
+    int i;
+    int n, chars, xoffsets, yoffsets;
+    luaL_checktype(L, 1, LUA_TTABLE);
+    n = (int) luaL_optinteger(L, 2, (lua_Integer) lua_rawlen(L, 1));
+    chars = nodelib_getdatatable(L, 1, lua_key_index(char));
+    xoffsets = nodelib_getdatatable(L, 1, lua_key_index(xoffset));
+    yoffsets = nodelib_getdatatable(L, 1, lua_key_index(yoffset));
+    for (i = 1; i <= n; i++) {
+        halfword p;
+        lua_rawgeti(L, 1, i);
+        p = (halfword) lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        if (p == null || type(p) != glyph_node) {
+            continue;
+        }
+        if (chars) {
+            lua_rawgeti(L, chars, i);
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                character(p) = (halfword) lua_tointeger(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+        if (xoffsets) {
+            lua_rawgeti(L, xoffsets, i);
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                x_displace(p) = (halfword) lua_roundnumber(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+        if (yoffsets) {
+            lua_rawgeti(L, yoffsets, i);
+            if (lua_type(L, -1) == LUA_TNUMBER) {
+                y_displace(p) = (halfword) lua_roundnumber(L, -1);
+            }
+            lua_pop(L, 1);
+        }
+    }
+    return 0;
+}
+
 /* node.direct.getfield */
 
 static void lua_nodelib_getfield_whatsit(lua_State * L, int n, const char *s)
@@ -4608,7 +4777,6 @@ static int lua_nodelib_fast_getfield(lua_State * L)
         importance of fields
     */
 
-      halfword *a;
       const char *s;
 
       halfword n = *((halfword *) lua_touserdata(L, 1));
@@ -6070,6 +6238,55 @@ static int font_tex_direct_kerning(lua_State * L)
     return 3;
 }
 
+/* node.shaping */
+
+static int font_tex_shaping_indeed(lua_State * L, int direct)
+{
+    /* on the stack are two nodes */
+    halfword tmp_head;
+    halfword h;
+    halfword t = null;
+    halfword p ;
+    if (lua_gettop(L) < 1) {
+        lua_pushnil(L);
+        lua_pushboolean(L, 0);
+        return 2;
+    }
+    h = direct ? (halfword) lua_tointeger(L, 1) : *check_isnode(L, 1);
+    if (lua_gettop(L) > 1) {
+        t = direct ? (halfword) lua_tointeger(L, 2) : *check_isnode(L, 2);
+    }
+    tmp_head = new_node(nesting_node, 1);
+    p = alink(h);
+    couple_nodes(tmp_head, h);
+    tlink(tmp_head) = t;
+    t = handle_shaping(tmp_head, t);
+    if (p != null) {
+        vlink(p) = vlink(tmp_head) ;
+    }
+    alink(vlink(tmp_head)) = p ;
+    if (direct) {
+        lua_pushinteger(L, vlink(tmp_head));
+        lua_pushinteger(L, t);
+    } else {
+        lua_nodelib_push_fast(L, vlink(tmp_head));
+        lua_nodelib_push_fast(L, t);
+    }
+    lua_pushboolean(L, 1);
+    flush_node(tmp_head);
+    return 3;
+}
+
+static int font_tex_shaping(lua_State * L)
+{
+    return font_tex_shaping_indeed(L, 0);
+}
+
+static int font_tex_direct_shaping(lua_State * L)
+{
+    return font_tex_shaping_indeed(L, 1);
+}
+
 /* node.protect_glyphs (returns also boolean because that signals callback) */
 /* node.unprotect_glyphs (returns also boolean because that signals callback) */
 
@@ -6296,7 +6513,6 @@ static int lua_nodelib_direct_first_glyph(lua_State * L)
 
 static int lua_nodelib_has_glyph(lua_State * L)
 {
-    halfword *a;
     halfword h = (halfword) *(check_isnode(L,1)) ;
     while (h != null) {
         if ( (type(h) == glyph_node) || (type(h) == disc_node)) {
@@ -6498,13 +6714,9 @@ static int lua_nodelib_direct_todirect(lua_State * L)
 
 static int lua_nodelib_direct_tonode(lua_State * L)
 {
-    halfword *a;
     halfword n = lua_tointeger(L, 1);
     if (n != null) {
-        a = (halfword *) lua_newuserdata(L, sizeof(halfword));
-        *a=n;
-        lua_get_metatablelua(luatex_node);
-        lua_setmetatable(L,-2);
+        lua_nodelib_push_cached(L, n);
     } /* else assume node and return argument */
     return 1;
 }
@@ -8546,7 +8758,6 @@ static int lua_nodelib_flatten_discretionaries(lua_State * L)
     halfword current = head;
     halfword next;
     halfword d, n, h, t;
-    halfword *a;
     int c = 0;
     while (current != null) {
         next = vlink(current);
@@ -8665,7 +8876,6 @@ static int lua_nodelib_direct_get_synctex_fields(lua_State * L)
 
 static int lua_nodelib_prepend_prevdepth(lua_State * L)
 {
-    halfword *a;
     halfword p;
     halfword prevdepth;
     boolean mirrored;
@@ -8832,6 +9042,7 @@ static const struct luaL_Reg direct_nodelib_f[] = {
     {"getprev", lua_nodelib_direct_getprev},
     {"getboth", lua_nodelib_direct_getboth},
     {"getlist", lua_nodelib_direct_getlist},
+    {"getlistdata", lua_nodelib_direct_getlistdata},
     {"getleader", lua_nodelib_direct_getleader},
     {"getdata", lua_nodelib_direct_getdata},
     {"getsubtype", lua_nodelib_direct_getsubtype},
@@ -8866,6 +9077,7 @@ static const struct luaL_Reg direct_nodelib_f[] = {
     {"protrusion_skippable", lua_nodelib_direct_cp_skipable},
     {"remove", lua_nodelib_direct_remove},
     {"set_attribute", lua_nodelib_direct_set_attribute},
+    {"shaping", font_tex_direct_shaping},
     {"setbox", lua_nodelib_direct_setbox},
     {"setfield", lua_nodelib_direct_setfield},
     {"setchar", lua_nodelib_direct_setchar},
@@ -8891,6 +9103,7 @@ static const struct luaL_Reg direct_nodelib_f[] = {
     {"setlink", lua_nodelib_direct_setlink},
     {"setsplit", lua_nodelib_direct_setsplit},
     {"setlist", lua_nodelib_direct_setlist},
+    {"setlistdata", lua_nodelib_direct_setlistdata},
     {"setleader", lua_nodelib_direct_setleader},
     {"setdata", lua_nodelib_direct_setdata},
     {"setsubtype", lua_nodelib_direct_setsubtype},
@@ -8998,6 +9211,7 @@ static const struct luaL_Reg nodelib_f[] = {
     {"remove", lua_nodelib_remove},
  /* {"setbox", lua_nodelib_setbox}, */ /* tex.setbox */
     {"set_attribute", lua_nodelib_set_attribute},
+    {"shaping", font_tex_shaping},
     {"slide", lua_nodelib_slide},
     {"subtype", lua_nodelib_subtype},
     {"tail", lua_nodelib_tail},
@@ -9049,6 +9263,7 @@ int luaopen_node(lua_State * L)
 {
 
     lua_new_properties_table(L);
+    lua_new_userdata_cache(L);
 
     /* the main metatable of node userdata */
     luaL_newmetatable(L, NODE_METATABLE);
@@ -705,6 +705,73 @@ static int pdfelib_readwholestream(lua_State * L)
     return 0;
 }
 
+/*tex
+
+    Many streams (for instance all content streams and images of a page) can
+    be read in one go. They are read in the order they appear in the file and
+    the result is a table with the data, in the order of the given streams, with
+    \type {false} for streams that could not be read. When decoding, plain
+    \FLATE\ streams are inflated by worker threads. The optional third argument
+    sets the number of threads, where the default (zero) is one per processor
+    and one disables them.
+
+    \starttyping
+    strings = readwholestreams({ streamobject, ... },decode,threads)
+    \stoptyping
+
+*/
+
+typedef struct {
+    lua_State *L;
+    int *slots;
+} pdfe_batch;
+
+static void pdfelib_readwholestreams_callback(ppstream *stream, size_t index, uint8_t *data, size_t size, void *alien)
+{
+    pdfe_batch *batch = (pdfe_batch *) alien;
+    (void) stream;
+    lua_pushlstring(batch->L, (const char *) data, size);
+    lua_rawseti(batch->L, -2, batch->slots[index]);
+}
+
+static int pdfelib_readwholestreams(lua_State * L)
+{
+    if (lua_type(L, 1) == LUA_TTABLE) {
+        int decode = lua_isboolean(L, 2) ? lua_toboolean(L, 2) : 0;
+        int threads = (int) luaL_optinteger(L, 3, 0);
+        int n = (int) lua_rawlen(L, 1);
+        int i;
+        size_t count = 0;
+        pdfe_batch batch;
+        ppstream **streams = xmalloc((unsigned) ((n > 0 ? n : 1) * sizeof(ppstream *)));
+        batch.L = L;
+        batch.slots = xmalloc((unsigned) ((n > 0 ? n : 1) * sizeof(int)));
+        lua_createtable(L, n, 0);
+        for (i = 1; i <= n; i++) {
+            pdfe_stream *s;
+            lua_pushboolean(L, 0);
+            lua_rawseti(L, -2, i);
+            lua_rawgeti(L, 1, i);
+            s = check_isstream(L, -1);
+            lua_pop(L, 1);
+            if (s != NULL) {
+                if (s->open > 0) {
+                    ppstream_done(s->stream);
+                    s->open = 0;
+                    s->decode = 0;
+                }
+                batch.slots[count] = i;
+                streams[count++] = s->stream;
+            }
+        }
+        ppstream_batch(streams, count, decode, threads, pdfelib_readwholestreams_callback, &batch);
+        xfree(batch.slots);
+        xfree(streams);
+        return 1;
+    }
+    return 0;
+}
+
 /*tex
 
     Alternatively streams can be fetched stepwise:
@@ -770,10 +837,16 @@ static int pdfelib_readfromstream(lua_State * L)
     There are two methods for opening a document: files and strings.
 
     \starttyping
-    documentobject = open(filename)
-    documentobject = new(string,length)
+    documentobject = open(filename[,lazy])
+    documentobject = new(string,length[,lazy])
     \stoptyping
 
+    When \type {lazy} is \type {true} only the cross reference tables and
+    trailers are read; objects (and object streams) are parsed when they are
+    accessed for the first time. For large documents of which only a few
+    objects are needed this saves time and memory, which can be checked with
+    \type {getmemoryusage}.
+
     Closing happens with:
 
     \starttyping
@@ -788,7 +861,9 @@ static int pdfelib_readfromstream(lua_State * L)
 static int pdfelib_open(lua_State * L)
 {
     const char *filename = luaL_checkstring(L, 1);
+    int lazy = ppdoc_lazy(lua_toboolean(L, 2));
     ppdoc *d = ppdoc_load(filename);
+    ppdoc_lazy(lazy);
     if (d == NULL) {
         formatted_warning("pdfe lib","no valid pdf file '%s'",filename);
     } else {
@@ -833,9 +908,11 @@ static int pdfelib_new(lua_State * L)
     }
     memcpy(memstream, docstream, (streamsize + 1));
     memstream[streamsize]='\0';
-    if (lua_gettop(L) == 2) {
+    if (lua_gettop(L) == 2 || lua_type(L, 3) == LUA_TBOOLEAN) {
         /* we stay at the lua end */
+        int lazy = ppdoc_lazy(lua_toboolean(L, 3));
         ppdoc *d = ppdoc_mem(memstream, streamsize);
+        ppdoc_lazy(lazy);
         if (d == NULL) {
             normal_warning("pdfe lib","no valid pdf mem stream");
         } else {
@@ -1568,6 +1645,7 @@ static const struct luaL_Reg pdfelib[] = {
     { "getstream",               pdfelib_getstream },
     /* streams */
     { "readwholestream",         pdfelib_readwholestream },
+    { "readwholestreams",        pdfelib_readwholestreams },
     /* not really needed */
     { "openstream",              pdfelib_openstream },
     { "readfromstream",          pdfelib_readfromstream },
@@ -195,6 +195,8 @@ static int table_obj(lua_State * L)
     lstring buf;
     int immediate = 0;          /* default: not immediate */
     int nolength = 0;
+    int shared = 0;
+    int write_now = 0;
     attr.s = st.s = NULL;
     attr.l = 0;
     assert(lua_istable(L, 1));  /* t */
@@ -215,12 +217,26 @@ static int table_obj(lua_State * L)
         immediate = lua_toboolean(L, -1);       /* 0 or 1 */
     }
     lua_pop(L, 1);              /* t */
+    lua_key_rawgeti(shared);
+    if (lua_type(L, -1) == LUA_TSTRING) {
+        shared = 1;
+    } else if (lua_isboolean(L, -1)) {
+        shared = lua_toboolean(L, -1);
+    } else if (!lua_isnil(L, -1)) {
+        luaL_error(L, "pdf.obj(): \"shared\" must be boolean or string");
+    }
+    lua_pop(L, 1);              /* t */
     lua_key_rawgeti(nolength);
     if (!lua_isnil(L, -1)) {    /* b? t */
         if (lua_isboolean(L, -1))      /* !b t */
             nolength = lua_toboolean(L, -1);       /* 0 or 1 */
     }
     lua_pop(L, 1);              /* t */
+    if (shared && immediate && !nolength && pdf_has_resource_pack()) {
+        /* a shared object is written via the resource pack, a nolength stream is already packed */
+        immediate = 0;
+        write_now = 1;
+    }
 
     /* is a reserved object referenced by "objnum"? */
 
@@ -242,6 +258,14 @@ static int table_obj(lua_State * L)
         init_obj_obj(static_pdf, k);
     }
     lua_pop(L, 1);              /* t */
+    if (shared) {
+        set_obj_obj_is_shared(static_pdf, k);
+        lua_key_rawgeti(shared);
+        if (lua_type(L, -1) == LUA_TSTRING)
+            obj_obj_shared_name(static_pdf, k) = luaL_ref(L, LUA_REGISTRYINDEX);     /* t */
+        else
+            lua_pop(L, 1);      /* t */
+    }
 
     /* get optional "attr" (allowed only for stream case) */
 
@@ -399,6 +423,8 @@ static int table_obj(lua_State * L)
         }
     }
     static_pdf->compress_level = saved_compress_level;
+    if (write_now)
+        pdf_write_obj(static_pdf, k);
     return k;
 }
 
@@ -490,6 +516,27 @@ static int l_refobj(lua_State * L)
     return 0;
 }
 
+static int l_setresourcepack(lua_State * L)
+{
+    const char *s = luaL_checkstring(L, 1);
+    if (!pdf_set_resource_pack(s))
+        luaL_error(L, "pdf.setresourcepack() can only be used once");
+    return 0;
+}
+
+static int l_getsharedobj(lua_State * L)
+{
+    int k;
+    const char *s = luaL_checkstring(L, 1);
+    ensure_output_state(static_pdf, ST_HEADER_WRITTEN);
+    k = pdf_get_shared_obj(static_pdf, s);
+    if (k > 0)
+        lua_pushinteger(L, k);
+    else
+        lua_pushnil(L);
+    return 1;
+}
+
 static int l_reserveobj(lua_State * L)
 {
     int n;
@@ -1166,7 +1213,7 @@ static int l_set_font_attributes(lua_State * L)
     if ((lua_type(L,-1) == LUA_TSTRING) && (st = lua_tostring(L, -1)) != NULL) {
         /* is this dup needed? */
         /*s = xstrdup(st);*/
-        i = maketexstring(st); /* brrr */
+        i = maketexlstring_shared(st, strlen(st));
         set_pdf_font_attr(f, i);
         /*free(s);*/
     }
@@ -1265,6 +1312,8 @@ static const struct luaL_Reg pdflib[] = {
     { "refobj", l_refobj },
     { "registerannot", l_registerannot },
     { "reserveobj", l_reserveobj },
+    { "setresourcepack", l_setresourcepack },
+    { "getsharedobj", l_getsharedobj },
     { "getpos", l_getpos },
     { "getpageref", getpdfpageref },
     { "getmaxobjnum", getpdfmaxobjnum },
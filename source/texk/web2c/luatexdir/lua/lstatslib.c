@@ -340,11 +340,14 @@ static struct statistic stats[] = {
     {"pool_ptr", 'g', &pool_size},
     {"init_pool_ptr", 'g', &init_pool_ptr},
     {"pool_size", 'g', &pool_size},
+    {"pool_saved", 'g', &pool_saved},
+    {"str_shared", 'g', &str_shared},
     {"var_mem_max", 'g', &var_mem_max},
     {"node_mem_usage", 'S', &sprint_node_mem_usage},
     {"fix_mem_max", 'g', &fix_mem_max},
     {"fix_mem_min", 'g', &fix_mem_min},
     {"fix_mem_end", 'g', &fix_mem_end},
+    {"fix_mem_growths", 'g', &fix_mem_growths},
     {"cs_count", 'g', &cs_count},
     {"hash_size", 'G', &get_hash_size},
     {"hash_extra", 'g', &hash_extra},
@@ -381,6 +384,17 @@ static struct statistic stats[] = {
     {"direct_callbacks", 'g', &direct_callback_count},
     {"function_callbacks", 'g', &function_callback_count},
 
+    {"hyphenation_cache_hits", 'g', &hyphenation_cache_hits},
+    {"hyphenation_cache_misses", 'g', &hyphenation_cache_misses},
+    {"lua_chunk_cache_hits", 'g', &lua_chunk_cache_hits},
+    {"lua_chunk_cache_misses", 'g', &lua_chunk_cache_misses},
+    {"node_userdata_hits", 'g', &node_userdata_hits},
+    {"node_userdata_misses", 'g', &node_userdata_misses},
+    {"lua_gc_steps", 'g', &lua_gc_steps},
+    {"lua_gc_cycles", 'g', &lua_gc_cycles},
+    {"lua_gc_time", 'g', &lua_gc_time},
+    {"lua_gc_max_time", 'g', &lua_gc_max_time},
+
     {"lc_ctype", 'S', (void *) &get_lc_ctype},
     {"lc_collate", 'S', (void *) &get_lc_collate},
     {"lc_numeric",'S', (void *) &get_lc_numeric},
@@ -505,8 +519,30 @@ static int setexitcode(lua_State * L) {
     return 0;
 }
 
+/*tex The size classes of the \LUA\ allocator, only filled with \type {--luapool}. */
+
+static int getluapool(lua_State * L)
+{
+    int i;
+    lua_createtable(L, lua_pool_classes_size, 1);
+    for (i = 0; i < lua_pool_classes_size; i++) {
+        lua_createtable(L, 0, 3);
+        lua_pushinteger(L, (i + 1) * lua_pool_step);
+        lua_setfield(L, -2, "size");
+        lua_pushinteger(L, lua_pool_classes[i].used);
+        lua_setfield(L, -2, "used");
+        lua_pushinteger(L, lua_pool_classes[i].available);
+        lua_setfield(L, -2, "free");
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushinteger(L, lua_pool_slab_bytes);
+    lua_setfield(L, -2, "slab_bytes");
+    return 1;
+}
+
 static const struct luaL_Reg statslib[] = {
     {"list", statslist},
+    {"getluapool", getluapool},
     {"resetmessages", resetmessages},
     {"setexitcode", setexitcode},
     {NULL, NULL}                /* sentinel */
@@ -2559,7 +2559,7 @@ static int tex_definefont(lua_State * L)
     }
     csname = luaL_checklstring(L, i, &l);
     f = luaL_checkinteger(L, (i + 1));
-    t = maketexlstring(csname, l);
+    t = maketexlstring_shared(csname, l);
     no_new_control_sequence = 0;
     u = string_lookup(csname, l);
     no_new_control_sequence = 1;
@@ -79,6 +79,7 @@ const_string LUATEX_IHELP[] = {
     "   --jobname=STRING              set the job name to STRING",
     "   --kpathsea-debug=NUMBER       set path searching debugging flags according to the bits of NUMBER",
     "   --lua=FILE                    load and execute a lua initialization script",
+    "   --luapool                     use a pooled allocator for small lua objects",
     "   --[no-]mktex=FMT              disable/enable mktexFMT generation (FMT=tex/tfm)",
     "   --nosocket                    disable the lua socket library",
     "   --output-comment=STRING       use STRING for DVI file comment instead of date (no effect for PDF)",
@@ -229,6 +230,7 @@ static struct option long_options[] = {
     {"safer", 0, &safer_option, 1},
     {"utc", 0, &utc_option, 1},
     {"nosocket", 0, &nosocket_option, 1},
+    {"luapool", 0, &luapool_option, 1},
     {"help", 0, 0, 0},
     {"ini", 0, &ini_version, 1},
     {"interaction", 1, 0, 0},
@@ -615,9 +617,9 @@ static const char *luatex_kpse_find_aux(lua_State *L, const char *name,
     const char *altname;
     /*tex Lua convention */
     altname = luaL_gsub(L, name, ".", "/");
-    filename = kpse_find_file(altname, format, false);
+    filename = texmf_find_file(altname, format, false);
     if (filename == NULL) {
-        filename = kpse_find_file(name, format, false);
+        filename = texmf_find_file(name, format, false);
     }
     if (filename == NULL) {
         lua_pushfstring(L, "\n\t[kpse %s searcher] file not found: " LUA_QS, errname, name);
@@ -638,6 +640,29 @@ static const char *luatex_kpse_find_aux(lua_State *L, const char *name,
 
 static int lua_loader_function = 0;
 
+/*tex Modules in a \TEX\ pack are loaded from memory. */
+
+static int luatex_kpse_load(lua_State * L, const char *filename)
+{
+    size_t size;
+    const char *data = texmf_pack_data(filename, &size);
+    int status;
+    if (data == NULL) {
+        return luaL_loadfile(L, filename);
+    }
+    /*tex Skip a |#| line like |luaL_loadfile| does, but keep the line count. */
+    if (size > 0 && data[0] == '#') {
+        while (size > 0 && data[0] != '\n') {
+            data++;
+            size--;
+        }
+    }
+    lua_pushfstring(L, "@%s", filename);
+    status = luaL_loadbuffer(L, data, size, lua_tostring(L, -1));
+    lua_remove(L, -2);
+    return status;
+}
+
 static int luatex_kpse_lua_find(lua_State * L)
 {
     const char *filename;
@@ -654,7 +679,7 @@ static int luatex_kpse_lua_find(lua_State * L)
         /*tex library not found in this path */
         return 1;
     }
-    if (luaL_loadfile(L, filename) != 0) {
+    if (luatex_kpse_load(L, filename) != 0) {
         luaL_error(L, "error loading module %s from file %s:\n\t%s",
             lua_tostring(L, 1), filename, lua_tostring(L, -1));
     }
@@ -1124,6 +1149,10 @@ void lua_initialize(int ac, char **av)
         if (starttime >= 0) {
             set_start_time(starttime);
         }
+        get_lua_number("texconfig", "lua_gc_step", &lua_gc_step_size);
+        if (lua_gc_step_size < 0) {
+            lua_gc_step_size = 0;
+        }
         utc = -1 ;
         get_lua_boolean("texconfig", "use_utc_time", &utc);
         if (utc >= 0 && utc <= 1) {
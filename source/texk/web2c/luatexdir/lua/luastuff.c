@@ -32,6 +32,46 @@ lua_State *Luas = NULL;
 int luastate_bytes = 0;
 int lua_active = 0;
 
+/*tex
+
+    Normally the garbage collector runs when \LUA\ decides that enough memory
+    has been allocated, which can be in the middle of a callback that is busy
+    with a paragraph. When |lua_gc_step_size| is positive the engine itself does
+    an incremental step of that many kilobytes at points where \TEX\ is in
+    between jobs: after a page has been shipped out, when the page builder fires
+    and when a file is opened or the terminal is read. The collector then runs
+    more often at these points and less often in the middle of things. The time
+    spent in these steps is registered so that it can be reported.
+
+*/
+
+int lua_gc_step_size = 0;
+int lua_gc_points = lua_gc_point_all;
+int lua_gc_steps = 0;
+int lua_gc_cycles = 0;
+int lua_gc_time = 0;
+int lua_gc_max_time = 0;
+
+void lua_gc_quiet_point(int point)
+{
+    if (Luas != NULL && lua_gc_step_size > 0 && (lua_gc_points & point)) {
+        int s1, m1, s2, m2, t;
+        seconds_and_micros(s1, m1);
+        if (lua_gc(Luas, LUA_GCSTEP, lua_gc_step_size)) {
+            lua_gc_cycles++;
+        }
+        seconds_and_micros(s2, m2);
+        t = (s2 - s1) * 1000000 + (m2 - m1);
+        if (t > 0) {
+            lua_gc_time += t;
+            if (t > lua_gc_max_time) {
+                lua_gc_max_time = t;
+            }
+        }
+        lua_gc_steps++;
+    }
+}
+
 #ifdef LuajitTeX
 #define Luas_load(Luas,getS,ls,lua_id) \
     lua_load(Luas,getS,ls,lua_id);
@@ -96,6 +136,13 @@ static const char *getS(lua_State * L, void *ud, size_t * size)
     return ls->s;
 }
 
+/*tex The pool is not used with \LUAJITTEX, but the statistics are always there. */
+
+int luapool_option = 0;
+int lua_pool_slab_bytes = 0;
+
+lua_pool_class_info lua_pool_classes[lua_pool_classes_size];
+
 #ifdef LuajitTeX
     /*
         \LUATEX\ has its own memory allocator, \LUAJIITEX\ uses the standard one
@@ -109,6 +156,9 @@ static void *my_luaalloc(void *ud, void *ptr, size_t osize, size_t nsize)
     void *ret = NULL;
     /*tex define |ud| for -Wunused */
     (void) ud;
+    /*tex For a new block |osize| is the object type, not a size. */
+    if (ptr == NULL)
+        osize = 0;
     if (nsize == 0)
         free(ptr);
     else
@@ -116,6 +166,149 @@ static void *my_luaalloc(void *ud, void *ptr, size_t osize, size_t nsize)
     luastate_bytes += (int) (nsize - osize);
     return ret;
 }
+
+/*tex
+
+    The \LUA\ heap is dominated by small strings and tables (node properties,
+    font data) and \LUA\ always tells us the size of the block it frees. When
+    \type {--luapool} is given, blocks up to |lua_pool_max| bytes are served
+    from size classes that are carved out of larger slabs and recycled via free
+    lists, so no per block header is needed. Larger blocks go to the system
+    allocator. Slabs are never returned, the state lives as long as the run.
+
+*/
+
+#define lua_pool_slab  65536
+
+#define lua_pool_class(n) ((int) (((n) - 1) / lua_pool_step))
+
+static char *lua_pool_ptr = NULL;
+static char *lua_pool_end = NULL;
+
+static void *lua_pool_get(size_t n)
+{
+    lua_pool_class_info *c;
+    void *p;
+    if (n > lua_pool_max) {
+        return malloc(n);
+    }
+    c = &lua_pool_classes[lua_pool_class(n)];
+    p = c->free;
+    if (p != NULL) {
+        c->free = *((void **) p);
+        c->available--;
+    } else {
+        size_t s = (size_t) (lua_pool_class(n) + 1) * lua_pool_step;
+        if (lua_pool_ptr == NULL || lua_pool_ptr + s > lua_pool_end) {
+            lua_pool_ptr = malloc(lua_pool_slab);
+            if (lua_pool_ptr == NULL) {
+                lua_pool_end = NULL;
+                return NULL;
+            }
+            lua_pool_end = lua_pool_ptr + lua_pool_slab;
+            lua_pool_slab_bytes += lua_pool_slab;
+        }
+        p = lua_pool_ptr;
+        lua_pool_ptr += s;
+    }
+    c->used++;
+    return p;
+}
+
+static void lua_pool_put(void *p, size_t n)
+{
+    lua_pool_class_info *c;
+    if (n > lua_pool_max) {
+        free(p);
+        return;
+    }
+    c = &lua_pool_classes[lua_pool_class(n)];
+    *((void **) p) = c->free;
+    c->free = p;
+    c->used--;
+    c->available++;
+}
+
+/*tex
+
+    \LUA\ assumes that shrinking a block never fails. When no block of the
+    smaller class can be had we keep the old one, but then the size that \LUA\
+    passes later no longer tells where the block came from. Such blocks are
+    remembered here with their real size, which is used when they are resized
+    or released. This only happens when memory runs out, so the list is short
+    and normally empty.
+
+*/
+
+#define lua_pool_strays_size 64
+
+typedef struct lua_pool_stray {
+    void *ptr;
+    size_t size;
+} lua_pool_stray;
+
+static lua_pool_stray lua_pool_strays[lua_pool_strays_size];
+static int lua_pool_nofstrays = 0;
+
+static size_t lua_pool_unstray(void *p, size_t n)
+{
+    int i;
+    for (i = 0; i < lua_pool_nofstrays; i++) {
+        if (lua_pool_strays[i].ptr == p) {
+            n = lua_pool_strays[i].size;
+            lua_pool_strays[i] = lua_pool_strays[--lua_pool_nofstrays];
+            break;
+        }
+    }
+    return n;
+}
+
+static void *my_luapoolalloc(void *ud, void *ptr, size_t osize, size_t nsize)
+{
+    void *ret = NULL;
+    /*tex The size as \LUA\ sees it, which is what we report. */
+    size_t lsize;
+    (void) ud;
+    if (ptr == NULL) {
+        osize = 0;
+    }
+    lsize = osize;
+    if (ptr != NULL && lua_pool_nofstrays > 0) {
+        osize = lua_pool_unstray(ptr, osize);
+    }
+    if (nsize == 0) {
+        if (ptr != NULL) {
+            lua_pool_put(ptr, osize);
+        }
+    } else if (ptr == NULL) {
+        ret = lua_pool_get(nsize);
+    } else if (osize > lua_pool_max && nsize > lua_pool_max) {
+        ret = realloc(ptr, nsize);
+    } else if (osize <= lua_pool_max && nsize <= lua_pool_max && lua_pool_class(osize) == lua_pool_class(nsize)) {
+        ret = ptr;
+    } else {
+        ret = lua_pool_get(nsize);
+        if (ret != NULL) {
+            memcpy(ret, ptr, osize < nsize ? osize : nsize);
+            lua_pool_put(ptr, osize);
+        } else if (nsize < osize && lua_pool_nofstrays < lua_pool_strays_size) {
+            /*tex The old block is large enough, see above. */
+            lua_pool_strays[lua_pool_nofstrays].ptr = ptr;
+            lua_pool_strays[lua_pool_nofstrays].size = osize;
+            lua_pool_nofstrays++;
+            ret = ptr;
+        }
+    }
+    if (ret != NULL || nsize == 0) {
+        luastate_bytes += (int) (nsize - lsize);
+    } else if (ptr != NULL && osize != lsize) {
+        /*tex The block stays where it was, so we keep remembering it. */
+        lua_pool_strays[lua_pool_nofstrays].ptr = ptr;
+        lua_pool_strays[lua_pool_nofstrays].size = osize;
+        lua_pool_nofstrays++;
+    }
+    return ret;
+}
 #endif
 
 static int my_luapanic(lua_State * L)
@@ -126,30 +319,44 @@ static int my_luapanic(lua_State * L)
     return 0;
 }
 
+/*tex
+
+    This calls the function that sits below its |n| arguments on the stack, with
+    a traceback handler, and reports an error when there is one. The function
+    and arguments are popped.
+
+*/
+
+static void luacall_traced(int n, int *count)
+{
+    int i;
+    /*tex function index */
+    int base = lua_gettop(Luas) - n;
+    lua_checkstack(Luas, 1);
+    /*tex push traceback function */
+    lua_pushcfunction(Luas, lua_traceback);
+    /*tex put it under chunk  */
+    lua_insert(Luas, base);
+    ++*count;
+    i = lua_pcall(Luas, n, 0, base);
+    /*tex remove traceback function */
+    lua_remove(Luas, base);
+    if (i != 0) {
+        lua_gc(Luas, LUA_GCCOLLECT, 0);
+        Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
+    }
+}
+
 void luafunctioncall(int slot)
 {
-    int i ;
     int stacktop = lua_gettop(Luas);
     lua_active++;
     lua_rawgeti(Luas, LUA_REGISTRYINDEX, lua_key_index(lua_functions));
     lua_gettable(Luas, LUA_REGISTRYINDEX);
     lua_rawgeti(Luas, -1,slot);
     if (lua_isfunction(Luas,-1)) {
-        /*tex function index */
-        int base = lua_gettop(Luas);
         lua_pushinteger(Luas, slot);
-        /* push traceback function */
-        lua_pushcfunction(Luas, lua_traceback);
-        /*tex put it under chunk  */
-        lua_insert(Luas, base);
-        ++function_callback_count;
-        i = lua_pcall(Luas, 1, 0, base);
-        /*tex remove traceback function */
-        lua_remove(Luas, base);
-        if (i != 0) {
-            lua_gc(Luas, LUA_GCCOLLECT, 0);
-            Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-        }
+        luacall_traced(1, &function_callback_count);
     }
     lua_settop(Luas,stacktop);
     lua_active--;
@@ -294,7 +501,7 @@ void luainterpreter(void)
     }
     L = luaL_newstate() ;
 #else
-    L = lua_newstate(my_luaalloc, NULL);
+    L = lua_newstate(luapool_option ? my_luapoolalloc : my_luaalloc, NULL);
 #endif
     if (L == NULL) {
         fprintf(stderr, "Can't create the Lua state.\n");
@@ -441,6 +648,208 @@ int lua_traceback(lua_State * L)
     return 1;
 }
 
+/*tex
+
+    Macros often expand the same \.{\\directlua} or \.{\\latelua} chunk over
+    and over again. Compiled chunks are therefore kept in a small direct mapped
+    cache that is keyed by the tokens themselves, so that a hit needs neither the
+    conversion to a string nor the Lua parser. Only lists of plain character
+    tokens qualify: the string made from a control sequence depends on the
+    escape character and catcodes at the moment of the call. The chunk name is
+    part of the key.
+
+    A hit runs the same compiled function again, so the prototypes of functions
+    defined in the chunk are shared between calls. \LUA\ caches closures per
+    prototype, which means that a function that has no upvalues other than
+    \type {_ENV} can be the same object in successive calls, where recompiling
+    the chunk would give a new one each time. This is documented in the manual.
+
+*/
+
+#define lua_chunk_cache_size 256
+#define lua_chunk_cache_max  8192
+
+typedef struct lua_chunk_entry {
+    unsigned hash;
+    int size;
+    int *tokens;
+    char *name;
+    int ref;
+} lua_chunk_entry;
+
+static lua_chunk_entry lua_chunk_cache[lua_chunk_cache_size] = { { 0, 0, NULL, NULL, 0 } };
+
+int lua_chunk_cache_hits = 0;
+int lua_chunk_cache_misses = 0;
+
+static boolean lua_chunk_token(int t)
+{
+    if (t < 0 || t >= cs_token_flag) {
+        return false;
+    }
+    switch (token_cmd(t)) {
+        case left_brace_cmd:
+        case right_brace_cmd:
+        case math_shift_cmd:
+        case tab_mark_cmd:
+        case sup_mark_cmd:
+        case sub_mark_cmd:
+        case spacer_cmd:
+        case letter_cmd:
+        case other_char_cmd:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*tex
+
+    The key is the list of name tokens (when given) followed by a separator and
+    the chunk tokens. We return the number of tokens, zero for an empty chunk,
+    or -1 when the lists can't be cached.
+
+*/
+
+static int lua_chunk_key(int p, int nameptr, unsigned *hash)
+{
+    unsigned h = 2166136261U;
+    int n = 0;
+    int q;
+    if (token_link(p) == null) {
+        return 0;
+    }
+    if (nameptr > 0) {
+        for (q = token_link(nameptr); q != null; q = token_link(q)) {
+            if (! lua_chunk_token(token_info(q))) {
+                return -1;
+            }
+            h = (h ^ (unsigned) token_info(q)) * 16777619U;
+            n++;
+        }
+    }
+    h = (h ^ 0xFFFFFFFFU) * 16777619U;
+    n++;
+    for (q = token_link(p); q != null; q = token_link(q)) {
+        if (! lua_chunk_token(token_info(q))) {
+            return -1;
+        } else if (n > lua_chunk_cache_max) {
+            return -1;
+        }
+        h = (h ^ (unsigned) token_info(q)) * 16777619U;
+        n++;
+    }
+    *hash = h;
+    return n;
+}
+
+static boolean lua_chunk_match(lua_chunk_entry *e, int p, int nameptr)
+{
+    int n = 0;
+    int q;
+    if (nameptr > 0) {
+        for (q = token_link(nameptr); q != null; q = token_link(q)) {
+            if (e->tokens[n++] != token_info(q)) {
+                return false;
+            }
+        }
+    }
+    if (e->tokens[n++] != -1) {
+        return false;
+    }
+    for (q = token_link(p); q != null; q = token_link(q)) {
+        if (e->tokens[n++] != token_info(q)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void lua_chunk_store(lua_chunk_entry *e, int p, int nameptr, const char *name, unsigned h, int size)
+{
+    int n = 0;
+    int q;
+    if (e->ref != 0) {
+        luaL_unref(Luas, LUA_REGISTRYINDEX, e->ref);
+    }
+    xfree(e->tokens);
+    xfree(e->name);
+    e->tokens = xmalloc((unsigned) size * sizeof(int));
+    if (nameptr > 0) {
+        for (q = token_link(nameptr); q != null; q = token_link(q)) {
+            e->tokens[n++] = token_info(q);
+        }
+    }
+    e->tokens[n++] = -1;
+    for (q = token_link(p); q != null; q = token_link(q)) {
+        e->tokens[n++] = token_info(q);
+    }
+    e->name = (name == NULL ? NULL : xstrdup(name));
+    e->hash = h;
+    e->size = size;
+    /*tex The function is on top of the stack, we keep it there. */
+    lua_pushvalue(Luas, -1);
+    e->ref = luaL_ref(Luas, LUA_REGISTRYINDEX);
+}
+
+/*tex
+
+    This pushes the compiled chunk and returns |true|, or returns |false| when
+    there is nothing to run. Syntax errors are reported here.
+
+*/
+
+static boolean lua_load_chunk(int p, int nameptr, const char *dflt)
+{
+    LoadS ls;
+    int i;
+    int l = 0;
+    unsigned h = 0;
+    const char *name = NULL;
+    char *lua_id = NULL;
+    lua_chunk_entry *e = NULL;
+    int size = lua_chunk_key(p, nameptr, &h);
+    if (nameptr < 0) {
+        name = get_lua_name((nameptr + 65536));
+    }
+    if (name == NULL && nameptr <= 0) {
+        name = dflt;
+    }
+    if (size > 0) {
+        e = &lua_chunk_cache[h & (lua_chunk_cache_size - 1)];
+        if (e->ref != 0 && e->hash == h && e->size == size
+            && (e->name == NULL ? name == NULL : (name != NULL && strcmp(e->name, name) == 0))
+            && lua_chunk_match(e, p, nameptr)) {
+            ++lua_chunk_cache_hits;
+            lua_rawgeti(Luas, LUA_REGISTRYINDEX, e->ref);
+            return true;
+        }
+        ++lua_chunk_cache_misses;
+    }
+    ls.s = tokenlist_to_cstring(p, 1, &l);
+    ls.size = (size_t) l;
+    if (ls.size == 0) {
+        xfree(ls.s);
+        return false;
+    }
+    if (nameptr > 0) {
+        lua_id = tokenlist_to_cstring(nameptr, 1, &l);
+        i = Luas_load(Luas, getS, &ls, lua_id);
+        xfree(lua_id);
+    } else {
+        i = Luas_load(Luas, getS, &ls, name);
+    }
+    xfree(ls.s);
+    if (i != 0) {
+        Luas = luatex_error(Luas, (i == LUA_ERRSYNTAX ? 0 : 1));
+        return false;
+    }
+    if (e != NULL) {
+        lua_chunk_store(e, p, nameptr, name, h, size);
+    }
+    return true;
+}
+
 static void luacall(int p, int nameptr, boolean is_string)
 {
     LoadS ls;
@@ -448,43 +857,31 @@ static void luacall(int p, int nameptr, boolean is_string)
     size_t ll = 0;
     char *lua_id;
     char *s = NULL;
+    const char *ss = NULL;
     int stacktop = lua_gettop(Luas);
     if (Luas == NULL) {
         luainterpreter();
     }
     lua_active++;
-    if (is_string) {
-        const char *ss = NULL;
-        lua_rawgeti(Luas, LUA_REGISTRYINDEX, p);
-        if (lua_isfunction(Luas,-1)) {
-            /*tex function index */
-            int base = lua_gettop(Luas);
-            lua_checkstack(Luas, 1);
-            /*tex push traceback function */
-            lua_pushcfunction(Luas, lua_traceback);
-            /*tex put it under chunk  */
-            lua_insert(Luas, base);
-            ++late_callback_count;
-            i = lua_pcall(Luas, 0, 0, base);
-            /*tex remove traceback function */
-            lua_remove(Luas, base);
-            if (i != 0) {
-                lua_gc(Luas, LUA_GCCOLLECT, 0);
-                Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-            }
-            lua_settop(Luas,stacktop);
-            lua_active--;
-            return ;
+    if (! is_string) {
+        if (lua_load_chunk(p, nameptr, "=[\\latelua]")) {
+            luacall_traced(0, &late_callback_count);
         }
-        ss = lua_tolstring(Luas, -1, &ll);
-        s = xmalloc(ll+1);
-        memcpy(s,ss,ll+1);
-        lua_pop(Luas,1);
-    } else {
-        int l = 0;
-        s = tokenlist_to_cstring(p, 1, &l);
-        ll = (size_t)l;
+        lua_settop(Luas,stacktop);
+        lua_active--;
+        return ;
+    }
+    lua_rawgeti(Luas, LUA_REGISTRYINDEX, p);
+    if (lua_isfunction(Luas,-1)) {
+        luacall_traced(0, &late_callback_count);
+        lua_settop(Luas,stacktop);
+        lua_active--;
+        return ;
     }
+    ss = lua_tolstring(Luas, -1, &ll);
+    s = xmalloc(ll+1);
+    memcpy(s,ss,ll+1);
+    lua_pop(Luas,1);
     ls.s = s;
     ls.size = ll;
     if (ls.size > 0) {
@@ -507,21 +904,7 @@ static void luacall(int p, int nameptr, boolean is_string)
         if (i != 0) {
             Luas = luatex_error(Luas, (i == LUA_ERRSYNTAX ? 0 : 1));
         } else {
-            /*tex function index */
-            int base = lua_gettop(Luas);
-            lua_checkstack(Luas, 1);
-            /*tex push traceback function */
-            lua_pushcfunction(Luas, lua_traceback);
-            /*tex put it under chunk  */
-            lua_insert(Luas, base);
-            ++late_callback_count;
-            i = lua_pcall(Luas, 0, 0, base);
-            /*tex remove traceback function */
-            lua_remove(Luas, base);
-            if (i != 0) {
-                lua_gc(Luas, LUA_GCCOLLECT, 0);
-                Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-            }
+            luacall_traced(0, &late_callback_count);
         }
         xfree(ls.s);
     }
@@ -539,23 +922,9 @@ void luacall_vf(int p, int f, int c)
     lua_active++;
     lua_rawgeti(Luas, LUA_REGISTRYINDEX, p);
     if (lua_isfunction(Luas,-1)) {
-        /*tex function index */
-        int base = lua_gettop(Luas);
-        lua_checkstack(Luas, 1);
-        /*tex push traceback function */
-        lua_pushcfunction(Luas, lua_traceback);
-        /*tex put it under chunk  */
-        lua_insert(Luas, base);
         lua_pushinteger(Luas, f);
         lua_pushinteger(Luas, c);
-        ++late_callback_count;
-        i = lua_pcall(Luas, 2, 0, base);
-        /*tex remove traceback function */
-        lua_remove(Luas, base);
-        if (i != 0) {
-            lua_gc(Luas, LUA_GCCOLLECT, 0);
-            Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-        }
+        luacall_traced(2, &late_callback_count);
     } else {
         LoadS ls;
         size_t ll = 0;
@@ -572,17 +941,7 @@ void luacall_vf(int p, int f, int c)
             if (i != 0) {
                 Luas = luatex_error(Luas, (i == LUA_ERRSYNTAX ? 0 : 1));
             } else {
-                int base = lua_gettop(Luas);        /* function index */
-                lua_checkstack(Luas, 1);
-                lua_pushcfunction(Luas, lua_traceback);     /* push traceback function */
-                lua_insert(Luas, base);     /* put it under chunk  */
-                ++late_callback_count;
-                i = lua_pcall(Luas, 0, 0, base);
-                lua_remove(Luas, base);     /* remove traceback function */
-                if (i != 0) {
-                    lua_gc(Luas, LUA_GCCOLLECT, 0);
-                    Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-                }
+                luacall_traced(0, &late_callback_count);
             }
             xfree(ls.s);
         }
@@ -612,51 +971,10 @@ void late_lua(PDF pdf, halfword p)
 
 void luatokencall(int p, int nameptr)
 {
-    LoadS ls;
-    int i;
-    int l = 0;
-    char *s = NULL;
-    char *lua_id;
     int stacktop = lua_gettop(Luas);
     lua_active++;
-    s = tokenlist_to_cstring(p, 1, &l);
-    ls.s = s;
-    ls.size = (size_t) l;
-    if (ls.size > 0) {
-        if (nameptr > 0) {
-            lua_id = tokenlist_to_cstring(nameptr, 1, &l);
-            i = Luas_load(Luas, getS, &ls, lua_id);
-            xfree(lua_id);
-        } else if (nameptr < 0) {
-            lua_id = get_lua_name((nameptr + 65536));
-            if (lua_id != NULL) {
-                i = Luas_load(Luas, getS, &ls, lua_id);
-            } else {
-                i = Luas_load(Luas, getS, &ls, "=[\\directlua]");
-            }
-        } else {
-            i = Luas_load(Luas, getS, &ls, "=[\\directlua]");
-        }
-        xfree(s);
-        if (i != 0) {
-            Luas = luatex_error(Luas, (i == LUA_ERRSYNTAX ? 0 : 1));
-        } else {
-            /*tex function index */
-            int base = lua_gettop(Luas);
-            lua_checkstack(Luas, 1);
-            /*tex push traceback function */
-            lua_pushcfunction(Luas, lua_traceback);
-            /*tex put it under chunk  */
-            lua_insert(Luas, base);
-            ++direct_callback_count;
-            i = lua_pcall(Luas, 0, 0, base);
-            /*tex remove traceback function */
-            lua_remove(Luas, base);
-            if (i != 0) {
-                lua_gc(Luas, LUA_GCCOLLECT, 0);
-                Luas = luatex_error(Luas, (i == LUA_ERRRUN ? 0 : 1));
-            }
-        }
+    if (lua_load_chunk(p, nameptr, "=[\\directlua]")) {
+        luacall_traced(0, &direct_callback_count);
     }
     lua_settop(Luas,stacktop);
     lua_active--;
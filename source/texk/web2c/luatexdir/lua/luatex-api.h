@@ -201,6 +201,39 @@ extern int direct_callback_count;
 extern int late_callback_count;
 extern int function_callback_count;
 
+#define lua_pool_step 8
+#define lua_pool_max 256
+#define lua_pool_classes_size (lua_pool_max / lua_pool_step)
+
+typedef struct lua_pool_class_info {
+    void *free;
+    int used;
+    int available;
+} lua_pool_class_info;
+
+extern lua_pool_class_info lua_pool_classes[];
+extern int lua_pool_slab_bytes;
+
+extern int lua_chunk_cache_hits;
+extern int lua_chunk_cache_misses;
+
+extern int node_userdata_hits;
+extern int node_userdata_misses;
+
+#define lua_gc_point_shipout 1
+#define lua_gc_point_page    2
+#define lua_gc_point_input   4
+#define lua_gc_point_all     7
+
+extern int lua_gc_step_size;
+extern int lua_gc_points;
+extern int lua_gc_steps;
+extern int lua_gc_cycles;
+extern int lua_gc_time;
+extern int lua_gc_max_time;
+
+extern void lua_gc_quiet_point(int point);
+
 extern const char *luatex_banner;
 extern const char *engine_name;
 
@@ -216,6 +249,7 @@ extern void preset_environment(lua_State * L, const parm_struct * p, const char
 extern char *startup_filename;
 extern int safer_option;
 extern int nosocket_option;
+extern int luapool_option;
 extern int utc_option;
 
 extern char *last_source_name;
@@ -541,6 +575,7 @@ make_lua_key(adjust_head);\
 make_lua_key(adjusted_hbox);\
 make_lua_key(adjustspacing);\
 make_lua_key(advance);\
+make_lua_key(after);\
 make_lua_key(after_assignment);\
 make_lua_key(after_display);\
 make_lua_key(after_group);\
@@ -577,6 +612,7 @@ make_lua_key(attributes);\
 make_lua_key(automatic);\
 make_lua_key(baselineskip);\
 make_lua_key(bbox);\
+make_lua_key(before);\
 make_lua_key(before_display);\
 make_lua_key(beforedisplaypenalty);\
 make_lua_key(begin_group);\
@@ -846,6 +882,7 @@ make_lua_key(log);\
 make_lua_key(long_call);\
 make_lua_key(long_outer_call);\
 make_lua_key(looseness);\
+make_lua_key(lookups);\
 make_lua_key(LTL);\
 make_lua_key(lua);\
 make_lua_key(lua_bytecode_call);\
@@ -1078,6 +1115,8 @@ make_lua_key(set_prev_graf);\
 make_lua_key(set_tex_shape);\
 make_lua_key(shape);\
 make_lua_key(shape_ref);\
+make_lua_key(shaping);\
+make_lua_key(shared);\
 make_lua_key(shift);\
 make_lua_key(shorthand_def);\
 make_lua_key(shrink);\
@@ -1245,6 +1284,7 @@ init_lua_key(adjust_head);\
 init_lua_key(adjusted_hbox);\
 init_lua_key(adjustspacing);\
 init_lua_key(advance);\
+init_lua_key(after);\
 init_lua_key(after_assignment);\
 init_lua_key(after_display);\
 init_lua_key(after_group);\
@@ -1281,6 +1321,7 @@ init_lua_key(attributes);\
 init_lua_key(automatic);\
 init_lua_key(baselineskip);\
 init_lua_key(bbox);\
+init_lua_key(before);\
 init_lua_key(before_display);\
 init_lua_key(beforedisplaypenalty);\
 init_lua_key(begin_group);\
@@ -1549,6 +1590,7 @@ init_lua_key(log);\
 init_lua_key(long_call);\
 init_lua_key(long_outer_call);\
 init_lua_key(looseness);\
+init_lua_key(lookups);\
 init_lua_key(LTL);\
 init_lua_key(lua);\
 init_lua_key(lua_bytecode_call);\
@@ -1769,6 +1811,8 @@ init_lua_key(set_prev_graf);\
 init_lua_key(set_tex_shape);\
 init_lua_key(shape);\
 init_lua_key(shape_ref);\
+init_lua_key(shaping);\
+init_lua_key(shared);\
 init_lua_key(shift);\
 init_lua_key(shorthand_def);\
 init_lua_key(shrink);\
@@ -1998,6 +2042,7 @@ use_lua_key(adjust_head);
 use_lua_key(adjusted_hbox);
 use_lua_key(adjustspacing);
 use_lua_key(advance);
+use_lua_key(after);
 use_lua_key(after_assignment);
 use_lua_key(after_display);
 use_lua_key(after_group);
@@ -2034,6 +2079,7 @@ use_lua_key(attributes);
 use_lua_key(automatic);
 use_lua_key(baselineskip);
 use_lua_key(bbox);
+use_lua_key(before);
 use_lua_key(before_display);
 use_lua_key(beforedisplaypenalty);
 use_lua_key(begin_group);
@@ -2303,6 +2349,7 @@ use_lua_key(log);
 use_lua_key(long_call);
 use_lua_key(long_outer_call);
 use_lua_key(looseness);
+use_lua_key(lookups);
 use_lua_key(LTL);
 use_lua_key(lua);
 use_lua_key(lua_bytecode_call);
@@ -2535,6 +2582,8 @@ use_lua_key(set_prev_graf);
 use_lua_key(set_tex_shape);
 use_lua_key(shape);
 use_lua_key(shape_ref);
+use_lua_key(shaping);
+use_lua_key(shared);
 use_lua_key(shift);
 use_lua_key(shorthand_def);
 use_lua_key(shrink);
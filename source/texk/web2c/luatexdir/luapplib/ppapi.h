@@ -150,8 +150,13 @@ struct ppref {
   size_t offset;
   size_t length;
   ppxref *xref;
+  int flags;
 };
 
+#define PPREF_LAZY (1<<0)       // not loaded yet, ppref_obj() loads on demand
+#define PPREF_COMPRESSED (1<<1) // stored in object stream, parent objstm number kept as length until loaded
+#define PPREF_OBJSTM (1<<2)     // object stream already unpacked
+
 typedef struct ppdoc ppdoc;
 
 /* object */
@@ -308,12 +313,17 @@ PPAPI uint8_t * ppstream_next (ppstream *stream, size_t *size);
 PPAPI uint8_t * ppstream_all (ppstream *stream, size_t *size, int decode);
 PPAPI void ppstream_done (ppstream *stream);
 
+typedef void (*ppstream_batch_callback) (ppstream *stream, size_t index, uint8_t *data, size_t size, void *alien);
+PPAPI size_t ppstream_batch (ppstream **streams, size_t count, int decode, int threads, ppstream_batch_callback callback, void *alien);
+
 PPAPI void ppstream_init_buffers (void);
 PPAPI void ppstream_free_buffers (void);
 
 /* ref */
 
-#define ppref_obj(ref) (&(ref)->object)
+PPAPI ppobj * ppref_load (ppref *ref);
+
+#define ppref_obj(ref) (((ref)->flags & PPREF_LAZY) ? ppref_load(ref) : &(ref)->object)
 
 /* xref */
 
@@ -329,6 +339,7 @@ PPAPI ppref * ppxref_find (ppxref *xref, ppuint refnumber);
 
 PPAPI ppdoc * ppdoc_load (const char *filename);
 PPAPI ppdoc * ppdoc_mem (const void *data, size_t size);
+PPAPI int ppdoc_lazy (int lazy);
 PPAPI void ppdoc_free (ppdoc *pdf);
 
 #define ppdoc_trailer(pdf) ppxref_trailer(ppdoc_xref(pdf))
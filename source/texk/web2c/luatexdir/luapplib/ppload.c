@@ -1497,6 +1497,7 @@ static ppxref * ppxref_load_table (iof *I, ppdoc *pdf, size_t xrefoffset)
           ref->object.type = PPNONE; // init for sanity
           ref->object.any = NULL;
           ref->length = 0;
+          ref->flags = (pdf->flags & PPDOC_LAZY) ? PPREF_LAZY : 0;
           break;
         case 'f':
         default:
@@ -1641,6 +1642,7 @@ static ppxref * ppxref_load_stream (iof *I, ppdoc *pdf, size_t xrefoffset)
           ref->object.type = PPNONE;
           ref->object.any = NULL;
           ref->length = 0;
+          ref->flags = (pdf->flags & PPDOC_LAZY) ? PPREF_LAZY : 0;
           break;
         case 2:
           if (xrefsection == NULL)
@@ -1650,11 +1652,12 @@ static ppxref * ppxref_load_stream (iof *I, ppdoc *pdf, size_t xrefoffset)
             xrefsection->refs = ref;
           }
           xrefsection->last = ref->number;
-          ref->offset = 0; // f2 is parent objstm, f3 is index in parent, both useless
+          ref->offset = 0; // f2 is parent objstm, f3 is index in parent, the later useless
           ref->version = 0; // compressed objects has implicit version == 0
           ref->object.type = PPNONE;
           ref->object.any = NULL;
-          ref->length = 0;
+          ref->length = f2; // parent objstm, needed only when loading lazily
+          ref->flags = (pdf->flags & PPDOC_LAZY) ? PPREF_LAZY|PPREF_COMPRESSED : PPREF_COMPRESSED;
           break;
         default:
           goto xref_stream_error;
@@ -1934,6 +1937,7 @@ ppobj * ppdoc_load_entry (ppdoc *pdf, ppref *ref)
   ppref *refref;
   ppuint refnumber, refversion;
 
+  ref->flags &= ~PPREF_LAZY; // preloaded refs are never loaded again
   length = ref->length > 0 ? ref->length : PP_LENGTH_UNKNOWN; // estimated or unknown
   if ((I = ppdoc_reader(pdf, ref->offset, length)) == NULL || !ppscan_start_entry(I, ref))
   {
@@ -2020,8 +2024,9 @@ static int ppdoc_load_objstm (ppstream *stream, ppdoc *pdf, ppxref *xref)
     ppscan_find(I);
     if (!ppscan_uint(I, &offset))
       goto invalid_objstm;
-    if ((ref = ppxref_find_local(xref, objnum)) == NULL || ref->object.type != PPNONE)
-    {
+    if ((ref = ppxref_find_local(xref, objnum)) == NULL || ref->object.type != PPNONE || (ref->flags & (PPREF_LAZY|PPREF_COMPRESSED)) == PPREF_LAZY)
+    { // the last condition for lazy mode, where uncompressed refs are PPNONE until accessed
+
       loggerf("invalid compressed object number " PPUINTF " at position " PPUINTF, objnum, i);
       ++invalid;
       continue;
@@ -2038,6 +2043,7 @@ static int ppdoc_load_objstm (ppstream *stream, ppdoc *pdf, ppxref *xref)
     if ((obj = ppscan_obj(I, pdf, xref)) != NULL)
     {
       ref->object = *obj;
+      ref->flags &= ~PPREF_LAZY;
       ppstack_pop(stack, 1);
       // nothing more needed, as obj can never be indirect ref or stream
     }
@@ -2055,6 +2061,83 @@ invalid_objstm:
   return 0;
 }
 
+/* Lazy loading
+
+With ppdoc_lazy(1) set before ppdoc_load() or ppdoc_mem(), only the header, xrefs and trailers are read.
+ppdoc_load_entries() is not called; instead all refs are flagged PPREF_LAZY and ppref_obj() loads an object
+on first access. For compressed entries xref stream loader keeps the parent object stream number as
+ref->length, and the whole object stream is unpacked at once. Crypt context is saved and restored, as
+loading may be triggered in the middle of other object processing (eg. stream /Length reference
+accessed by ppstream_info()). Loading sorted by offsets and linearized dict check are irrelevant here,
+references are resolved against the top xref anyway (see ppxref_find() notes).
+*/
+
+static int ppdoc_lazy_mode = 0;
+
+int ppdoc_lazy (int lazy)
+{
+  int previous = ppdoc_lazy_mode;
+  ppdoc_lazy_mode = lazy;
+  return previous;
+}
+
+#define ppcrypt_restore_ref(crypt, r) ((r) != NULL ? ppcrypt_start_ref(crypt, r) : ppcrypt_end_ref(crypt))
+
+ppobj * ppref_load (ppref *ref)
+{
+  ppdoc *pdf;
+  ppcrypt *crypt;
+  ppref *cryptref, *objstmref, *target;
+  ppobj *obj;
+  ppname type;
+
+  pdf = ref->xref->pdf;
+  if (pdf->cryptstatus != PPCRYPT_NONE && pdf->cryptstatus != PPCRYPT_DONE)
+    return &ref->object; // PPNONE, as with eager loading; password needed first (or hopeless)
+  ref->flags &= ~PPREF_LAZY; // first, so that insane loops end here
+  crypt = pdf->crypt;
+  cryptref = crypt != NULL ? crypt->ref : NULL;
+  if (ref->flags & PPREF_COMPRESSED)
+  {
+    if ((objstmref = ppxref_find(ref->xref, (ppuint)ref->length)) == NULL || (objstmref->flags & PPREF_OBJSTM))
+      return &ref->object; // not found in parent objstm
+    obj = ppref_obj(objstmref);
+    objstmref->flags |= PPREF_OBJSTM;
+    if (obj->type != PPSTREAM || !ppref_is_objstm(objstmref, obj->stream, type))
+    {
+      loggerf("invalid objects stream %s for compressed %s", ppref_str(objstmref->number, objstmref->version), ppref_str(ref->number, ref->version));
+      return &ref->object;
+    }
+    if (crypt != NULL)
+      ppcrypt_end_ref(crypt);
+    if (!ppdoc_load_objstm(obj->stream, pdf, objstmref->xref))
+      loggerf("invalid objects stream %s at offset " PPSIZEF, ppref_str(objstmref->number, objstmref->version), objstmref->offset);
+    if (crypt != NULL)
+      ppcrypt_restore_ref(crypt, cryptref);
+    return &ref->object;
+  }
+  if (ref->offset == 0)
+    return &ref->object;
+  if (crypt != NULL)
+    ppcrypt_start_ref(crypt, ref);
+  obj = ppdoc_load_entry(pdf, ref);
+  if (obj->type == PPREF)
+  { // redundant indirection, cut as ppdoc_load_entries() does
+    target = obj->ref;
+    if (target == ref)
+      obj->type = PPNONE, obj->any = NULL;
+    else
+      *obj = *ppref_obj(target);
+  }
+  else if (obj->type == PPSTREAM)
+  {
+    ppstream_info(obj->stream, pdf); // may load other objects, those restore crypt->ref
+  }
+  if (crypt != NULL)
+    ppcrypt_restore_ref(crypt, cryptref);
+  return obj;
+}
+
 /* main PDF loader proc */
 
 ppcrypt_status ppdoc_crypt_pass (ppdoc *pdf, const void *userpass, size_t userpasslength, const void *ownerpass, size_t ownerpasslength)
@@ -2071,7 +2154,8 @@ ppcrypt_status ppdoc_crypt_pass (ppdoc *pdf, const void *userpass, size_t userpa
       {
         case PPCRYPT_NONE:
         case PPCRYPT_DONE:
-          ppdoc_load_entries(pdf);
+          if ((pdf->flags & PPDOC_LAZY) == 0)
+            ppdoc_load_entries(pdf);
           break;
         case PPCRYPT_PASS: // user needs to check ppdoc_crypt_status() and recall ppdoc_crypt_pass() with the proper password
         case PPCRYPT_FAIL: // hopeless..
@@ -2119,7 +2203,7 @@ static ppdoc * ppdoc_create (iof_file *input)
 
   heap = ppheap_new();
   pdf = (ppdoc *)ppheap_take(&heap, sizeof(ppdoc));
-  pdf->flags = 0;
+  pdf->flags = ppdoc_lazy_mode ? PPDOC_LAZY : 0;
   pdf->heap = heap;
   pdf->xref = NULL;
   pdf->version[0] = '\0';
@@ -2136,12 +2220,9 @@ static ppdoc * ppdoc_create (iof_file *input)
 
 ppdoc * ppdoc_load (const char *filename)
 {
-  FILE *file;
   iof_file input;
-  if ((file = fopen(filename, "rb")) == NULL)
+  if (iof_file_reader_from_mapped_file(&input, filename) == NULL) // data mode on mapped bytes, or FILE * if not mappable
     return NULL;
-  iof_file_init(&input, file);
-  input.flags |= IOF_CLOSE_FILE;
   return ppdoc_create(&input);
 }
 
@@ -2210,7 +2291,7 @@ ppuint ppdoc_page_count (ppdoc *pdf)
   ppuint count;
   if ((ref = ppxref_pages(pdf->xref)) == NULL)
     return 0;
-  if (pppage_node(ref->object.dict, &count, &type) == NULL)
+  if (pppage_node(ppref_obj(ref)->dict, &count, &type) == NULL)
     return ppname_is_page(type) ? 1 : 0; // acrobat and ghostscript accept documents with root /Pages entry being a reference to a sole /Page object
   return count;
 }
@@ -2228,7 +2309,7 @@ ppref * ppdoc_page (ppdoc *pdf, ppuint index)
 
   if ((ref = ppxref_pages(pdf->xref)) == NULL)
     return NULL;
-  dict = ref->object.dict;
+  dict = ppref_obj(ref)->dict;
   if ((kids = pppage_node(dict, &count, &type)) != NULL)
   {
     if (index < 1 || index > count)
@@ -2245,7 +2326,7 @@ scan_array:
     {
       if (r->type != PPREF)
         return NULL;
-      o = &r->ref->object;
+      o = ppref_obj(r->ref);
       if (o->type != PPDICT)
         return NULL;
       dict = o->dict;
@@ -2268,7 +2349,7 @@ scan_array:
     {
       if (r->type != PPREF)
         return NULL;
-      o = &r->ref->object;
+      o = ppref_obj(r->ref);
       if (o->type != PPDICT)
         return NULL;
       dict = o->dict;
@@ -2333,13 +2414,13 @@ static ppref * ppdoc_pages_group_first (ppdoc *pdf, ppref *ref)
   ppuint count;
   ppname type;
 
-  dict = ref->object.dict; // typecheck made by callers
+  dict = ppref_obj(ref)->dict; // typecheck made by callers
   while ((kids = pppage_node(dict, &count, &type)) != NULL)
   {
-    if ((ref = pparray_get_ref(kids, 0)) == NULL || ref->object.type != PPDICT)
+    if ((ref = pparray_get_ref(kids, 0)) == NULL || ppref_obj(ref)->type != PPDICT)
       return NULL;
     pppages_push(pdf, kids);
-    dict = ref->object.dict;
+    dict = ppref_obj(ref)->dict;
   }
   return ppname_is_page(type) ? ref : NULL;
 }
@@ -2372,7 +2453,7 @@ ppref * ppdoc_next_page (ppdoc *pdf)
       if (obj->type != PPREF)
         return NULL;
       ref = obj->ref;
-      if (ref->object.type != PPDICT)
+      if (ppref_obj(ref)->type != PPDICT)
         return NULL;
       return ppdoc_pages_group_first(pdf, ref);
     }
@@ -2420,8 +2501,8 @@ static ppstream * ppcontents_first_stream (pparray *array)
   ppobj *obj;
   ppref *ref;
   for (pparray_first(array, i, obj); i < array->size; pparray_next(i, obj))
-    if ((ref = ppobj_get_ref(obj)) != NULL && ref->object.type == PPSTREAM)
-      return ref->object.stream;
+    if ((ref = ppobj_get_ref(obj)) != NULL && ppref_obj(ref)->type == PPSTREAM)
+      return ppref_obj(ref)->stream;
   return NULL;
 }
 
@@ -2431,9 +2512,9 @@ static ppstream * ppcontents_next_stream (pparray *array, ppstream *stream)
   ppobj *obj;
   ppref *ref;
   for (pparray_first(array, i, obj); i < array->size; pparray_next(i, obj))
-    if ((ref = ppobj_get_ref(obj)) != NULL && ref->object.type == PPSTREAM && ref->object.stream == stream)
-      if (++i < array->size && (ref = ppobj_get_ref(obj + 1)) != NULL && ref->object.type == PPSTREAM)
-        return ref->object.stream;
+    if ((ref = ppobj_get_ref(obj)) != NULL && ppref_obj(ref)->type == PPSTREAM && ppref_obj(ref)->stream == stream)
+      if (++i < array->size && (ref = ppobj_get_ref(obj + 1)) != NULL && ppref_obj(ref)->type == PPSTREAM)
+        return ppref_obj(ref)->stream;
   return NULL;
 }
 
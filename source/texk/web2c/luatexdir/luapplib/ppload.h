@@ -41,6 +41,7 @@ struct ppdoc {
 };
 
 #define PPDOC_LINEARIZED (1 << 0)
+#define PPDOC_LAZY (1 << 1)
 
 ppobj * ppdoc_load_entry (ppdoc *pdf, ppref *ref);
 #define ppobj_preloaded(pdf, obj) ((obj)->type != PPREF ? (obj) : ((obj)->ref->object.type == PPNONE ? ppdoc_load_entry(pdf, (obj)->ref) : &(obj)->ref->object))
@@ -2,6 +2,13 @@
 #include "ppfilter.h"
 #include "pplib.h"
 
+#ifndef _WIN32
+#  include <pthread.h>
+#  include <unistd.h>
+#  include <zlib.h>
+#  define PPSTREAM_THREADS
+#endif
+
 ppstream * ppstream_create (ppdoc *pdf, ppdict *dict, size_t offset)
 {
 	ppstream *stream;
@@ -98,7 +105,26 @@ static iof * ppstream_decoder (ppstream *stream, ppstreamtp filtertype, ppdict *
   return NULL;
 }
 
-#define ppstream_source(stream) iof_filter_stream_coreader((iof_file *)((stream)->input), (size_t)((stream)->offset), (size_t)((stream)->length))
+/*
+If the document is in memory (ppdoc_mem() or a mapped file), the raw stream data is read in place, without
+copying it chunk by chunk into a coreader buffer. Otherwise the coreader seeks and reads the source file.
+*/
+
+static iof * ppstream_source (ppstream *stream)
+{
+  iof_file *input;
+  size_t size;
+  input = (iof_file *)stream->input;
+  if (input->flags & IOF_DATA)
+  {
+    size = (size_t)(input->rend - input->rbuf);
+    if (stream->offset > size)
+      return NULL;
+    return iof_filter_string_reader(input->rbuf + stream->offset, stream->length <= size - stream->offset ? stream->length : size - stream->offset);
+  }
+  return iof_filter_stream_coreader(input, (size_t)stream->offset, (size_t)stream->length);
+}
+
 #define ppstream_auxsource(filename) iof_filter_file_reader(filename)
 
 static ppname ppstream_get_filter_name (ppobj *filterobj, size_t index)
@@ -248,6 +274,245 @@ void ppstream_done (ppstream *stream)
   }
 }
 
+/* Batch reading. Streams are read in the order of offsets, so the source file is read forward (or mapped pages are
+touched once), and handed to the callback with their original index. The data is valid only during the callback.
+Returns the number of streams successfully read. Streams that are already open are skipped.
+
+When decoding, plain Flate streams (no predictor, no encryption) are inflated by worker threads first. iof filters
+and buffers come from process-global heaps that are not thread safe, so workers use zlib directly on the raw bytes
+and plain malloc; the raw bytes are taken on the main thread, in place for in-memory documents. A stream the worker
+cannot finish is read the usual way, so the results are the same. threads is the number of threads including the
+calling one, 0 means one per processor (at most 8). Callbacks are always called from the calling thread. */
+
+typedef struct {
+  ppstream *stream;
+  size_t index;
+#ifdef PPSTREAM_THREADS
+  const uint8_t *raw;
+  uint8_t *copy;
+  size_t rawsize;
+  uint8_t *data;
+  size_t size;
+#endif
+} ppstream_item;
+
+static void ppstream_items_sort (ppstream_item *left, ppstream_item *right)
+{
+  ppstream_item *l, *r, t;
+  size_t offset;
+  l = left, r = right;
+  offset = (l + ((r - l) >> 1))->stream->offset;
+  do {
+    while (l->stream->offset < offset) ++l;
+    while (r->stream->offset > offset) --r;
+    if (l <= r)
+    {
+      t = *l, *l = *r, *r = t;
+      ++l, --r;
+    }
+  } while (l <= r);
+  if (left < r)
+    ppstream_items_sort(left, r);
+  if (l < right)
+    ppstream_items_sort(l, right);
+}
+
+#ifdef PPSTREAM_THREADS
+
+#define PPSTREAM_MAX_THREADS 8
+
+typedef struct {
+  ppstream_item *items;
+  size_t count, next;
+  pthread_mutex_t lock;
+} ppstream_jobs;
+
+static int ppstream_threadable (ppstream *stream)
+{
+  ppdict *params;
+  ppint predictor;
+  if (ppstream_iof(stream) != NULL || stream->filespec != NULL || stream->cryptkey != NULL || (stream->flags & PPSTREAM_ENCRYPTED_OWN))
+    return 0;
+  if (stream->filter.count != 1 || stream->filter.filters[0] != PPSTREAM_FLATE)
+    return 0;
+  params = stream->filter.params != NULL ? stream->filter.params[0] : NULL;
+  return params == NULL || !ppdict_get_int(params, "Predictor", &predictor) || predictor <= 1;
+}
+
+static void ppstream_raw (ppstream_item *item)
+{
+  iof_file *input;
+  const uint8_t *data;
+  size_t size;
+  input = (iof_file *)item->stream->input;
+  if (input->flags & IOF_DATA)
+  {
+    size = (size_t)(input->rend - input->rbuf);
+    if (item->stream->offset > size)
+      return;
+    size -= item->stream->offset;
+    item->raw = input->rbuf + item->stream->offset;
+    item->rawsize = item->stream->length <= size ? item->stream->length : size;
+    return;
+  }
+  if ((data = ppstream_all(item->stream, &size, 0)) != NULL && (item->copy = (uint8_t *)malloc(size > 0 ? size : 1)) != NULL)
+  {
+    memcpy(item->copy, data, size);
+    item->raw = item->copy;
+    item->rawsize = size;
+  }
+  ppstream_done(item->stream);
+}
+
+static void ppstream_inflate (ppstream_item *item)
+{
+  z_stream z;
+  uint8_t *data, *more;
+  size_t size;
+  int status;
+  memset(&z, 0, sizeof(z_stream));
+  if (inflateInit(&z) != Z_OK)
+    return;
+  size = item->rawsize * 4 + 1024;
+  if ((data = (uint8_t *)malloc(size)) == NULL)
+  {
+    inflateEnd(&z);
+    return;
+  }
+  z.next_in = (Bytef *)item->raw;
+  z.avail_in = (uInt)item->rawsize;
+  z.next_out = (Bytef *)data;
+  z.avail_out = (uInt)size;
+  while ((status = inflate(&z, Z_NO_FLUSH)) == Z_OK && z.avail_out == 0)
+  {
+    if ((more = (uint8_t *)realloc(data, size * 2)) == NULL)
+      break;
+    data = more;
+    z.next_out = (Bytef *)(data + size);
+    z.avail_out = (uInt)size;
+    size *= 2;
+  }
+  if (status == Z_STREAM_END)
+  {
+    item->data = data;
+    item->size = (size_t)z.total_out;
+  }
+  else
+  {
+    free(data);
+  }
+  inflateEnd(&z);
+}
+
+static void * ppstream_worker (void *alien)
+{
+  ppstream_jobs *jobs;
+  ppstream_item *item;
+  jobs = (ppstream_jobs *)alien;
+  for (;;)
+  {
+    pthread_mutex_lock(&jobs->lock);
+    item = jobs->next < jobs->count ? &jobs->items[jobs->next++] : NULL;
+    pthread_mutex_unlock(&jobs->lock);
+    if (item == NULL)
+      break;
+    if (item->raw != NULL)
+      ppstream_inflate(item);
+  }
+  return NULL;
+}
+
+static void ppstream_batch_inflate (ppstream_item *items, size_t count, int threads)
+{
+  ppstream_jobs jobs;
+  pthread_t workers[PPSTREAM_MAX_THREADS - 1];
+  size_t i, eligible;
+  int t, started;
+  long cpus;
+  if (threads <= 0)
+  {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus < 1 ? 1 : cpus > PPSTREAM_MAX_THREADS ? PPSTREAM_MAX_THREADS : (int)cpus;
+  }
+  else if (threads > PPSTREAM_MAX_THREADS)
+  {
+    threads = PPSTREAM_MAX_THREADS;
+  }
+  if (threads < 2)
+    return;
+  for (i = 0, eligible = 0; i < count; ++i)
+  {
+    if (ppstream_threadable(items[i].stream))
+    {
+      ppstream_raw(&items[i]);
+      if (items[i].raw != NULL)
+        ++eligible;
+    }
+  }
+  if (eligible < 2)
+    return;
+  if ((size_t)threads > eligible)
+    threads = (int)eligible;
+  jobs.items = items;
+  jobs.count = count;
+  jobs.next = 0;
+  pthread_mutex_init(&jobs.lock, NULL);
+  for (t = 0, started = 0; t < threads - 1; ++t)
+    if (pthread_create(&workers[started], NULL, ppstream_worker, &jobs) == 0)
+      ++started;
+  ppstream_worker(&jobs);
+  for (t = 0; t < started; ++t)
+    pthread_join(workers[t], NULL);
+  pthread_mutex_destroy(&jobs.lock);
+}
+
+#endif
+
+size_t ppstream_batch (ppstream **streams, size_t count, int decode, int threads, ppstream_batch_callback callback, void *alien)
+{
+  ppstream_item *items, *item;
+  uint8_t *data;
+  size_t i, size, done;
+  if (count == 0)
+    return 0;
+  items = (ppstream_item *)pp_malloc(count * sizeof(ppstream_item));
+  memset(items, 0, count * sizeof(ppstream_item));
+  for (i = 0, item = items; i < count; ++i, ++item)
+    item->stream = streams[i], item->index = i;
+  if (count > 1)
+    ppstream_items_sort(items, items + count - 1);
+#ifdef PPSTREAM_THREADS
+  if (decode)
+    ppstream_batch_inflate(items, count, threads);
+#else
+  (void)threads;
+#endif
+  for (i = 0, done = 0, item = items; i < count; ++i, ++item)
+  {
+#ifdef PPSTREAM_THREADS
+    if (item->copy != NULL)
+      free(item->copy);
+    if (item->data != NULL)
+    {
+      callback(item->stream, item->index, item->data, item->size, alien);
+      free(item->data);
+      ++done;
+      continue;
+    }
+#endif
+    if (ppstream_iof(item->stream) != NULL)
+      continue;
+    if ((data = ppstream_all(item->stream, &size, decode)) != NULL)
+    {
+      callback(item->stream, item->index, data, size, alien);
+      ++done;
+    }
+    ppstream_done(item->stream);
+  }
+  pp_free(items);
+  return done;
+}
+
 /* fetching stream info
 PJ20190916: revealed it makes sense to do a lilbit more just after parsing stream entry to simplify stream operations
 and extend ppstream api
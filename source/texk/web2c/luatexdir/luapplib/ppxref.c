@@ -192,5 +192,5 @@ ppref * ppxref_pages (ppxref *xref)
 
   if ((dict = ppxref_catalog(xref)) == NULL || (ref = ppdict_get_ref(dict, "Pages")) == NULL)
     return NULL;
-  return ref->object.type == PPDICT ? ref : NULL;
+  return ppref_obj(ref)->type == PPDICT ? ref : NULL;
 }
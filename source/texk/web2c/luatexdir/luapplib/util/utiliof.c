@@ -4,6 +4,17 @@
 #include <string.h>
 #include <stdarg.h>
 
+#if defined(_WIN32) || defined(WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#  include <io.h>
+#else
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
+
 #include "utilmem.h"
 #include "utillog.h"
 #include "utiliof.h"
@@ -53,6 +64,97 @@ uint8_t * iof_copy_file_handle_data (FILE *file, size_t *psize)
   return data;
 }
 
+/*
+Read-only mapping of the whole file. Returns NULL if the file can't be mapped (empty file, pipe, no mmap),
+in which case the caller should fall back to ordinary reads. The mapping survives fclose(); the file must
+not be truncated as long as the data is in use.
+*/
+
+uint8_t * iof_map_file_handle (FILE *file, size_t *psize)
+{
+#if defined(_WIN32) || defined(WIN32)
+  HANDLE handle, mapping;
+  LARGE_INTEGER size;
+  void *data;
+  handle = (HANDLE)_get_osfhandle(_fileno(file));
+  if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size) || size.QuadPart <= 0 || (uint64_t)size.QuadPart > (uint64_t)SIZE_MAX)
+    return NULL;
+  if ((mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+    return NULL;
+  data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping); // the view keeps the mapping object alive
+  if (data == NULL)
+    return NULL;
+  *psize = (size_t)size.QuadPart;
+  return (uint8_t *)data;
+#else
+  struct stat st;
+  void *data;
+  if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || (uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+    return NULL;
+  if ((data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0)) == MAP_FAILED)
+    return NULL;
+  *psize = (size_t)st.st_size;
+  return (uint8_t *)data;
+#endif
+}
+
+/*
+Read-only mapping of length bytes at offset. The mapping has to start at a page (allocation granularity) boundary,
+so the start and size of what is actually mapped are returned in pmap and pmapsize, to be passed to iof_unmap_data().
+Returns NULL if the range is not within the file or can't be mapped.
+*/
+
+uint8_t * iof_map_file_range (FILE *file, size_t offset, size_t length, void **pmap, size_t *pmapsize)
+{
+#if defined(_WIN32) || defined(WIN32)
+  HANDLE handle, mapping;
+  LARGE_INTEGER size;
+  SYSTEM_INFO info;
+  uint64_t start;
+  void *data;
+  handle = (HANDLE)_get_osfhandle(_fileno(file));
+  if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size) || length == 0 || (uint64_t)offset + length > (uint64_t)size.QuadPart)
+    return NULL;
+  GetSystemInfo(&info);
+  start = (uint64_t)offset - (uint64_t)offset % info.dwAllocationGranularity;
+  if ((mapping = CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+    return NULL;
+  data = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)(start & 0xFFFFFFFF), (SIZE_T)(offset - start + length));
+  CloseHandle(mapping);
+  if (data == NULL)
+    return NULL;
+  *pmap = data;
+  *pmapsize = (size_t)(offset - start + length);
+  return (uint8_t *)data + (offset - start);
+#else
+  struct stat st;
+  size_t start;
+  long page;
+  void *data;
+  if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || length == 0 || (uint64_t)offset + length > (uint64_t)st.st_size)
+    return NULL;
+  if ((page = sysconf(_SC_PAGESIZE)) <= 0)
+    return NULL;
+  start = offset - offset % (size_t)page;
+  if ((data = mmap(NULL, offset - start + length, PROT_READ, MAP_PRIVATE, fileno(file), (off_t)start)) == MAP_FAILED)
+    return NULL;
+  *pmap = data;
+  *pmapsize = offset - start + length;
+  return (uint8_t *)data + (offset - start);
+#endif
+}
+
+void iof_unmap_data (const void *data, size_t size)
+{
+#if defined(_WIN32) || defined(WIN32)
+  (void)size;
+  UnmapViewOfFile(data);
+#else
+  munmap((void *)data, size);
+#endif
+}
+
 FILE * iof_get_file (iof *F)
 {
   if (F->flags & IOF_FILE)
@@ -215,6 +317,27 @@ iof_file * iof_file_reader_from_data (iof_file *iofile, const void *data, size_t
   return iofile;
 }
 
+/* data reader working directly on mapped file bytes; falls back to FILE * reader if mapping fails */
+
+iof_file * iof_file_reader_from_mapped_file (iof_file *iofile, const char *filename)
+{
+  FILE *file;
+  uint8_t *data;
+  size_t size;
+  if ((file = fopen(filename, "rb")) == NULL)
+    return NULL;
+  if ((data = iof_map_file_handle(file, &size)) == NULL)
+    return iof_file_reader_from_file_handle(iofile, filename, file, 0, 1);
+  fclose(file);
+  if (iofile == NULL)
+    iofile = iof_file_rdata(data, size);
+  else
+    iof_file_rdata_init(iofile, data, size);
+  iofile->flags |= IOF_BUFFER_MAPPED;
+  iof_file_set_name(iofile, filename);
+  return iofile;
+}
+
 /*
 iof_file * iof_file_writer_from_file (iof_file *iofile, const char *filename)
 {
@@ -286,6 +409,15 @@ void iof_file_free (iof_file *iofile)
         iofile->buf = iofile->pos = iofile->end = NULL;
       }
     }
+    else if (iofile->flags & IOF_BUFFER_MAPPED)
+    {
+      iofile->flags &= ~IOF_BUFFER_MAPPED;
+      if (iofile->buf != NULL)
+      {
+        iof_unmap_data(iofile->buf, (size_t)(iofile->end - iofile->buf));
+        iofile->buf = iofile->pos = iofile->end = NULL;
+      }
+    }
   }
   else if ((file = iof_file_get_fh(iofile)) != NULL)
   {
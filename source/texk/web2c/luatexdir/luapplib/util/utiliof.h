@@ -110,7 +110,9 @@ typedef void (*iof_dump_function) (const void *value, iof *O);
 
 #define IOF_STOPPED        (1<<16) // stopped
 
-// #define IOF_CUSTOM         (1<<17) // first custom flag
+#define IOF_BUFFER_MAPPED  (1<<17) // buffer mapped from file
+
+// #define IOF_CUSTOM         (1<<18) // first custom flag
 
 #define IOF_BUFSIZ (sizeof(iof) + BUFSIZ*sizeof(uint8_t))
 
@@ -245,9 +247,13 @@ iof_file * iof_file_wdata_init (iof_file *iofile, void *data, size_t size);
 iof_file * iof_file_reader_from_file_handle (iof_file *iofile, const char *filename, FILE *file, int preload, int closefile);
 iof_file * iof_file_reader_from_file (iof_file *iofile, const char *filename, int preload);
 iof_file * iof_file_reader_from_data (iof_file *iofile, const void *data, size_t size, int preload, int freedata);
+iof_file * iof_file_reader_from_mapped_file (iof_file *iofile, const char *filename);
 //iof_file * iof_file_writer_from_file (iof_file *iofile, const char *filename);
 
 void * iof_copy_data (const void *data, size_t size);
+uint8_t * iof_map_file_handle (FILE *file, size_t *psize);
+uint8_t * iof_map_file_range (FILE *file, size_t offset, size_t length, void **pmap, size_t *pmapsize);
+void iof_unmap_data (const void *data, size_t size);
 #define iof_data_free(data) util_free(data)
 #define iof_file_wdata_copy(data, size) iof_file_wdata(iof_copy_data(data, size), size)
 #define iof_file_rdata_copy(data, size) iof_file_rdata(iof_copy_data(data, size), size)
@@ -90,6 +90,7 @@ extern int lua_active;
 extern int debug_callback_defined(int i);
 
 extern int run_callback(int i, const char *values, ...);
+extern boolean get_callback(lua_State * L, int i);
 extern int run_saved_callback(int i, const char *name, const char *values, ...);
 extern int run_and_save_callback(int i, const char *values, ...);
 extern void destroy_saved_callback(int i);
@@ -2426,6 +2426,7 @@ void pdf_finish_file(PDF pdf, int fatal_error) {
                 }
                 libpdffinish(pdf);
                 close_file(pdf->file);
+                pdf_save_resource_pack();
             } else {
                 if (callback_id > 0) {
                     run_callback(callback_id, "->");
@@ -2450,6 +2451,10 @@ void pdf_finish_file(PDF pdf, int fatal_error) {
                 fprintf(log_file, " %d words of extra memory for PDF output out of %d (max. %d)\n",
                     (int) pdf->mem_ptr, (int) pdf->mem_size,
                     (int) sup_pdf_mem_size);
+                if (resource_pack_hits > 0 || resource_pack_added > 0) {
+                    fprintf(log_file, " %d shared objects taken from the resource pack, %d added\n",
+                        resource_pack_hits, resource_pack_added);
+                }
             }
         }
     }
@@ -21,6 +21,866 @@ with LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 
 #include "ptexlib.h"
 #include "lua/luatex-api.h"
+#include "luapplib/util/utilsha.h"
+#include <stdint.h>
+
+/*tex
+
+    Objects can be marked as shared. When a resource pack is set with |pdf.setresourcepack|
+    a shared object is written from an entry in that pack: the (compressed) stream or
+    object body with the references to other shared objects taken out. An entry is
+    identified by a hash of its content, its compression level and the entries that
+    it refers to, so when a later job produces the same object the stored bytes are
+    used and the stream is not compressed again. A shared object that has a name
+    can be fetched by a later job with |pdf.getsharedobj| without generating it at
+    all; the entries it depends on then get fresh object numbers in this job. The
+    pack is saved at the end of the job when something has been added. Entries are
+    found by hash and by name through two small open addressing tables. Every
+    entry remembers the last save of the pack in which a job used it; when none
+    of the last |PACK_KEEP| saves did, it is dropped, unless a kept entry still
+    refers to it.
+
+    An object that refers to an object that is not shared is written as usual, as
+    is every shared object when there is no pack.
+
+*/
+
+#define PACK_STREAM   (1 << 0)
+#define PACK_DEFLATED (1 << 1)
+
+#define PACK_IN_ATTR 0
+#define PACK_IN_DATA 1
+
+#define PACK_MAGIC "LuaTeX resource pack 3\n"
+
+#define PACK_KEEP 16
+
+#define PACK_HASH_INIT UINT64_C(14695981039346656037)
+
+#define PACK_FREE    -1
+#define PACK_DELETED -2
+
+typedef struct pack_ref {
+    int where;
+    int offset;
+    int entry;
+} pack_ref;
+
+typedef struct pack_entry {
+    uint64_t hash;
+    int flags;
+    char *name;
+    char *attr;
+    int attr_l;
+    char *data;
+    int data_l;
+    int nrefs;
+    pack_ref *refs;
+    /*tex The length and digest of the data before it was deflated: */
+    int raw_l;
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    /*tex The last save of the pack in which the entry was used: */
+    int used;
+    /*tex The object number in this job, zero when not used yet: */
+    int objnum;
+} pack_entry;
+
+typedef struct pack_index {
+    int *slots;
+    int size;
+    int used;
+} pack_index;
+
+typedef struct resource_pack_s {
+    char *file_name;
+    pack_entry *entries;
+    int count;
+    int size;
+    /*tex The number of times the pack has been saved: */
+    int saves;
+    pack_index hashes;
+    pack_index names;
+    boolean changed;
+} resource_pack_s;
+
+static resource_pack_s resource_pack = { NULL, NULL, 0, 0, 0, { NULL, 0, 0 }, { NULL, 0, 0 }, false };
+
+int resource_pack_hits = 0;
+int resource_pack_added = 0;
+
+static uint64_t pack_hash(uint64_t h, const void *p, size_t l)
+{
+    const unsigned char *s = (const unsigned char *) p;
+    size_t i;
+    for (i = 0; i < l; i++) {
+        h ^= s[i];
+        h *= UINT64_C(1099511628211);
+    }
+    return h;
+}
+
+/*tex
+
+    A slot in an index has an entry, or is free or deleted. There is always a free
+    slot, so probing stops.
+
+*/
+
+static uint64_t pack_key(int e, boolean by_name)
+{
+    pack_entry *p = &resource_pack.entries[e];
+    return by_name ? pack_hash(PACK_HASH_INIT, p->name, strlen(p->name)) : p->hash;
+}
+
+static void pack_index_put(pack_index *x, uint64_t key, int e)
+{
+    int i = (int) (key & (uint64_t) (x->size - 1));
+    while (x->slots[i] >= 0)
+        i = (i + 1) & (x->size - 1);
+    if (x->slots[i] == PACK_FREE)
+        x->used++;
+    x->slots[i] = e;
+}
+
+static void pack_index_add(pack_index *x, boolean by_name, int e)
+{
+    if (2 * (x->used + 1) > x->size) {
+        int i;
+        x->size = 64;
+        while (x->size < 4 * resource_pack.count)
+            x->size *= 2;
+        xfree(x->slots);
+        x->slots = xmalloc((unsigned) x->size * sizeof(int));
+        for (i = 0; i < x->size; i++)
+            x->slots[i] = PACK_FREE;
+        x->used = 0;
+        for (i = 0; i < resource_pack.count; i++) {
+            if (i != e && (!by_name || resource_pack.entries[i].name != NULL))
+                pack_index_put(x, pack_key(i, by_name), i);
+        }
+    }
+    pack_index_put(x, pack_key(e, by_name), e);
+}
+
+static void pack_index_remove(pack_index *x, uint64_t key, int e)
+{
+    int i;
+    if (x->size == 0)
+        return;
+    i = (int) (key & (uint64_t) (x->size - 1));
+    while (x->slots[i] != PACK_FREE) {
+        if (x->slots[i] == e) {
+            x->slots[i] = PACK_DELETED;
+            return;
+        }
+        i = (i + 1) & (x->size - 1);
+    }
+}
+
+static void pack_index_free(pack_index *x)
+{
+    xfree(x->slots);
+    x->size = 0;
+    x->used = 0;
+}
+
+/*tex
+
+    The hash only tells us where to look, because it is not collision resistant. An
+    entry is the same as the candidate |c| when the flags, attributes and references
+    are the same and so is the data, or for a deflated stream the length and the
+    SHA-256 digest of the data before deflating. The digest of |c| is only made
+    when we need it.
+
+*/
+
+static boolean pack_same(pack_entry *p, pack_entry *c, boolean *digested)
+{
+    int i;
+    if (p->hash != c->hash || p->flags != c->flags || p->attr_l != c->attr_l || p->nrefs != c->nrefs)
+        return false;
+    if (memcmp(p->attr, c->attr, (size_t) c->attr_l) != 0)
+        return false;
+    for (i = 0; i < c->nrefs; i++) {
+        if (p->refs[i].where != c->refs[i].where || p->refs[i].offset != c->refs[i].offset
+            || p->refs[i].entry != c->refs[i].entry)
+            return false;
+    }
+    if (p->flags & PACK_DEFLATED) {
+        if (p->raw_l != c->data_l)
+            return false;
+        if (!*digested) {
+            sha256(c->data, (size_t) c->data_l, c->digest);
+            *digested = true;
+        }
+        return memcmp(p->digest, c->digest, SHA256_DIGEST_LENGTH) == 0;
+    }
+    return p->data_l == c->data_l && memcmp(p->data, c->data, (size_t) c->data_l) == 0;
+}
+
+static int pack_find_entry(pack_entry *c, boolean *digested)
+{
+    pack_index *x = &resource_pack.hashes;
+    int i;
+    if (x->size == 0)
+        return -1;
+    i = (int) (c->hash & (uint64_t) (x->size - 1));
+    while (x->slots[i] != PACK_FREE) {
+        int e = x->slots[i];
+        if (e >= 0 && pack_same(&resource_pack.entries[e], c, digested))
+            return e;
+        i = (i + 1) & (x->size - 1);
+    }
+    return -1;
+}
+
+static int pack_find_name(const char *name)
+{
+    pack_index *x = &resource_pack.names;
+    int i;
+    if (x->size == 0)
+        return -1;
+    i = (int) (pack_hash(PACK_HASH_INIT, name, strlen(name)) & (uint64_t) (x->size - 1));
+    while (x->slots[i] != PACK_FREE) {
+        int e = x->slots[i];
+        if (e >= 0 && strcmp(resource_pack.entries[e].name, name) == 0)
+            return e;
+        i = (i + 1) & (x->size - 1);
+    }
+    return -1;
+}
+
+static int pack_new_entry(void)
+{
+    if (resource_pack.count == resource_pack.size) {
+        resource_pack.size = (resource_pack.size == 0) ? 64 : 2 * resource_pack.size;
+        resource_pack.entries = xrealloc(resource_pack.entries, (unsigned) resource_pack.size * sizeof(pack_entry));
+    }
+    memset(&resource_pack.entries[resource_pack.count], 0, sizeof(pack_entry));
+    return resource_pack.count++;
+}
+
+static void pack_free_entries(void)
+{
+    int i;
+    for (i = 0; i < resource_pack.count; i++) {
+        pack_entry *e = &resource_pack.entries[i];
+        xfree(e->name);
+        xfree(e->attr);
+        xfree(e->data);
+        xfree(e->refs);
+    }
+    xfree(resource_pack.entries);
+    resource_pack.count = 0;
+    resource_pack.size = 0;
+    resource_pack.saves = 0;
+    pack_index_free(&resource_pack.hashes);
+    pack_index_free(&resource_pack.names);
+}
+
+static boolean pack_get_int(const unsigned char **p, const unsigned char *e, int *v)
+{
+    if ((size_t) (e - *p) < sizeof(int))
+        return false;
+    memcpy(v, *p, sizeof(int));
+    *p += sizeof(int);
+    return *v >= 0;
+}
+
+static boolean pack_get_string(const unsigned char **p, const unsigned char *e, int l, char **s)
+{
+    if (e - *p < l)
+        return false;
+    *s = xmalloc((unsigned) l + 1);
+    memcpy(*s, *p, (size_t) l);
+    (*s)[l] = '\0';
+    *p += l;
+    return true;
+}
+
+/*tex
+
+    The pack file is a magic line, the number of saves, the number of entries and
+    the entries. Per entry we have the hash, the flags, the lengths of the name,
+    attributes and data, the number of references, the length of the data before
+    deflating, the save in which it was last used and the digest, then the strings
+    and the references. It is only meant for the machine that
+    wrote it so we use the native layout.
+
+*/
+
+static boolean pack_read(const unsigned char *b, int size)
+{
+    const unsigned char *p, *e;
+    int i, j, n, name_l;
+    if (b == NULL || (size_t) size < strlen(PACK_MAGIC) || memcmp(b, PACK_MAGIC, strlen(PACK_MAGIC)) != 0)
+        return false;
+    p = b + strlen(PACK_MAGIC);
+    e = b + size;
+    if (!(pack_get_int(&p, e, &resource_pack.saves) && pack_get_int(&p, e, &n)))
+        return false;
+    for (i = 0; i < n; i++) {
+        pack_entry *q;
+        int last[2] = { 0, 0 };
+        j = pack_new_entry();
+        q = &resource_pack.entries[j];
+        if ((size_t) (e - p) < sizeof(uint64_t))
+            return false;
+        memcpy(&q->hash, p, sizeof(uint64_t));
+        p += sizeof(uint64_t);
+        if (!(pack_get_int(&p, e, &q->flags) && pack_get_int(&p, e, &name_l)
+            && pack_get_int(&p, e, &q->attr_l) && pack_get_int(&p, e, &q->data_l)
+            && pack_get_int(&p, e, &q->nrefs) && pack_get_int(&p, e, &q->raw_l)
+            && pack_get_int(&p, e, &q->used)))
+            return false;
+        if ((size_t) (e - p) < SHA256_DIGEST_LENGTH)
+            return false;
+        memcpy(q->digest, p, SHA256_DIGEST_LENGTH);
+        p += SHA256_DIGEST_LENGTH;
+        if (name_l > 0 && !pack_get_string(&p, e, name_l, &q->name))
+            return false;
+        if (!(pack_get_string(&p, e, q->attr_l, &q->attr) && pack_get_string(&p, e, q->data_l, &q->data)))
+            return false;
+        if ((size_t) q->nrefs > (size_t) (e - p) / (3 * sizeof(int)))
+            return false;
+        q->refs = xmalloc((unsigned) (q->nrefs + 1) * sizeof(pack_ref));
+        for (j = 0; j < q->nrefs; j++) {
+            pack_ref *r = &q->refs[j];
+            if (!(pack_get_int(&p, e, &r->where) && pack_get_int(&p, e, &r->offset) && pack_get_int(&p, e, &r->entry)))
+                return false;
+            /*tex A stream only has references in its attributes, other objects only in their data. */
+            if (r->where != ((q->flags & PACK_STREAM) ? PACK_IN_ATTR : PACK_IN_DATA)
+                || r->entry >= n || r->offset < last[r->where]
+                || r->offset > (r->where == PACK_IN_ATTR ? q->attr_l : q->data_l))
+                return false;
+            last[r->where] = r->offset;
+        }
+        pack_index_add(&resource_pack.hashes, false, i);
+        if (q->name != NULL)
+            pack_index_add(&resource_pack.names, true, i);
+    }
+    return p == e;
+}
+
+boolean pdf_set_resource_pack(const char *name)
+{
+    FILE *f;
+    if (resource_pack.file_name != NULL)
+        return false;
+    resource_pack.file_name = xstrdup(name);
+    f = fopen(name, FOPEN_RBIN_MODE);
+    if (f != NULL) {
+        unsigned char *b = NULL;
+        int size = 0;
+        boolean ok = readbinfile(f, &b, &size) && pack_read(b, size);
+        fclose(f);
+        xfree(b);
+        if (!ok) {
+            formatted_warning("pdf backend", "resource pack '%s' is invalid, starting a new one", name);
+            pack_free_entries();
+            resource_pack.changed = true;
+        }
+    }
+    return true;
+}
+
+boolean pdf_has_resource_pack(void)
+{
+    return resource_pack.file_name != NULL;
+}
+
+static void pack_put_int(FILE *f, int i)
+{
+    fwrite(&i, sizeof(int), 1, f);
+}
+
+/*tex
+
+    Entries that were used in this job are marked with the save that we are about
+    to do. We also save when such an entry was marked long ago, so that a pack that
+    is used but doesn't change in some job keeps its entries. The |map| becomes the
+    new index of an entry or |-1| when it is dropped.
+
+*/
+
+void pdf_save_resource_pack(void)
+{
+    char *tmp;
+    FILE *f;
+    int i, j, n, saves;
+    int *map;
+    boolean ok, more;
+    if (resource_pack.file_name == NULL)
+        return;
+    saves = resource_pack.saves + 1;
+    for (i = 0; i < resource_pack.count; i++) {
+        if (resource_pack.entries[i].objnum != 0 && saves - resource_pack.entries[i].used > PACK_KEEP / 2)
+            resource_pack.changed = true;
+    }
+    if (!resource_pack.changed)
+        return;
+    map = xmalloc((unsigned) (resource_pack.count + 1) * sizeof(int));
+    for (i = 0; i < resource_pack.count; i++) {
+        pack_entry *e = &resource_pack.entries[i];
+        if (e->objnum != 0)
+            e->used = saves;
+        map[i] = (saves - e->used <= PACK_KEEP) ? 0 : -1;
+    }
+    /*tex An entry mostly refers to older ones, so this loop is seldom repeated. */
+    do {
+        more = false;
+        for (i = resource_pack.count - 1; i >= 0; i--) {
+            if (map[i] == 0) {
+                for (j = 0; j < resource_pack.entries[i].nrefs; j++) {
+                    int r = resource_pack.entries[i].refs[j].entry;
+                    if (map[r] < 0) {
+                        map[r] = 0;
+                        more = true;
+                    }
+                }
+            }
+        }
+    } while (more);
+    n = 0;
+    for (i = 0; i < resource_pack.count; i++) {
+        if (map[i] == 0)
+            map[i] = n++;
+    }
+    tmp = xmalloc((unsigned) strlen(resource_pack.file_name) + 5);
+    sprintf(tmp, "%s.tmp", resource_pack.file_name);
+    f = fopen(tmp, FOPEN_WBIN_MODE);
+    if (f == NULL) {
+        formatted_warning("pdf backend", "unable to write resource pack '%s'", resource_pack.file_name);
+        xfree(tmp);
+        xfree(map);
+        return;
+    }
+    fputs(PACK_MAGIC, f);
+    pack_put_int(f, saves);
+    pack_put_int(f, n);
+    for (i = 0; i < resource_pack.count; i++) {
+        pack_entry *e = &resource_pack.entries[i];
+        int name_l = (e->name == NULL) ? 0 : (int) strlen(e->name);
+        if (map[i] < 0)
+            continue;
+        fwrite(&e->hash, sizeof(uint64_t), 1, f);
+        pack_put_int(f, e->flags);
+        pack_put_int(f, name_l);
+        pack_put_int(f, e->attr_l);
+        pack_put_int(f, e->data_l);
+        pack_put_int(f, e->nrefs);
+        pack_put_int(f, e->raw_l);
+        pack_put_int(f, e->used);
+        fwrite(e->digest, 1, SHA256_DIGEST_LENGTH, f);
+        fwrite(e->name, 1, (size_t) name_l, f);
+        fwrite(e->attr, 1, (size_t) e->attr_l, f);
+        fwrite(e->data, 1, (size_t) e->data_l, f);
+        for (j = 0; j < e->nrefs; j++) {
+            pack_put_int(f, e->refs[j].where);
+            pack_put_int(f, e->refs[j].offset);
+            pack_put_int(f, map[e->refs[j].entry]);
+        }
+    }
+    ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = false;
+    if (!ok || rename(tmp, resource_pack.file_name) != 0) {
+        formatted_warning("pdf backend", "unable to write resource pack '%s'", resource_pack.file_name);
+        remove(tmp);
+    } else {
+        resource_pack.saves = saves;
+    }
+    xfree(tmp);
+    xfree(map);
+    resource_pack.changed = false;
+}
+
+/*tex An entry that is used by this job gets an object when it has none yet. */
+
+static int pack_objnum(PDF pdf, int e)
+{
+    int k = resource_pack.entries[e].objnum;
+    if (k == 0) {
+        pdf->obj_count++;
+        k = pdf_create_obj(pdf, obj_type_obj, pdf->obj_ptr + 1);
+        obj_data_ptr(pdf, k) = pdf_get_mem(pdf, pdfmem_obj_size);
+        init_obj_obj(pdf, k);
+        obj_obj_pack_entry(pdf, k) = e + 1;
+        if (resource_pack.entries[e].flags & PACK_STREAM)
+            set_obj_obj_is_stream(pdf, k);
+        resource_pack.entries[e].objnum = k;
+    }
+    return k;
+}
+
+int pdf_get_shared_obj(PDF pdf, const char *name)
+{
+    int i = pack_find_name(name);
+    if (i < 0)
+        return 0;
+    resource_pack_hits++;
+    return pack_objnum(pdf, i);
+}
+
+static void read_obj_file(const char *name, lstring *data);
+
+static int pack_entry_of_obj(PDF pdf, int k, int level);
+
+/*tex
+
+    We take the |n 0 R| references out of |s| and put the rest in |out|. The text
+    is split in tokens: literal and hex strings, names and comments are copied as
+    they are, and at every integer we check if it starts a |n 0 R| sequence. When it
+    doesn't we only move past that integer, because it can be followed by a
+    reference, as in |[/Indexed /DeviceRGB 255 7 0 R]|. Every reference has to be to
+    a shared object, otherwise we return |false|.
+
+*/
+
+static boolean pack_is_space(int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' || c == 0;
+}
+
+static boolean pack_is_regular(int c)
+{
+    return !pack_is_space(c) && strchr("()<>[]{}/%", c) == NULL;
+}
+
+/*tex The length of the regular token at |i|, when it is an unsigned integer: */
+
+static int pack_integer(const char *s, int l, int i, int *v)
+{
+    int j = i;
+    *v = 0;
+    while (j < l && pack_is_regular((unsigned char) s[j])) {
+        if (!isdigit((unsigned char) s[j]) || *v >= 100000000)
+            return 0;
+        *v = 10 * *v + s[j++] - '0';
+    }
+    return j - i;
+}
+
+static boolean pack_take_refs(PDF pdf, int level, const char *s, int l, int where, char *out, int *out_l, pack_ref **refs, int *nrefs)
+{
+    int i = 0, o = 0;
+    while (i < l) {
+        int c = (unsigned char) s[i];
+        if (c == '(') {
+            int depth = 0;
+            while (i < l) {
+                c = (unsigned char) s[i];
+                out[o++] = s[i++];
+                if (c == '\\') {
+                    if (i < l)
+                        out[o++] = s[i++];
+                } else if (c == '(') {
+                    depth++;
+                } else if (c == ')' && --depth == 0) {
+                    break;
+                }
+            }
+        } else if (c == '<' && i + 1 < l && s[i + 1] == '<') {
+            out[o++] = s[i++];
+            out[o++] = s[i++];
+        } else if (c == '<') {
+            while (i < l && s[i] != '>')
+                out[o++] = s[i++];
+            if (i < l)
+                out[o++] = s[i++];
+        } else if (c == '%') {
+            while (i < l && s[i] != '\n' && s[i] != '\r')
+                out[o++] = s[i++];
+        } else if (c == '/') {
+            out[o++] = s[i++];
+            while (i < l && pack_is_regular((unsigned char) s[i]))
+                out[o++] = s[i++];
+        } else if (pack_is_regular(c)) {
+            int num, gen, n = pack_integer(s, l, i, &num);
+            if (n > 0) {
+                int j = i + n;
+                while (j < l && pack_is_space((unsigned char) s[j]))
+                    j++;
+                if (j > i + n) {
+                    int g = pack_integer(s, l, j, &gen);
+                    if (g > 0) {
+                        j += g;
+                        while (j < l && pack_is_space((unsigned char) s[j]))
+                            j++;
+                        if (j < l && s[j] == 'R' && (j + 1 == l || !pack_is_regular((unsigned char) s[j + 1]))) {
+                            int e = (gen == 0) ? pack_entry_of_obj(pdf, num, level) : -1;
+                            if (e < 0)
+                                return false;
+                            *refs = xrealloc(*refs, (unsigned) (*nrefs + 1) * sizeof(pack_ref));
+                            (*refs)[*nrefs].where = where;
+                            (*refs)[*nrefs].offset = o;
+                            (*refs)[*nrefs].entry = e;
+                            (*nrefs)++;
+                            i = j + 1;
+                            continue;
+                        }
+                    }
+                }
+            }
+            while (i < l && pack_is_regular((unsigned char) s[i]))
+                out[o++] = s[i++];
+        } else {
+            out[o++] = s[i++];
+        }
+    }
+    *out_l = o;
+    return true;
+}
+
+static const char *obj_string(int r, size_t *l)
+{
+    const char *s;
+    lua_rawgeti(Luas, LUA_REGISTRYINDEX, r);
+    if (lua_type(Luas, -1) != LUA_TSTRING)
+        normal_error("pdf backend", "invalid object");
+    s = lua_tolstring(Luas, -1, l);
+    lua_pop(Luas, 1);
+    return s;
+}
+
+/*tex
+
+    The |level| is the global compression level, the one that is passed on to the
+    objects we refer to; each object applies its own |compresslevel| on top of it.
+
+*/
+
+static int pack_build_entry(PDF pdf, int k, int level)
+{
+    pack_entry *e, c;
+    boolean digested = false;
+    lstring data, attr;
+    pack_ref *refs = NULL;
+    int i, nrefs = 0, attr_l = 0, data_l = 0, flags = 0;
+    int compress_level = level;
+    char *name = NULL;
+    uint64_t h = PACK_HASH_INIT;
+    const char *s;
+    size_t l;
+    if (obj_obj_pdfcompresslevel(pdf, k) > -1)
+        compress_level = obj_obj_pdfcompresslevel(pdf, k);
+    s = obj_string(obj_obj_data(pdf, k), &l);
+    if (obj_obj_is_file(pdf, k)) {
+        read_obj_file(s, &data);
+    } else {
+        data.l = l;
+        data.s = xmalloc((unsigned) l + 1);
+        memcpy(data.s, s, l);
+    }
+    attr.s = NULL;
+    attr.l = 0;
+    if (obj_obj_is_stream(pdf, k)) {
+        flags |= PACK_STREAM;
+        if (obj_obj_stream_attr(pdf, k) != LUA_NOREF) {
+            s = obj_string(obj_obj_stream_attr(pdf, k), &l);
+            attr.s = xmalloc((unsigned) l + 1);
+            if (!pack_take_refs(pdf, level, s, (int) l, PACK_IN_ATTR, (char *) attr.s, &attr_l, &refs, &nrefs))
+                goto FAILED;
+        }
+        data_l = (int) data.l;
+    } else {
+        char *raw = (char *) data.s;
+        data.s = xmalloc((unsigned) data.l + 1);
+        if (!pack_take_refs(pdf, level, raw, (int) data.l, PACK_IN_DATA, (char *) data.s, &data_l, &refs, &nrefs)) {
+            xfree(raw);
+            goto FAILED;
+        }
+        xfree(raw);
+    }
+    h = pack_hash(h, &flags, sizeof(int));
+    if (flags & PACK_STREAM)
+        h = pack_hash(h, &compress_level, sizeof(int));
+    h = pack_hash(h, &attr_l, sizeof(int));
+    h = pack_hash(h, attr.s, (size_t) attr_l);
+    h = pack_hash(h, data.s, (size_t) data_l);
+    for (i = 0; i < nrefs; i++) {
+        h = pack_hash(h, &refs[i].where, sizeof(int));
+        h = pack_hash(h, &refs[i].offset, sizeof(int));
+        h = pack_hash(h, &resource_pack.entries[refs[i].entry].hash, sizeof(uint64_t));
+    }
+    if (obj_obj_shared_name(pdf, k) != LUA_NOREF)
+        name = xstrdup(obj_string(obj_obj_shared_name(pdf, k), &l));
+    if ((flags & PACK_STREAM) && compress_level > 0)
+        flags |= PACK_DEFLATED;
+    memset(&c, 0, sizeof(pack_entry));
+    c.hash = h;
+    c.flags = flags;
+    c.attr = (char *) attr.s;
+    c.attr_l = attr_l;
+    c.data = (char *) data.s;
+    c.data_l = data_l;
+    c.refs = refs;
+    c.nrefs = nrefs;
+    i = pack_find_entry(&c, &digested);
+    if (i >= 0) {
+        resource_pack_hits++;
+        xfree(attr.s);
+        xfree(data.s);
+        xfree(refs);
+    } else {
+        i = pack_new_entry();
+        e = &resource_pack.entries[i];
+        e->hash = h;
+        e->attr = (char *) attr.s;
+        e->attr_l = attr_l;
+        e->nrefs = nrefs;
+        e->refs = refs;
+        e->raw_l = data_l;
+        if (flags & PACK_DEFLATED) {
+            uLongf z = compressBound((uLong) data_l);
+            if (!digested)
+                sha256(data.s, (size_t) data_l, c.digest);
+            memcpy(e->digest, c.digest, SHA256_DIGEST_LENGTH);
+            e->data = xmalloc((unsigned) z);
+            if (compress2((Bytef *) e->data, &z, (const Bytef *) data.s, (uLong) data_l, compress_level) != Z_OK)
+                normal_error("pdf backend", "compressing a shared object failed");
+            e->data_l = (int) z;
+            xfree(data.s);
+        } else {
+            e->data = (char *) data.s;
+            e->data_l = data_l;
+        }
+        e->flags = flags;
+        pack_index_add(&resource_pack.hashes, false, i);
+        resource_pack_added++;
+        resource_pack.changed = true;
+    }
+    e = &resource_pack.entries[i];
+    if (name != NULL) {
+        if (e->name == NULL || strcmp(e->name, name) != 0) {
+            int j = pack_find_name(name);
+            if (j >= 0) {
+                pack_index_remove(&resource_pack.names, pack_key(j, true), j);
+                xfree(resource_pack.entries[j].name);
+            }
+            if (e->name != NULL)
+                pack_index_remove(&resource_pack.names, pack_key(i, true), i);
+            xfree(e->name);
+            e->name = name;
+            pack_index_add(&resource_pack.names, true, i);
+            resource_pack.changed = true;
+        } else {
+            xfree(name);
+        }
+    }
+    if (e->objnum == 0)
+        e->objnum = k;
+    return i;
+  FAILED:
+    xfree(attr.s);
+    xfree(data.s);
+    xfree(refs);
+    return -1;
+}
+
+/*tex The result is cached in the object, a value of |-1| means: not packable. */
+
+static int pack_entry_of_obj(PDF pdf, int k, int level)
+{
+    int e;
+    if (k <= 0 || k > pdf->obj_ptr || obj_type(pdf, k) != obj_type_obj || obj_data_ptr(pdf, k) == 0)
+        return -1;
+    e = obj_obj_pack_entry(pdf, k);
+    if (e < 0)
+        return -1;
+    else if (e > 0)
+        return e - 1;
+    if (!obj_obj_is_shared(pdf, k) || obj_obj_data(pdf, k) == LUA_NOREF)
+        return -1;
+    /*tex This also catches cycles: */
+    obj_obj_pack_entry(pdf, k) = -1;
+    e = pack_build_entry(pdf, k, level);
+    obj_obj_pack_entry(pdf, k) = (e < 0) ? -1 : e + 1;
+    return e;
+}
+
+static void pack_out(PDF pdf, int e, int where, const char *s, int l)
+{
+    int i, p = 0;
+    for (i = 0; i < resource_pack.entries[e].nrefs; i++) {
+        pack_ref *r = &resource_pack.entries[e].refs[i];
+        if (r->where == where) {
+            pdf_out_block(pdf, s + p, (size_t) (r->offset - p));
+            pdf_printf(pdf, "%d 0 R", pack_objnum(pdf, r->entry));
+            p = r->offset;
+        }
+    }
+    pdf_out_block(pdf, s + p, (size_t) (l - p));
+}
+
+static void pdf_write_pack_entry(PDF pdf, int k, int e, int os_threshold)
+{
+    pack_entry *p = &resource_pack.entries[e];
+    int i;
+    if (p->flags & PACK_STREAM) {
+        pdf_begin_obj(pdf, k, OBJSTM_NEVER);
+        pdf_begin_dict(pdf);
+        pdf_check_space(pdf);
+        pack_out(pdf, e, PACK_IN_ATTR, p->attr, p->attr_l);
+        pdf_set_space(pdf);
+        if (p->flags & PACK_DEFLATED)
+            pdf_dict_add_name(pdf, "Filter", "FlateDecode");
+        pdf_dict_add_int(pdf, "Length", p->data_l);
+        pdf_end_dict(pdf);
+        pdf_begin_stream(pdf);
+        pdf_out_block(pdf, p->data, (size_t) p->data_l);
+        pdf_end_stream(pdf);
+    } else {
+        pdf_begin_obj(pdf, k, os_threshold);
+        pack_out(pdf, e, PACK_IN_DATA, p->data, p->data_l);
+    }
+    pdf_end_obj(pdf);
+    /*tex The objects we refer to have to end up in the file too. */
+    for (i = 0; i < resource_pack.entries[e].nrefs; i++) {
+        int d = resource_pack.entries[resource_pack.entries[e].refs[i].entry].objnum;
+        if (d != 0 && !is_obj_written(pdf, d))
+            pdf_write_obj(pdf, d);
+    }
+}
+
+/*tex Read the data of a |file| object: */
+
+static void read_obj_file(const char *name, lstring *data)
+{
+    /*tex The callback status value: */
+    boolean res = false;
+    /*tex The callback found filename: */
+    const char *fnam = NULL;
+    int callback_id;
+    int ll = 0;
+    data->s = NULL;
+    fnam = luatex_find_file(name, find_data_file_callback);
+    callback_id = callback_defined(read_data_file_callback);
+    if (fnam && callback_id > 0) {
+        boolean file_opened = false;
+        res = run_callback(callback_id, "S->bSd", fnam, &file_opened, &data->s, &ll);
+        data->l = (size_t) ll;
+        if (!file_opened)
+            normal_error("pdf backend", "cannot open file for embedding");
+    } else {
+        /*tex The data file's |FILE*|: */
+        byte_file f;
+        if (!fnam)
+            fnam = name;
+        if (!luatex_open_input(&f, fnam, kpse_tex_format, FOPEN_RBIN_MODE, true))
+            normal_error("pdf backend", "cannot open file for embedding");
+        res = read_data_file(f, &data->s, &ll);
+        data->l = (size_t) ll;
+        close_file(f);
+    }
+    if (data->l == 0L)
+        normal_error("pdf backend", "empty file for embedding");
+    if (!res)
+        normal_error("pdf backend", "error reading file for embedding");
+    tprint("<<");
+    tprint(name);
+    tprint(">>");
+}
 
 /*tex Write a raw \PDF\ object: */
 
@@ -35,7 +895,6 @@ void pdf_write_obj(PDF pdf, int k)
     int os_threshold = OBJSTM_ALWAYS;
     /*tex Possibly a \LUA\ registry reference: */
     int l = 0;
-    int ll = 0;
     data.s = NULL;
     /*tex We can have an immediate object before we are initialized. */
     ensure_output_state(pdf, ST_HEADER_WRITTEN);
@@ -50,6 +909,20 @@ void pdf_write_obj(PDF pdf, int k)
     }
     if (obj_obj_objstm_threshold(pdf, k) != OBJSTM_UNSET)
         os_threshold = obj_obj_objstm_threshold(pdf, k);
+    if (resource_pack.file_name != NULL) {
+        int e = pack_entry_of_obj(pdf, k, saved_compress_level);
+        if (e >= 0) {
+            pdf_write_pack_entry(pdf, k, e, os_threshold);
+            luaL_unref(Luas, LUA_REGISTRYINDEX, obj_obj_stream_attr(pdf, k));
+            luaL_unref(Luas, LUA_REGISTRYINDEX, obj_obj_data(pdf, k));
+            luaL_unref(Luas, LUA_REGISTRYINDEX, obj_obj_shared_name(pdf, k));
+            obj_obj_stream_attr(pdf, k) = LUA_NOREF;
+            obj_obj_data(pdf, k) = LUA_NOREF;
+            obj_obj_shared_name(pdf, k) = LUA_NOREF;
+            pdf->compress_level = saved_compress_level;
+            return;
+        }
+    }
     if (obj_obj_is_stream(pdf, k)) {
         pdf_begin_obj(pdf, k, OBJSTM_NEVER);
         pdf_begin_dict(pdf);
@@ -80,40 +953,10 @@ void pdf_write_obj(PDF pdf, int k)
     st.l = li;
     lua_pop(Luas, 1);
     if (obj_obj_is_file(pdf, k)) {
-        /*tex The callback status value: */
-        boolean res = false;
-        /*tex The callback found filename: */
-        const char *fnam = NULL;
-        int callback_id;
         /*tex |st.s| is also |\0|-terminated, even as |lstring| */
-        fnam = luatex_find_file(st.s, find_data_file_callback);
-        callback_id = callback_defined(read_data_file_callback);
-        if (fnam && callback_id > 0) {
-            boolean file_opened = false;
-            res = run_callback(callback_id, "S->bSd", fnam, &file_opened, &data.s, &ll);
-            data.l = (size_t) ll;
-            if (!file_opened)
-                normal_error("pdf backend", "cannot open file for embedding");
-        } else {
-            /*tex The data file's |FILE*|: */
-            byte_file f;
-            if (!fnam)
-                fnam = st.s;
-            if (!luatex_open_input(&f, fnam, kpse_tex_format, FOPEN_RBIN_MODE, true))
-                normal_error("pdf backend", "cannot open file for embedding");
-            res = read_data_file(f, &data.s, &ll);
-            data.l = (size_t) ll;
-            close_file(f);
-        }
-        if (data.l == 0L)
-            normal_error("pdf backend", "empty file for embedding");
-        if (!res)
-            normal_error("pdf backend", "error reading file for embedding");
-        tprint("<<");
-        tprint(st.s);
+        read_obj_file(st.s, &data);
         pdf_out_block(pdf, (const char *) data.s, data.l);
         xfree(data.s);
-        tprint(">>");
     } else {
         pdf_out_block(pdf, st.s, st.l);
     }
@@ -138,6 +981,8 @@ void init_obj_obj(PDF pdf, int k)
     unset_obj_obj_no_length(pdf, k);
     obj_obj_pdfcompresslevel(pdf, k) = -1; /* unset */
     obj_obj_objstm_threshold(pdf, k) = OBJSTM_UNSET; /* unset */
+    obj_obj_shared_name(pdf, k) = LUA_NOREF;
+    obj_obj_pack_entry(pdf, k) = 0;
 }
 
 /*tex
@@ -174,6 +1019,8 @@ void scan_obj(PDF pdf)
         }
         obj_data_ptr(pdf, k) = pdf_get_mem(pdf, pdfmem_obj_size);
         init_obj_obj(pdf, k);
+        if (scan_keyword("shared"))
+            set_obj_obj_is_shared(pdf, k);
         if (scan_keyword("uncompressed")) {
             obj_obj_pdfcompresslevel(pdf, k) = 0;
             obj_obj_objstm_threshold(pdf, k) = OBJSTM_NEVER;
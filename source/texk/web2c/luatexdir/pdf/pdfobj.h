@@ -25,17 +25,20 @@
 
 #  define set_pdf_obj_objnum(A, B) pdf_obj_objnum(A) = (B)
 
-#  define pdfmem_obj_size 5 /* size of memory in |mem| which |obj_data_ptr| holds */
+#  define pdfmem_obj_size 7 /* size of memory in |mem| which |obj_data_ptr| holds */
 
 #  define obj_obj_data(pdf, A)             pdf->mem[obj_data_ptr((pdf), (A)) + 0] /* object data */
 #  define obj_obj_stream_attr(pdf, A)      pdf->mem[obj_data_ptr((pdf), (A)) + 1] /* additional attributes into stream dict */
 #  define obj_obj_flags(pdf, A)            pdf->mem[obj_data_ptr((pdf), (A)) + 2] /* stream/file flags */
 #  define obj_obj_pdfcompresslevel(pdf, A) pdf->mem[obj_data_ptr((pdf), (A)) + 3] /* overrides \pdfcompresslevel */
 #  define obj_obj_objstm_threshold(pdf, A) pdf->mem[obj_data_ptr((pdf), (A)) + 4] /* for object stream compression */
+#  define obj_obj_shared_name(pdf, A)      pdf->mem[obj_data_ptr((pdf), (A)) + 5] /* name of a shared object */
+#  define obj_obj_pack_entry(pdf, A)       pdf->mem[obj_data_ptr((pdf), (A)) + 6] /* resource pack entry plus one */
 
 #  define OBJ_FLAG_ISSTREAM              (1 << 0)
 #  define OBJ_FLAG_ISFILE                (1 << 1)
 #  define OBJ_FLAG_NOLENGTH              (1 << 2)
+#  define OBJ_FLAG_SHARED                (1 << 3)
 
 #  define obj_obj_is_stream(pdf,A)       ((obj_obj_flags((pdf), (A)) & OBJ_FLAG_ISSTREAM) != 0)
 #  define set_obj_obj_is_stream(pdf,A)   ((obj_obj_flags((pdf), (A)) |= OBJ_FLAG_ISSTREAM))
@@ -49,6 +52,10 @@
 #  define set_obj_obj_no_length(pdf,A)   ((obj_obj_flags((pdf), (A)) |= OBJ_FLAG_NOLENGTH))
 #  define unset_obj_obj_no_length(pdf,A) ((obj_obj_flags((pdf), (A)) &= ~OBJ_FLAG_NOLENGTH))
 
+#  define obj_obj_is_shared(pdf,A)       ((obj_obj_flags((pdf), (A)) & OBJ_FLAG_SHARED) != 0)
+#  define set_obj_obj_is_shared(pdf,A)   ((obj_obj_flags((pdf), (A)) |= OBJ_FLAG_SHARED))
+#  define unset_obj_obj_is_shared(pdf,A) ((obj_obj_flags((pdf), (A)) &= ~OBJ_FLAG_SHARED))
+
 extern void init_obj_obj(PDF pdf, int k);
 extern void pdf_write_obj(PDF pdf, int n);
 extern void scan_obj(PDF pdf);
@@ -57,4 +64,12 @@ extern void scan_refobj_lua(PDF pdf, int k);
 extern void pdf_ref_obj(PDF pdf, halfword p);
 extern void pdf_ref_obj_lua(PDF pdf, int k);
 
+extern int resource_pack_hits;
+extern int resource_pack_added;
+
+extern boolean pdf_set_resource_pack(const char *name);
+extern boolean pdf_has_resource_pack(void);
+extern int pdf_get_shared_obj(PDF pdf, const char *name);
+extern void pdf_save_resource_pack(void);
+
 #endif
@@ -20,6 +20,7 @@ with LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "ptexlib.h"
+#include "lua/luatex-api.h"
 
 scaledpos shipbox_refpos;
 
@@ -287,4 +288,5 @@ void ship_out(PDF pdf, halfword p, shipping_mode_e shipping_mode)
     if (synctex_par)
         synctexteehs();
     global_shipping_mode = NOT_SHIPPING;
+    lua_gc_quiet_point(lua_gc_point_shipout);
 }
@@ -20,6 +20,7 @@ with LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "ptexlib.h"
+#include "lua/luatex-api.h"
 
 
 #define mode mode_par
@@ -701,6 +702,7 @@ void build_page(void)
             }
             if ((c == awful_bad) || (pi <= eject_penalty)) {
                 /*tex Output the current page at the best place. */
+                lua_gc_quiet_point(lua_gc_point_page);
                 fire_up(p);
                 if (output_active) {
                     /*tex User's output routine will act. */
@@ -381,7 +381,7 @@ boolean load_fmt_file(const char *fmtname)
     if (ini_version) {
         libcfree(hash);
         libcfree(eqtb);
-        libcfree(fixmem);
+        free_fixmem();
         libcfree(varmem);
     }
     undump_int(x);
@@ -460,9 +460,8 @@ boolean load_fmt_file(const char *fmtname)
     undump_int(backup_head);
     undump_int(garbage);
     undump_int(fix_mem_min);
-    undump_int(fix_mem_max);
-    fixmem = xmallocarray(smemory_word, fix_mem_max + 1);
-    memset(voidcast(fixmem), 0, (fix_mem_max + 1) * sizeof(smemory_word));
+    undump_int(x);
+    allocate_fixmem((unsigned) x);
     undump_int(fix_mem_end);
     undump_int(avail);
     undump_things(fixmem[fix_mem_min], fix_mem_end - fix_mem_min + 1);
@@ -507,6 +506,7 @@ boolean load_fmt_file(const char *fmtname)
         if (debug_format_file)
             print_csnames(eqtb_size + 1, hash_high - (eqtb_size + 1));
     }
+    rebuild_cs_index();
     undump_int(cs_count);
     /*tex Undump the font information */
     undump_int(x);
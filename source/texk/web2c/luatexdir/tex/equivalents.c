@@ -753,10 +753,14 @@ void unsave(void)
     quarterword l = level_one;
     /*tex Variable |a| registers if we already have processed an \.{\\aftergroup}. */
     boolean a = false;
-    unsave_math_codes(cur_level);
-    unsave_cat_codes(cat_code_table_par, cur_level);
-    unsave_text_codes(cur_level);
-    unsave_math_data(cur_level);
+    if (cur_level <= sa_stack_level) {
+        /*tex Only when something was saved in a sparse array at this level. */
+        unsave_math_codes(cur_level);
+        unsave_cat_codes(cat_code_table_par, cur_level);
+        unsave_text_codes(cur_level);
+        unsave_math_data(cur_level);
+        sa_stack_level = cur_level - 1;
+    }
     if (cur_level > level_one) {
         boolean trace = tracing_restores_par > 0;
         decr(cur_level);
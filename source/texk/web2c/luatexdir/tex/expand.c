@@ -591,18 +591,68 @@ int long_state;
 /*tex
 
     The parameters, if any, must be scanned before the macro is expanded.
-    Parameters are token lists without reference counts. They are placed on an
+    Parameters are token lists with reference counts. They are placed on an
     auxiliary stack called |pstack| while they are being scanned, since the
     |param_stack| may be losing entries during the matching process. (Note that
     |param_stack| can't be gaining entries, since |macro_call| is the only
     routine that puts anything onto |param_stack|, and it is not recursive.)
 
+    The reference count makes it possible to pass an argument on without
+    copying it. When a macro body says \type {\\next{#1}}, the argument of
+    \type {\\next} is exactly the list of \type {#1}, so instead of reading it
+    token by token we skip the parameter and take another reference. Because the
+    lists on the parameter stack are never changed, that is all there is to it.
+    When more tokens follow, we copy the list after all.
+
 */
 
 /*tex The arguments supplied to a macro: */
 
 halfword pstack[9];
 
+/*tex
+
+    We can take the next parameter of the current macro body as it is when it is
+    a complete group: the list is balanced and we are inside a group, so the
+    |align_state| stays positive, but a \.{\\par} or an \.{\\outer} macro has
+    to be noticed the usual way.
+
+*/
+
+static halfword shared_argument(void)
+{
+    halfword h, q;
+    if (istate != token_list || token_type != macro || iloc == null || align_state <= 0) {
+        return null;
+    } else if (token_info(iloc) >= cs_token_flag || token_cmd(token_info(iloc)) != out_param_cmd) {
+        return null;
+    }
+    h = param_stack[param_start + token_chr(token_info(iloc)) - 1];
+    for (q = token_link(h); q != null; q = token_link(q)) {
+        halfword t = token_info(q);
+        if (t == par_token && long_state != long_call_cmd && !suppress_long_error_par) {
+            return null;
+        } else if (t >= cs_token_flag && eq_type(t - cs_token_flag) >= outer_call_cmd) {
+            return null;
+        }
+    }
+    iloc = token_link(iloc);
+    return h;
+}
+
+/*tex Copy the shared argument |h| after |p| and return the last token copied. */
+
+static halfword copy_shared_argument(halfword h, halfword p)
+{
+    halfword q;
+    halfword r = token_link(p);
+    for (h = token_link(h); h != null; h = token_link(h)) {
+        fast_store_new_token(token_info(h));
+    }
+    set_token_link(p, r);
+    return p;
+}
+
 /*tex
 
     After parameter scanning is complete, the parameters are moved to the
@@ -651,6 +701,9 @@ void macro_call(void)
     halfword save_warning_index = warning_index;
     /*tex character used in parameter */
     int match_chr = 0;
+    /*tex an argument passed on as it is, and the left brace before it */
+    halfword shared = null;
+    halfword shared_at = null;
     warning_index = cur_cs;
     ref_count = cur_chr;
     r = token_link(ref_count);
@@ -738,6 +791,13 @@ void macro_call(void)
                 }
 
             }
+            if (shared != null) {
+                /*tex More follows the group, so we need a copy after all. */
+                q = copy_shared_argument(shared, shared_at);
+                if (p == shared_at)
+                    p = q;
+                shared = null;
+            }
             /*tex
 
                 Contribute the recently matched tokens to the current parameter,
@@ -816,7 +876,15 @@ void macro_call(void)
                     unbalance = 1;
                     while (1) {
                         fast_store_new_token(cur_tok);
+                        if (m == 0 && unbalance == 1 && p == token_link(temp_token_head)) {
+                            shared = shared_argument();
+                            shared_at = p;
+                        }
                         get_token();
+                        if (shared != null && (unbalance != 1 || cur_tok >= right_brace_limit || cur_tok < left_brace_limit)) {
+                            p = copy_shared_argument(shared, shared_at);
+                            shared = null;
+                        }
                         if (cur_tok == par_token) {
                             if (long_state != long_call_cmd) {
                                 if (!suppress_long_error_par) {
@@ -886,13 +954,24 @@ void macro_call(void)
                 */
                 if ((m == 1) && (token_info(p) < right_brace_limit)
                     && (p != temp_token_head)) {
+                    /*tex The left brace becomes the reference count. */
                     set_token_link(rbrace_ptr, null);
                     free_avail(p);
                     p = token_link(temp_token_head);
-                    pstack[n] = token_link(p);
-                    free_avail(p);
+                    if (shared != null) {
+                        free_avail(p);
+                        add_token_ref(shared);
+                        pstack[n] = shared;
+                        shared = null;
+                    } else {
+                        set_token_ref_count(p, 0);
+                        pstack[n] = p;
+                    }
                 } else {
-                    pstack[n] = token_link(temp_token_head);
+                    p = get_avail();
+                    set_token_ref_count(p, 0);
+                    set_token_link(p, token_link(temp_token_head));
+                    pstack[n] = p;
                 }
                 incr(n);
                 if (tracing_macros_par > 0) {
@@ -900,7 +979,7 @@ void macro_call(void)
                     print_nl(match_chr);
                     print_int(n);
                     tprint("<-");
-                    show_token_list(pstack[n - 1], null, 1000);
+                    show_token_list(token_link(pstack[n - 1]), null, 1000);
                     end_diagnostic(false);
                 }
             }
@@ -957,10 +1036,10 @@ void macro_call(void)
         );
         back_error();
     }
-    pstack[n] = token_link(temp_token_head);
+    flush_list(token_link(temp_token_head));
     align_state = align_state - unbalance;
-    for (m = 0; m <= n; m++)
-        flush_list(pstack[m]);
+    for (m = 0; m < n; m++)
+        delete_token_ref(pstack[m]);
   EXIT:
     scanner_status = save_scanner_status;
     warning_index = save_warning_index;
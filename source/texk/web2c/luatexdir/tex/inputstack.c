@@ -419,7 +419,7 @@ void show_context(void)
                     print_token_list_type(token_type);
 
                     begin_pseudoprint();
-                    if (token_type < macro) {
+                    if (token_type < macro && token_type != parameter) {
                         show_token_list(istart, iloc, 100000);
                     } else {
                         /*tex Avoid reference count. */
@@ -564,7 +564,7 @@ void end_token_list(void)
                 /*tex Parameters must be flushed: */
                 while (param_ptr > param_start) {
                     decr(param_ptr);
-                    flush_list(param_stack[param_ptr]);
+                    delete_token_ref(param_stack[param_ptr]);
                 }
             }
         }
@@ -926,10 +926,54 @@ static scaled best_pl_glue[4];
 #define add_disc_width_to_break_width(a)     break_width[(a)] += disc_width[(a)]
 #define sub_disc_width_from_active_width(a)  active_width[(a)] -= disc_width[(a)]
 
-#define add_char_shrink(a,b)  a += char_shrink((b))
-#define add_char_stretch(a,b) a += char_stretch((b))
-#define sub_char_shrink(a,b)  a -= char_shrink((b))
-#define sub_char_stretch(a,b) a -= char_stretch((b))
+/*tex
+
+    With font expansion the stretch and shrink of every glyph is needed in every
+    pass, and those of the glyphs in discretionaries each time a break width is
+    computed. Each value costs a few character lookups and a rounding, but only
+    depends on the font and character, so we keep them in a small direct mapped
+    cache that is cleared for every paragraph, because expansion parameters can
+    change in between.
+
+*/
+
+#define expansion_cache_size 1024
+
+typedef struct expansion_entry {
+    internal_font_number f;
+    int c;
+    scaled stretch;
+    scaled shrink;
+} expansion_entry;
+
+static expansion_entry expansion_cache[expansion_cache_size];
+
+static void reset_expansion_cache(void)
+{
+    int i;
+    for (i = 0; i < expansion_cache_size; i++) {
+        expansion_cache[i].c = -1;
+    }
+}
+
+static expansion_entry *char_expansion(halfword p)
+{
+    internal_font_number f = font(p);
+    int c = character(p);
+    expansion_entry *e = &expansion_cache[((unsigned) c * 31 + (unsigned) f) & (expansion_cache_size - 1)];
+    if (e->c != c || e->f != f) {
+        e->f = f;
+        e->c = c;
+        e->stretch = char_stretch(p);
+        e->shrink = char_shrink(p);
+    }
+    return e;
+}
+
+#define add_char_shrink(a,b)  a += char_expansion((b))->shrink
+#define add_char_stretch(a,b) a += char_expansion((b))->stretch
+#define sub_char_shrink(a,b)  a -= char_expansion((b))->shrink
+#define sub_char_stretch(a,b) a -= char_expansion((b))->stretch
 
 #define add_kern_shrink(a,b)  a += kern_shrink((b))
 #define add_kern_stretch(a,b) a += kern_stretch((b))
@@ -2001,6 +2045,7 @@ void ext_do_line_break(
         max_shrink_ratio = -1;
         cur_font_step = -1;
         set_prev_char_p(null);
+        reset_expansion_cache();
     }
     /*tex
 
@@ -22,6 +22,7 @@ with LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "ptexlib.h"
+#include "lua/luatex-api.h"
 
 /*tex
 
@@ -274,6 +275,10 @@ int save_size;
 
 int expand_depth;
 
+/*tex the number of token memory words that can be reserved in one go */
+
+int token_memory_reserve;
+
 /*tex parse the first line for options */
 
 int parsefirstlinep;
@@ -378,6 +383,7 @@ int main_initialize(void)
     setup_bound_var(0, "hash_extra", hash_extra);
     setup_bound_var(72, "pk_dpi", pk_dpi);
     setup_bound_var(10000, "expand_depth", expand_depth);
+    setup_bound_var(16000000, "token_memory_reserve", token_memory_reserve);
     /*tex
         Check other constants against their sup and inf.
     */
@@ -392,6 +398,7 @@ int main_initialize(void)
     const_chk(strings_free);
     const_chk(hash_extra);
     const_chk(pk_dpi);
+    const_chk(token_memory_reserve);
     if (error_line > ssup_error_line) {
         error_line = ssup_error_line;
     }
@@ -416,10 +423,8 @@ int main_initialize(void)
         Only in ini mode:
     */
     if (ini_version) {
-        fixmem = xmallocarray(smemory_word, fix_mem_init + 1);
-        memset(voidcast(fixmem), 0, (fix_mem_init + 1) * sizeof(smemory_word));
+        allocate_fixmem(fix_mem_init);
         fix_mem_min = 0;
-        fix_mem_max = fix_mem_init;
         eqtb_top = eqtb_size + hash_extra;
         if (hash_extra == 0)
             hash_top = undefined_control_sequence;
@@ -632,6 +637,12 @@ void close_files_and_terminate(void)
                     (int) nest_size, (int) param_size, (int) buf_size,
                     (int) save_size
                 );
+                if (lua_gc_steps > 0) {
+                    fprintf(log_file,
+                        " %d Lua gc steps (%d cycles) taking %d microseconds, at most %d\n",
+                        lua_gc_steps, lua_gc_cycles, lua_gc_time, lua_gc_max_time
+                    );
+                }
             }
         }
     }
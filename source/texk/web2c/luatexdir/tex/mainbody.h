@@ -68,6 +68,9 @@ in production versions of \TeX.
 #  define inf_expand_depth   100
 #  define sup_expand_depth   10000000
 
+#  define inf_token_memory_reserve   100000
+#  define sup_token_memory_reserve   max_halfword
+
 
 #  include <stdio.h>
 
@@ -134,6 +137,7 @@ extern int param_size;
 extern int nest_size;
 extern int save_size;
 extern int expand_depth;
+extern int token_memory_reserve;
 extern int parsefirstlinep;
 extern int filelineerrorstylep;
 extern int haltonerrorp;
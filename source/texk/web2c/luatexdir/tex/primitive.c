@@ -82,6 +82,125 @@ int cs_count;
 
 #define hash_is_full (hash_used==hash_base)
 
+/*tex
+
+Control sequences are no longer found by following coalesced lists: with many
+thousands of extra names all collisions end up in one long list. Instead
+|cs_slots| is an open addressing index, keyed by an \FNV\ hash of the name, that
+maps a name onto its position in |hash|. Positions are never moved, they end up
+in tokens, but the index is doubled when it gets half full. When all positions
+are used, the |hash_extra| part of |hash| and |eqtb| grows instead of
+overflowing. The |cs_next| fields are no longer set, so only the |cs_text|
+fields of |hash| matter in the format. The index itself is not dumped, it is
+rebuilt from those after the format has been loaded.
+
+*/
+
+typedef struct cs_slot {
+    halfword cs;
+    unsigned hash;
+} cs_slot;
+
+static cs_slot *cs_slots = NULL;
+static unsigned cs_slots_mask = 0;
+static unsigned cs_slots_used = 0;
+
+#define cs_slots_initial 65536
+
+#define cs_hash(s,l) str_hash(s, (size_t) (l))
+
+static void cs_slots_insert(halfword p, unsigned h)
+{
+    unsigned i = h & cs_slots_mask;
+    while (cs_slots[i].cs != 0) {
+        i = (i + 1) & cs_slots_mask;
+    }
+    cs_slots[i].cs = p;
+    cs_slots[i].hash = h;
+    cs_slots_used++;
+}
+
+static void cs_slots_resize(unsigned size)
+{
+    cs_slot *old = cs_slots;
+    unsigned i, n = (old == NULL) ? 0 : cs_slots_mask + 1;
+    cs_slots = xcalloc(size, sizeof(cs_slot));
+    cs_slots_mask = size - 1;
+    cs_slots_used = 0;
+    for (i = 0; i < n; i++) {
+        if (old[i].cs != 0) {
+            cs_slots_insert(old[i].cs, old[i].hash);
+        }
+    }
+    xfree(old);
+}
+
+static void cs_slots_add(halfword p, unsigned h)
+{
+    if (cs_slots == NULL) {
+        cs_slots_resize(cs_slots_initial);
+    } else if (2 * (cs_slots_used + 1) > cs_slots_mask + 1) {
+        cs_slots_resize(2 * (cs_slots_mask + 1));
+    }
+    cs_slots_insert(p, h);
+}
+
+static void add_cs_range(halfword first, halfword last)
+{
+    halfword p;
+    for (p = first; p <= last; p++) {
+        str_number s = cs_text(p);
+        if (s > 0) {
+            cs_slots_add(p, cs_hash(str_string(s), (unsigned) str_length(s)));
+        }
+    }
+}
+
+/*tex This one is called after undumping, the frozen names are not looked up. */
+
+void rebuild_cs_index(void)
+{
+    unsigned size = cs_slots_initial;
+    while (size < 4 * (unsigned) (hash_size + hash_high)) {
+        size = size << 1;
+    }
+    xfree(cs_slots);
+    cs_slots_resize(size);
+    add_cs_range(hash_base, frozen_control_sequence - 1);
+    add_cs_range(eqtb_size + 1, eqtb_size + hash_high);
+}
+
+/*tex
+
+When the |hash_extra| part is used up it grows by half its size, but at least by
+|hash_size|. The new |eqtb| entries are undefined.
+
+*/
+
+static void grow_hash_extra(void)
+{
+    int extra = hash_extra + (hash_extra / 2 > hash_size ? hash_extra / 2 : hash_size);
+    halfword k;
+    if (extra > sup_hash_extra) {
+        extra = sup_hash_extra;
+    }
+    if (cs_token_flag + eqtb_size + extra > max_halfword) {
+        extra = max_halfword - cs_token_flag - eqtb_size;
+    }
+    if (extra <= hash_extra) {
+        overflow("hash size", (unsigned) (hash_size + hash_extra));
+    }
+    hash = xrealloc(hash, sizeof(two_halves) * (unsigned) (eqtb_size + extra + 1));
+    memset(hash + hash_top + 1, 0, sizeof(two_halves) * (unsigned) (eqtb_size + extra - hash_top));
+    eqtb = xrealloc(eqtb, sizeof(memory_word) * (unsigned) (eqtb_size + extra + 1));
+    for (k = eqtb_top + 1; k <= eqtb_size + extra; k++) {
+        eqtb[k] = eqtb[undefined_control_sequence];
+    }
+    hash_extra = extra;
+    eqtb_top = eqtb_size + hash_extra;
+    hash_top = eqtb_top;
+}
+
 /*tex
 
     \.{\\primitive} support needs a few extra variables and definitions,
@@ -434,7 +553,7 @@ void primitive(const char *thes, quarterword c, halfword o, halfword off, int cm
     /*tex Needed to fill |prim_eqtb|: */
     int prim_val;
     str_number ss;
-    ss = maketexstring(thes);
+    ss = maketexlstring_shared(thes, strlen(thes));
     if (cmd_origin == tex_command || cmd_origin == core_command) {
         primitive_def(thes, strlen(thes), c, o);
     }
@@ -447,128 +566,80 @@ void primitive(const char *thes, quarterword c, halfword o, halfword off, int cm
 
 /*tex
 
-Here is a helper that does the actual hash insertion. This code far from ideal:
-the existance of |hash_extra| changes all the potential (short) coalesced lists
-into a single (long) one. This will create a slowdown.
+Here is a helper that does the actual hash insertion. The free positions in the
+|hash_size| part are used first, from the top down, then the |hash_extra| part is
+filled.
 
 */
 
-static halfword insert_id(halfword p, const unsigned char *j, unsigned int l)
+static halfword insert_id(const unsigned char *j, unsigned int l, unsigned h)
 {
-    unsigned saved_cur_length;
-    unsigned saved_cur_string_size;
-    unsigned char *saved_cur_string;
-    const unsigned char *k;
-    if (cs_text(p) > 0) {
-        if (hash_high < hash_extra) {
+    halfword p;
+    do {
+        if (hash_is_full) {
+            if (hash_high >= hash_extra) {
+                grow_hash_extra();
+            }
             incr(hash_high);
-            /*tex
-                Can't we use |eqtb_top| here (perhaps because that is not
-                finalized yet when called from |primitive|?
-            */
-            cs_next(p) = hash_high + eqtb_size;
-            p = cs_next(p);
-        } else {
-            /*tex
-                Search for an empty location in |hash|.
-            */
-            do {
-                if (hash_is_full)
-                    overflow("hash size", (unsigned) (hash_size + hash_extra));
-                decr(hash_used);
-            } while (cs_text(hash_used) != 0);
-            cs_next(p) = hash_used;
-            p = hash_used;
+            p = hash_high + eqtb_size;
+            goto DONE;
         }
-    }
-    saved_cur_length = cur_length;
-    saved_cur_string = cur_string;
-    saved_cur_string_size = cur_string_size;
-    reset_cur_string();
-    for (k = j; k <= j + l - 1; k++) {
-        append_char(*k);
-    }
-    cs_text(p) = make_string();
-    cur_length = saved_cur_length;
-    xfree(cur_string);
-    cur_string = saved_cur_string;
-    cur_string_size = saved_cur_string_size;
+        decr(hash_used);
+    } while (cs_text(hash_used) != 0);
+    p = hash_used;
+  DONE:
+    /*tex Control sequence names are never flushed so they can be shared. */
+    cs_text(p) = maketexlstring_shared((const char *) j, (size_t) l);
+    cs_slots_add(p, h);
     incr(cs_count);
     return p;
 }
 
-
 /*tex
 
 Here is the subroutine that searches the hash table for an identifier that
-matches a given string of length |l>1| appearing in |buffer[j.. (j+l-1)]|. If the
-identifier is found, the corresponding hash table address is returned. Otherwise,
-if the global variable |no_new_control_sequence| is |true|, the dummy address
+matches a given string of length |l|. If the identifier is found, the
+corresponding hash table address is returned. Otherwise, if the global variable
+|no_new_control_sequence| is |true|, the dummy address
 |undefined_control_sequence| is returned. Otherwise the identifier is inserted
 into the hash table and its location is returned.
 
 */
 
-pointer id_lookup(int j, int l)
+static pointer cs_lookup(const unsigned char *s, unsigned l)
 {
-    /*tex The hash code: */
-    int h;
-    /*tex The index in |hash| array: */
-    pointer p;
-    h = compute_hash((char *) (buffer + j), (unsigned) l, hash_prime);
-    /*tex We start searching here. Note that |0<=h<hash_prime|: */
-    p = h + hash_base;
-    while (1) {
-        if (cs_text(p) > 0)
-            if (str_length(cs_text(p)) == (unsigned) l)
-                if (str_eq_buf(cs_text(p), j))
-                    goto FOUND;
-        if (cs_next(p) == 0) {
-            if (no_new_control_sequence) {
-                p = undefined_control_sequence;
-            } else {
-                p = insert_id(p, (buffer + j), (unsigned) l);
+    unsigned h = cs_hash(s, l);
+    if (cs_slots != NULL) {
+        unsigned i = h & cs_slots_mask;
+        while (cs_slots[i].cs != 0) {
+            if (cs_slots[i].hash == h) {
+                str_number t = cs_text(cs_slots[i].cs);
+                if (str_length(t) == l && memcmp(str_string(t), s, l) == 0) {
+                    return cs_slots[i].cs;
+                }
             }
-            goto FOUND;
+            i = (i + 1) & cs_slots_mask;
         }
-        p = cs_next(p);
     }
-  FOUND:
-    return p;
+    if (no_new_control_sequence) {
+        return undefined_control_sequence;
+    } else {
+        return insert_id(s, l, h);
+    }
 }
 
-/*tex
+/*tex The identifier is in |buffer[j.. (j+l-1)]|: */
 
-Here is a similar subroutine for finding a primitive in the hash.
-This one is based on a C string.
+pointer id_lookup(int j, int l)
+{
+    return cs_lookup(buffer + j, (unsigned) l);
+}
 
-*/
+/*tex This one is based on a C string: */
 
 pointer string_lookup(const char *s, size_t l)
 {
-    /*tex The hash code: */
-    int h;
-    /*tex The index in |hash| array: */
-    pointer p;
-    h = compute_hash(s, (unsigned) l, hash_prime);
-    /*tex We start searching here. Note that |0<=h<hash_prime|: */
-    p = h + hash_base;
-    while (1) {
-        if (cs_text(p) > 0)
-            if (str_eq_cstr(cs_text(p), s, l))
-                goto FOUND;
-        if (cs_next(p) == 0) {
-            if (no_new_control_sequence) {
-                p = undefined_control_sequence;
-            } else {
-                p = insert_id(p, (const unsigned char *) s, (unsigned) l);
-            }
-            goto FOUND;
-        }
-        p = cs_next(p);
-    }
-  FOUND:
-    return p;
+    return cs_lookup((const unsigned char *) s, (unsigned) l);
 }
 
 /*tex
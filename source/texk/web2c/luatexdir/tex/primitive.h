@@ -45,7 +45,7 @@ extern halfword hash_high;      /* pointer to next high hash location */
 extern boolean no_new_control_sequence; /* are new identifiers legal? */
 extern int cs_count;            /* total number of known identifiers */
 
-#  define cs_next(a) hash[(a)].lhfield  /* link for coalesced lists */
+#  define cs_next(a) hash[(a)].lhfield  /* unused, lookups go through |cs_slots| */
 #  define cs_text(a) hash[(a)].rh
                                 /* string number for control sequence name */
 
@@ -54,6 +54,7 @@ extern int cs_count;            /* total number of known identifiers */
 #  define prim_prime 1777       /* about 85\pct! of |primitive_size| */
 
 extern void init_primitives(void);
+extern void rebuild_cs_index(void);
 extern void ini_init_primitives(void);
 
 extern halfword compute_pool_hash(pool_pointer j, pool_pointer l,
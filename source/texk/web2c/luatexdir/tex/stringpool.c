@@ -78,6 +78,109 @@ unsigned pool_size;
 
 /*tex
 
+Strings can be found by content: |string_buckets| has the most recently added
+string per hash value and |string_links| chains the strings with the same hash
+value. Both use zero as end marker, which is fine because the null string is not
+hashed.
+
+Strings that are never flushed, like control sequence names, can be shared. Such
+strings are flagged in |string_shared| and their bytes live in an arena, so
+that we don't need an allocation per string. The strings loaded from the format
+file are treated the same. The number of bytes that we didn't have to store
+because a string was shared or found by |search_string| is kept in |pool_saved|.
+
+*/
+
+static str_number *string_buckets = NULL;
+static str_number *string_links = NULL;
+static unsigned char *string_shared = NULL;
+static unsigned string_hash_mask = 0;
+
+#define string_link(a)   string_links[(a)-STRING_OFFSET]
+#define string_is_shared(a) string_shared[(a)-STRING_OFFSET]
+
+#define STRING_ARENA_SIZE 65536
+
+static unsigned char *string_arena = NULL;
+static size_t string_arena_left = 0;
+
+int pool_saved = 0;
+int str_shared = 0;
+
+/*tex
+
+The string hash is FNV-1a. It is also used for the control sequence table, so
+it returns the full value and the callers apply their own mask.
+
+*/
+
+unsigned str_hash(const unsigned char *s, size_t l)
+{
+    unsigned h = 2166136261U;
+    while (l-- > 0) {
+        h = (h ^ *s++) * 16777619U;
+    }
+    return h;
+}
+
+#define string_hash(s,l) (str_hash(s,l) & string_hash_mask)
+
+static void string_hash_insert(str_number s)
+{
+    unsigned h = string_hash(str_string(s), str_length(s));
+    string_link(s) = string_buckets[h];
+    string_buckets[h] = s;
+}
+
+static void string_hash_remove(str_number s)
+{
+    unsigned h = string_hash(str_string(s), str_length(s));
+    str_number *p = &string_buckets[h];
+    while (*p != 0) {
+        if (*p == s) {
+            *p = string_link(s);
+            break;
+        }
+        p = &string_link(*p);
+    }
+    string_link(s) = 0;
+}
+
+/*tex Returns the highest numbered string below |below| with the given content. */
+
+static str_number string_hash_find(const unsigned char *s, size_t l, str_number below, boolean shared)
+{
+    str_number found = 0;
+    str_number t = string_buckets[string_hash(s, l)];
+    while (t != 0) {
+        if (t < below && t > found && str_length(t) == l && (!shared || string_is_shared(t))
+                && memcmp(str_string(t), s, l) == 0) {
+            found = t;
+        }
+        t = string_link(t);
+    }
+    return found;
+}
+
+static unsigned char *string_arena_alloc(size_t l)
+{
+    unsigned char *s;
+    if (l > string_arena_left) {
+        if (l > STRING_ARENA_SIZE / 4) {
+            /*tex Large strings get their own block. */
+            return xmalloc((unsigned) l);
+        }
+        string_arena = xmalloc(STRING_ARENA_SIZE);
+        string_arena_left = STRING_ARENA_SIZE;
+    }
+    s = string_arena;
+    string_arena += l;
+    string_arena_left -= l;
+    return s;
+}
+
+/*tex
+
 Once a sequence of characters has been appended to |cur_string|, it officially
 becomes a string when the function |make_string| is called. This function returns
 the identification number of the new string as its value.
@@ -105,6 +208,7 @@ str_number make_string(void)
     str_string(str_ptr) = (unsigned char *) cur_string;
     str_length(str_ptr) = cur_length;
     pool_size += cur_length;
+    string_hash_insert(str_ptr);
     reset_cur_string();
     str_ptr++;
     return (str_ptr - 1);
@@ -220,8 +324,8 @@ boolean get_strings_started(void)
 The string recycling routines. \TeX{} uses 2 upto 4 {\it new\/} strings when
 scanning a filename in an \.{\\input}, \.{\\openin}, or \.{\\openout} operation.
 These strings are normally lost because the reference to them are not saved after
-finishing the operation. |search_string| searches through the string pool for the
-given string and returns either 0 or the found string number.
+finishing the operation. |search_string| looks up the newest string below the
+given one with the same content and returns either 0 or the found string number.
 
 */
 
@@ -233,17 +337,48 @@ str_number search_string(str_number search)
     if (len == 0) {
         return get_nullstr();
     } else {
-        /*tex We start the search with newest string below |s|; |search>1|! */
-        s = search - 1;
-        while (s >= STRING_OFFSET) {
-            /* The first |string_offset| of strings depend on the implementation! */
-            if (str_length(s) == len)
-                if (str_eq_str(s, search))
-                    return s;
-            s--;
+        s = string_hash_find(str_string(search), len, search, false);
+        if (s != 0) {
+            pool_saved += (int) len;
         }
+        return s;
     }
-    return 0;
+}
+
+/*tex
+
+Strings that are never flushed can be shared. When there is already a shared
+string with the same content we return that one, otherwise a new shared string
+is made. Flushing a shared string is a no|-|op.
+
+*/
+
+str_number maketexlstring_shared(const char *s, size_t l)
+{
+    str_number t;
+    if (s == NULL || l == 0)
+        return get_nullstr();
+    t = string_hash_find((const unsigned char *) s, l, str_ptr, true);
+    if (t != 0) {
+        pool_saved += (int) l;
+        str_shared++;
+        return t;
+    }
+    if (str_ptr == (max_strings + STRING_OFFSET)) {
+        overflow(
+            "number of strings",
+             (unsigned) (max_strings - init_str_ptr + STRING_OFFSET)
+        );
+    }
+    str_string(str_ptr) = string_arena_alloc(l + 1);
+    memcpy(str_string(str_ptr), s, l);
+    str_string(str_ptr)[l] = '\0';
+    str_length(str_ptr) = (unsigned) l;
+    string_is_shared(str_ptr) = 1;
+    pool_size += (unsigned) l;
+    string_hash_insert(str_ptr);
+    str_ptr++;
+    return (str_ptr - 1);
 }
 
 str_number maketexstring(const char *s)
@@ -257,9 +392,16 @@ str_number maketexlstring(const char *s, size_t l)
 {
     if (s == NULL || l == 0)
         return get_nullstr();
+    if (str_ptr == (max_strings + STRING_OFFSET)) {
+        overflow(
+            "number of strings",
+             (unsigned) (max_strings - init_str_ptr + STRING_OFFSET)
+        );
+    }
     str_string(str_ptr) = xmalloc((unsigned) (l + 1));
     memcpy(str_string(str_ptr), s, (l + 1));
     str_length(str_ptr) = (unsigned) l;
+    string_hash_insert(str_ptr);
     str_ptr++;
     return (str_ptr - 1);
 }
@@ -335,9 +477,11 @@ int undump_string_pool(void)
         if (x >= 0) {
             str_length(j) = (unsigned) x;
             pool_size += (unsigned) x;
-            str_string(j) = xmallocarray(unsigned char, (unsigned) (x + 1));
+            str_string(j) = string_arena_alloc((size_t) x + 1);
             undump_things(*str_string(j), (unsigned) x);
             *(str_string(j) + str_length(j)) = '\0';
+            string_is_shared(j) = 1;
+            string_hash_insert(j);
         } else {
             str_length(j) = 0;
         }
@@ -348,9 +492,21 @@ int undump_string_pool(void)
 
 void init_string_pool_array(unsigned s)
 {
+    unsigned h = 1024;
     string_pool = xmallocarray(lstring, s);
     _string_pool = string_pool - STRING_OFFSET;
     memset(string_pool, 0, s * sizeof(lstring));
+    /* the hash gets about two strings per bucket */
+    while (h < s / 2) {
+        h = h << 1;
+    }
+    xfree(string_buckets);
+    xfree(string_links);
+    xfree(string_shared);
+    string_hash_mask = h - 1;
+    string_buckets = xcalloc(h, sizeof(str_number));
+    string_links = xcalloc(s, sizeof(str_number));
+    string_shared = xcalloc(s, sizeof(unsigned char));
     /* seed the null string */
     string_pool[0].s = xmalloc(1);
     string_pool[0].s[0] = '\0';
@@ -364,8 +520,10 @@ void init_string_pool_array(unsigned s)
 
 void flush_str(str_number s)
 {
-    if (s > STRING_OFFSET) {
-        /*tex Don't ever delete the null string! */
+    if (s > STRING_OFFSET && !string_is_shared(s)) {
+        /*tex Don't ever delete the null string (or a shared one)! */
+        if (str_string(s) != NULL)
+            string_hash_remove(s);
         pool_size -= (unsigned) str_length(s);
         str_length(s) = 0;
         xfree(str_string(s));
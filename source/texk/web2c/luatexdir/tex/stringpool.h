@@ -124,10 +124,15 @@ extern void reset_cur_string(void);
 
 
 extern str_number search_string(str_number search);
+extern unsigned str_hash(const unsigned char *s, size_t l);
 extern int pool_to_unichar(unsigned char *t);
 
 extern str_number maketexstring(const char *);
 extern str_number maketexlstring(const char *, size_t);
+extern str_number maketexlstring_shared(const char *, size_t);
+
+extern int pool_saved;
+extern int str_shared;
 extern void append_string(const unsigned char *s, unsigned l);
 
 extern char *makecstring(int);
@@ -116,7 +116,7 @@ void tex_def_font(small_number a)
     if (u >= null_cs)
         t = cs_text(u);
     else
-        t = maketexstring("FONT");
+        t = maketexlstring_shared("FONT", 4);
     if (a >= 4) {
         geq_define(u, set_font_cmd, null_font);
     } else {
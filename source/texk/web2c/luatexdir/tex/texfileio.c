@@ -20,9 +20,18 @@ with LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "ptexlib.h"
+#include "lua/luatex-api.h"
 
 #include <string.h>
 #include <kpathsea/absolute.h>
+#include <kpathsea/pathsearch.h>
+
+#include <kpathsea/c-stat.h>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  define TEXMF_PACK 1
+#endif
 
 /*tex
 
@@ -122,6 +131,580 @@ int kpse_available(const char *m) {
     return 1 ;
 }
 
+/*tex
+
+    A \TEX\ tree can also be shipped as a single pack file that is mapped into
+    memory once, so that finding and opening files in it doesn't touch the file
+    system at all. The pack is named by the |TEXMFPACK| variable (environment or
+    \type {texmf.cnf}) and written by |kpse.write_pack|. It has the files under
+    the full names they were packed with, so these are also the names that end
+    up in the log and the recorder file. The layout is:
+
+    \startitemize
+        \startitem a |texmf_pack_header| \stopitem
+        \startitem |count| entries, sorted by name \stopitem
+        \startitem |count| entry numbers, sorted by base name and for equal base
+                   names in the order the files were packed \stopitem
+        \startitem the zero terminated names \stopitem
+        \startitem the file data \stopitem
+    \stopitemize
+
+    The pack is written and read on the same architecture, so we use native
+    integers. Format files and \LUA\ libraries are never taken from the pack
+    because they are read through a file descriptor or loaded by the system.
+
+*/
+
+#define TEXMF_PACK_MAGIC "ltxpack\n"
+#define TEXMF_PACK_VERSION 1
+
+typedef struct {
+    char magic[8];
+    unsigned version;
+    unsigned word_size;
+    unsigned count;
+    unsigned order;
+    size_t size;
+} texmf_pack_header;
+
+typedef struct {
+    size_t offset;
+    size_t size;
+    unsigned name;
+    unsigned base;
+} texmf_pack_entry;
+
+static struct {
+    int state;
+    char *data;
+    size_t size;
+    unsigned count;
+    texmf_pack_entry *entries;
+    unsigned *bases;
+    const char *names;
+} texmf_pack = { 0, NULL, 0, 0, NULL, NULL, NULL };
+
+#define texmf_pack_name(e) (texmf_pack.names + (e)->name)
+#define texmf_pack_base(e) (texmf_pack.names + (e)->name + (e)->base)
+
+/*tex We check the whole table once so that lookups need no checks. */
+
+static boolean texmf_pack_valid(char *data, size_t size)
+{
+    texmf_pack_header *h = (texmf_pack_header *) data;
+    texmf_pack_entry *e;
+    unsigned *b;
+    size_t names, pool;
+    unsigned i;
+    if (size < sizeof(texmf_pack_header)
+        || memcmp(h->magic, TEXMF_PACK_MAGIC, 8) != 0
+        || h->version != TEXMF_PACK_VERSION
+        || h->word_size != sizeof(size_t)
+        || h->order != 0x01020304
+        || h->size != size
+        || h->count > (size - sizeof(texmf_pack_header)) / (sizeof(texmf_pack_entry) + sizeof(unsigned))) {
+        return false;
+    }
+    e = (texmf_pack_entry *) (data + sizeof(texmf_pack_header));
+    b = (unsigned *) (e + h->count);
+    names = (size_t) ((char *) (b + h->count) - data);
+    pool = size - names;
+    for (i = 0; i < h->count; i++) {
+        const char *n, *z;
+        if (e[i].name >= pool || b[i] >= h->count || e[i].offset > size || e[i].size > size - e[i].offset) {
+            return false;
+        }
+        /*tex The name has to end within the pool before we can measure it. */
+        n = data + names + e[i].name;
+        z = (const char *) memchr(n, 0, pool - e[i].name);
+        if (z == NULL || e[i].base > (unsigned) (z - n)) {
+            return false;
+        }
+    }
+    texmf_pack.count = h->count;
+    texmf_pack.entries = e;
+    texmf_pack.bases = b;
+    texmf_pack.names = data + names;
+    return true;
+}
+
+static boolean texmf_pack_load(void)
+{
+    if (texmf_pack.state == 0) {
+        texmf_pack.state = -1;
+#ifdef TEXMF_PACK
+        if (kpse_init) {
+            char *name = kpse_var_value("TEXMFPACK");
+            if (name != NULL && *name) {
+                struct stat st;
+                int fd = open(name, O_RDONLY);
+                if (fd >= 0) {
+                    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                        void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                        if (data != MAP_FAILED) {
+                            if (texmf_pack_valid((char *) data, (size_t) st.st_size)) {
+                                texmf_pack.data = (char *) data;
+                                texmf_pack.size = (size_t) st.st_size;
+                                texmf_pack.state = 1;
+                            } else {
+                                munmap(data, (size_t) st.st_size);
+                            }
+                        }
+                    }
+                    close(fd);
+                }
+                if (texmf_pack.state < 0) {
+                    formatted_warning("texmf pack", "ignoring invalid pack file '%s'", name);
+                }
+            }
+            free(name);
+        }
+#endif
+    }
+    return texmf_pack.state > 0;
+}
+
+static texmf_pack_entry *texmf_pack_lookup(const char *name)
+{
+    unsigned lo = 0;
+    unsigned hi = texmf_pack.count;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(texmf_pack_name(&texmf_pack.entries[mid]), name);
+        if (cmp == 0) {
+            return &texmf_pack.entries[mid];
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+/*tex The first entry with a name that is not less than |key|: */
+
+static unsigned texmf_pack_lower(const char *key)
+{
+    unsigned lo = 0;
+    unsigned hi = texmf_pack.count;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (strcmp(texmf_pack_name(&texmf_pack.entries[mid]), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*tex
+
+    The pack is consulted as one more tree, in the order of the search path of
+    the format. For each path element we know if the pack has files below it. An
+    element like |.| or |TEXMFHOME| that is not in the pack is searched by
+    kpathsea as usual, so the current directory and personal trees still win
+    over the pack when they come first in the path. Elements with |//| in the
+    middle are left to kpathsea.
+
+*/
+
+typedef struct {
+    char *element;
+    char *dir;
+    boolean subdirs;
+} texmf_pack_element;
+
+static struct {
+    boolean done;
+    unsigned count;
+    texmf_pack_element *elements;
+} texmf_pack_paths[kpse_last_format];
+
+static char *texmf_pack_covers(const char *element, boolean *subdirs)
+{
+    const char *s = element;
+    char *dir, *prefix;
+    size_t l;
+    unsigned i;
+    if (s[0] == '!' && s[1] == '!') {
+        s += 2;
+    }
+    l = strlen(s);
+    *subdirs = l > 1 && IS_DIR_SEP(s[l - 1]) && IS_DIR_SEP(s[l - 2]);
+    while (l > 0 && IS_DIR_SEP(s[l - 1])) {
+        l--;
+    }
+    if (l == 0 || strcspn(s, "*?[{") < l) {
+        return NULL;
+    }
+    for (i = 1; i < l; i++) {
+        if (IS_DIR_SEP(s[i]) && IS_DIR_SEP(s[i - 1])) {
+            return NULL;
+        }
+    }
+    dir = xmalloc((unsigned) (l + 1));
+    memcpy(dir, s, l);
+    dir[l] = 0;
+    prefix = concat(dir, DIR_SEP_STRING);
+    i = texmf_pack_lower(prefix);
+    if (i < texmf_pack.count && strncmp(texmf_pack_name(&texmf_pack.entries[i]), prefix, l + 1) == 0) {
+        free(prefix);
+        return dir;
+    }
+    free(prefix);
+    free(dir);
+    return NULL;
+}
+
+/*tex We only keep the elements up to the last one that the pack covers. */
+
+static void texmf_pack_init_path(int format)
+{
+    const char *path;
+    unsigned n = 0;
+    unsigned i;
+    if (!kpse_format_info[format].type) {
+        kpse_init_format((kpse_file_format_type) format);
+    }
+    path = kpse_format_info[format].path;
+    texmf_pack_paths[format].done = true;
+    if (path == NULL) {
+        return;
+    }
+    for (i = 0; path[i]; i++) {
+        if (IS_ENV_SEP(path[i])) {
+            n++;
+        }
+    }
+    texmf_pack_paths[format].elements = xmalloc((n + 1) * sizeof(texmf_pack_element));
+    n = 0;
+    while (*path) {
+        size_t l = 0;
+        while (path[l] && !IS_ENV_SEP(path[l])) {
+            l++;
+        }
+        if (l > 0) {
+            texmf_pack_element *e = &texmf_pack_paths[format].elements[n++];
+            e->element = xmalloc((unsigned) (l + 1));
+            memcpy(e->element, path, l);
+            e->element[l] = 0;
+            e->dir = texmf_pack_covers(e->element, &e->subdirs);
+            if (e->dir != NULL) {
+                texmf_pack_paths[format].count = n;
+            }
+        }
+        path += l;
+        if (*path) {
+            path++;
+        }
+    }
+}
+
+/*tex
+
+    Find |name| below the directory of |e| in the pack. Below a |//| element the
+    name can be anywhere, so we go over the files with the same base name, in the
+    order they were packed, and check the directory and the rest of the name.
+
+*/
+
+static texmf_pack_entry *texmf_pack_search(const char *name, texmf_pack_element *e)
+{
+    const char *base = name + strlen(name);
+    size_t len = strlen(name);
+    size_t dlen = strlen(e->dir);
+    unsigned lo = 0;
+    unsigned hi = texmf_pack.count;
+    if (!e->subdirs) {
+        char *s = concat3(e->dir, DIR_SEP_STRING, name);
+        texmf_pack_entry *f = texmf_pack_lookup(s);
+        free(s);
+        return f;
+    }
+    while (base > name && !IS_DIR_SEP(base[-1])) {
+        base--;
+    }
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (strcmp(texmf_pack_base(&texmf_pack.entries[texmf_pack.bases[mid]]), base) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < texmf_pack.count; lo++) {
+        texmf_pack_entry *f = &texmf_pack.entries[texmf_pack.bases[lo]];
+        const char *s = texmf_pack_name(f);
+        size_t l = strlen(s);
+        if (strcmp(texmf_pack_base(f), base) != 0) {
+            break;
+        } else if (l > dlen + len && strncmp(s, e->dir, dlen) == 0 && IS_DIR_SEP(s[dlen])
+                && IS_DIR_SEP(s[l - len - 1]) && strcmp(s + l - len, name) == 0) {
+            return f;
+        }
+    }
+    return NULL;
+}
+
+static boolean texmf_pack_has_suffix(const char *name, const_string *suffixes)
+{
+    size_t len = strlen(name);
+    if (suffixes != NULL) {
+        for (; *suffixes; suffixes++) {
+            size_t l = strlen(*suffixes);
+            if (len >= l && strcmp(name + len - l, *suffixes) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*tex
+
+    This replaces |kpse_find_file| for all lookups by \LUATEX\ itself. The
+    names tried in each path element are the ones with the suffixes of the
+    format added, then the name itself. When neither the pack nor the elements
+    before its last one have the file, kpathsea gets the full lookup, with its
+    fallbacks and file generation.
+
+*/
+
+char *texmf_find_file(const char *name, int format, boolean must_exist)
+{
+    if (format != kpse_fmt_format && format != kpse_clua_format && texmf_pack_load()) {
+        if (kpse_absolute_p(name, false)) {
+            texmf_pack_entry *f = texmf_pack_lookup(name);
+            if (f != NULL) {
+                return xstrdup(texmf_pack_name(f));
+            }
+        } else if (!kpse_absolute_p(name, true)) {
+            char *names[16];
+            unsigned n = 0;
+            unsigned i, j;
+            if (!texmf_pack_paths[format].done) {
+                texmf_pack_init_path(format);
+            }
+            if (texmf_pack_paths[format].count > 0) {
+                const_string *suffix = kpse_format_info[format].suffix;
+                if (!texmf_pack_has_suffix(name, kpse_format_info[format].suffix)
+                    && !texmf_pack_has_suffix(name, kpse_format_info[format].alt_suffix)) {
+                    for (; suffix && *suffix && n < 15; suffix++) {
+                        names[n++] = concat(name, *suffix);
+                    }
+                }
+                names[n++] = xstrdup(name);
+            }
+            for (i = 0; i < texmf_pack_paths[format].count; i++) {
+                texmf_pack_element *e = &texmf_pack_paths[format].elements[i];
+                char *s = NULL;
+                for (j = 0; j < n && s == NULL; j++) {
+                    if (e->dir != NULL) {
+                        texmf_pack_entry *f = texmf_pack_search(names[j], e);
+                        if (f != NULL) {
+                            s = xstrdup(texmf_pack_name(f));
+                        }
+                    } else {
+                        s = kpse_path_search(e->element, names[j], false);
+                    }
+                }
+                if (s != NULL) {
+                    for (j = 0; j < n; j++) {
+                        free(names[j]);
+                    }
+                    return s;
+                }
+            }
+            for (j = 0; j < n; j++) {
+                free(names[j]);
+            }
+        }
+    }
+    return kpse_find_file(name, (kpse_file_format_type) format, must_exist);
+}
+
+/*tex Return the data of a packed file, or |NULL| when |name| is not packed. */
+
+const char *texmf_pack_data(const char *name, size_t *size)
+{
+    texmf_pack_entry *e;
+    if (texmf_pack.state <= 0 || (e = texmf_pack_lookup(name)) == NULL) {
+        return NULL;
+    }
+    *size = e->size;
+    return texmf_pack.data + e->offset;
+}
+
+/*tex Open a file for reading, from the pack when it's there. */
+
+FILE *texmf_fopen(const char *name, const char *mode)
+{
+#ifdef TEXMF_PACK
+    size_t size;
+    const char *data = mode[0] == 'r' && mode[1] != '+' && (mode[1] == 0 || mode[2] != '+')
+        ? texmf_pack_data(name, &size) : NULL;
+    if (data != NULL) {
+        /*tex Not all |fmemopen|s accept an empty buffer. */
+        return size > 0 ? fmemopen((void *) data, size, mode) : fopen("/dev/null", mode);
+    }
+#endif
+    return fopen(name, mode);
+}
+
+/*tex The same but not allowed to fail, like |xfopen|. */
+
+FILE *texmf_xfopen(const char *name, const char *mode)
+{
+    FILE *f = texmf_fopen(name, mode);
+    if (f == NULL) {
+        FATAL_PERROR(name);
+    }
+    return f;
+}
+
+/*tex
+
+    Write the pack |packname| with the given files. Files that can't be read are
+    skipped, and of files with the same base name the first one wins when we
+    search by base name. We write to a temporary file first so that a running
+    job never sees a half written pack.
+
+*/
+
+static const char **texmf_pack_sort_names;
+static texmf_pack_entry *texmf_pack_sort_entries;
+
+static int texmf_pack_compare_names(const void *a, const void *b)
+{
+    return strcmp(texmf_pack_sort_names[*(const unsigned *) a], texmf_pack_sort_names[*(const unsigned *) b]);
+}
+
+static int texmf_pack_compare_bases(const void *a, const void *b)
+{
+    unsigned x = *(const unsigned *) a;
+    unsigned y = *(const unsigned *) b;
+    int cmp = strcmp(texmf_pack_sort_names[x] + texmf_pack_sort_entries[x].base,
+                     texmf_pack_sort_names[y] + texmf_pack_sort_entries[y].base);
+    return cmp ? cmp : (x > y) - (x < y);
+}
+
+static size_t texmf_pack_copy(FILE *out, const char *name, size_t size)
+{
+    char buf[16384];
+    size_t done = 0;
+    FILE *in = fopen(name, FOPEN_RBIN_MODE);
+    if (in != NULL) {
+        size_t n;
+        while (done < size && (n = fread(buf, 1, size - done < sizeof(buf) ? size - done : sizeof(buf), in)) > 0) {
+            if (fwrite(buf, 1, n, out) != n) {
+                break;
+            }
+            done += n;
+        }
+        fclose(in);
+    }
+    return done;
+}
+
+boolean texmf_pack_write(const char *packname, const char **files, unsigned count)
+{
+    texmf_pack_header h;
+    texmf_pack_entry *entries = xmalloc((count ? count : 1) * sizeof(texmf_pack_entry));
+    unsigned *order = xmalloc((count ? count : 1) * sizeof(unsigned));
+    unsigned *bases = xmalloc((count ? count : 1) * sizeof(unsigned));
+    const char **names = xmalloc((count ? count : 1) * sizeof(char *));
+    char *tmpname = concat(packname, ".tmp");
+    size_t pool = 0;
+    size_t offset;
+    unsigned i, n = 0;
+    boolean ok = true;
+    FILE *f;
+    /*tex Collect the readable files, and sort them by name dropping duplicates. */
+    for (i = 0; i < count; i++) {
+        struct stat st;
+        if (stat(files[i], &st) == 0 && S_ISREG(st.st_mode)) {
+            const char *base = files[i] + strlen(files[i]);
+            while (base > files[i] && !IS_DIR_SEP(base[-1])) {
+                base--;
+            }
+            names[n] = files[i];
+            entries[n].size = (size_t) st.st_size;
+            entries[n].base = (unsigned) (base - files[i]);
+            order[n] = n;
+            n++;
+        }
+    }
+    texmf_pack_sort_names = names;
+    qsort(order, n, sizeof(unsigned), texmf_pack_compare_names);
+    for (i = 0, count = 0; i < n; i++) {
+        if (count == 0 || strcmp(names[order[i]], names[order[count - 1]]) != 0) {
+            order[count++] = order[i];
+        }
+    }
+    /*tex The base name order keeps the original order of equal names. */
+    for (i = 0; i < count; i++) {
+        bases[i] = order[i];
+    }
+    texmf_pack_sort_entries = entries;
+    qsort(bases, count, sizeof(unsigned), texmf_pack_compare_bases);
+    /*tex Now |order[i]| is the original index of entry |i|, so we renumber. */
+    {
+        unsigned *position = xmalloc((n ? n : 1) * sizeof(unsigned));
+        texmf_pack_entry *sorted = xmalloc((count ? count : 1) * sizeof(texmf_pack_entry));
+        for (i = 0; i < count; i++) {
+            position[order[i]] = i;
+            sorted[i] = entries[order[i]];
+            sorted[i].name = (unsigned) pool;
+            pool += strlen(names[order[i]]) + 1;
+        }
+        for (i = 0; i < count; i++) {
+            bases[i] = position[bases[i]];
+        }
+        free(position);
+        free(entries);
+        entries = sorted;
+    }
+    offset = sizeof(texmf_pack_header) + count * (sizeof(texmf_pack_entry) + sizeof(unsigned)) + pool;
+    for (i = 0; i < count; i++) {
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TEXMF_PACK_MAGIC, 8);
+    h.version = TEXMF_PACK_VERSION;
+    h.word_size = sizeof(size_t);
+    h.count = count;
+    h.order = 0x01020304;
+    h.size = offset;
+    f = fopen(tmpname, FOPEN_WBIN_MODE);
+    if (f == NULL) {
+        ok = false;
+    } else {
+        ok = fwrite(&h, sizeof(h), 1, f) == 1
+          && (count == 0 || fwrite(entries, sizeof(texmf_pack_entry), count, f) == count)
+          && (count == 0 || fwrite(bases, sizeof(unsigned), count, f) == count);
+        for (i = 0; ok && i < count; i++) {
+            ok = fwrite(names[order[i]], strlen(names[order[i]]) + 1, 1, f) == 1;
+        }
+        for (i = 0; ok && i < count; i++) {
+            ok = texmf_pack_copy(f, names[order[i]], entries[i].size) == entries[i].size;
+        }
+        ok = fclose(f) == 0 && ok;
+        ok = ok && rename(tmpname, packname) == 0;
+        if (!ok) {
+            remove(tmpname);
+        }
+    }
+    free(tmpname);
+    free(names);
+    free(bases);
+    free(order);
+    free(entries);
+    return ok;
+}
+
 char *luatex_find_read_file(const char *s, int n, int callback_index)
 {
     char *ftemp = NULL;
@@ -132,7 +715,7 @@ char *luatex_find_read_file(const char *s, int n, int callback_index)
         /*tex Use kpathsea here. */
         ftemp = find_in_output_directory(s);
         if (!ftemp)
-            ftemp = kpse_find_file(s, kpse_tex_format, 1);
+            ftemp = texmf_find_file(s, kpse_tex_format, 1);
     }
     if (ftemp) {
         if (fullnameoffile)
@@ -154,39 +737,39 @@ char *luatex_find_file(const char *s, int callback_index)
         /*tex Use kpathsea here. */
         switch (callback_index) {
             case find_enc_file_callback:
-                ftemp = kpse_find_file(s, kpse_enc_format, 0);
+                ftemp = texmf_find_file(s, kpse_enc_format, 0);
                 break;
             case find_map_file_callback:
-                ftemp = kpse_find_file(s, kpse_fontmap_format, 0);
+                ftemp = texmf_find_file(s, kpse_fontmap_format, 0);
                 break;
             case find_type1_file_callback:
-                ftemp = kpse_find_file(s, kpse_type1_format, 0);
+                ftemp = texmf_find_file(s, kpse_type1_format, 0);
                 break;
             case find_truetype_file_callback:
-                ftemp = kpse_find_file(s, kpse_truetype_format, 0);
+                ftemp = texmf_find_file(s, kpse_truetype_format, 0);
                 break;
             case find_opentype_file_callback:
-                ftemp = kpse_find_file(s, kpse_opentype_format, 0);
+                ftemp = texmf_find_file(s, kpse_opentype_format, 0);
                 if (ftemp == NULL)
-                    ftemp = kpse_find_file(s, kpse_truetype_format, 0);
+                    ftemp = texmf_find_file(s, kpse_truetype_format, 0);
                 break;
             case find_data_file_callback:
                 ftemp = find_in_output_directory(s);
                 if (!ftemp)
-                    ftemp = kpse_find_file(s, kpse_tex_format, 1);
+                    ftemp = texmf_find_file(s, kpse_tex_format, 1);
                 break;
             case find_font_file_callback:
-                ftemp = kpse_find_file(s, kpse_ofm_format, 1);
+                ftemp = texmf_find_file(s, kpse_ofm_format, 1);
                 if (ftemp == NULL)
-                    ftemp = kpse_find_file(s, kpse_tfm_format, 1);
+                    ftemp = texmf_find_file(s, kpse_tfm_format, 1);
                 break;
             case find_vf_file_callback:
-                ftemp = kpse_find_file(s, kpse_ovf_format, 0);
+                ftemp = texmf_find_file(s, kpse_ovf_format, 0);
                 if (ftemp == NULL)
-                    ftemp = kpse_find_file(s, kpse_vf_format, 0);
+                    ftemp = texmf_find_file(s, kpse_vf_format, 0);
                 break;
             case find_cidmap_file_callback:
-                ftemp = kpse_find_file(s, kpse_cid_format, 0);
+                ftemp = texmf_find_file(s, kpse_cid_format, 0);
                 break;
             default:
                 printf("luatex_find_file(): do not know how to handle file %s of type %d\n", s, callback_index);
@@ -227,7 +810,7 @@ boolean luatex_open_input(FILE ** f_ptr, const char *fn, int filefmt, const_stri
     if (fullnameoffile)
         free(fullnameoffile);
     fullnameoffile = NULL;
-    fname = kpse_find_file(fn, (kpse_file_format_type) filefmt, must_exist);
+    fname = texmf_find_file(fn, (kpse_file_format_type) filefmt, must_exist);
     if (fname) {
         fullnameoffile = xstrdup(fname);
         /*tex
@@ -248,7 +831,7 @@ boolean luatex_open_input(FILE ** f_ptr, const char *fn, int filefmt, const_stri
             fname[i] = 0;
         }
         /*tex This fopen is not allowed to fail. */
-        *f_ptr = xfopen(fname, fopen_mode);
+        *f_ptr = texmf_xfopen(fname, fopen_mode);
     }
     if (*f_ptr) {
         recorder_record_input(fname);
@@ -637,6 +1220,8 @@ void term_input(void)
     int k;
     /*tex Now the user sees the prompt for sure: */
     update_terminal();
+    /*tex We're waiting anyway so we can as well collect some garbage. */
+    lua_gc_quiet_point(lua_gc_point_input);
     if (!input_ln(term_in, true))
         fatal_error("End of file on the terminal!");
     /*tex The user's line ended with \.{<return>}: */
@@ -1007,6 +1592,7 @@ void start_input(void)
         end_file_reading();
         fn = prompt_file_name("input file name", "");
     }
+    lua_gc_quiet_point(lua_gc_point_input);
     iname = maketexstring(fullnameoffile);
     /*tex
 
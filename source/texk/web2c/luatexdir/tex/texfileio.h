@@ -24,6 +24,12 @@
 extern int *input_file_callback_id;
 extern int read_file_callback_id[17];
 
+extern char *texmf_find_file(const char *name, int format, boolean must_exist);
+extern FILE *texmf_fopen(const char *name, const char *mode);
+extern FILE *texmf_xfopen(const char *name, const char *mode);
+extern const char *texmf_pack_data(const char *name, size_t *size);
+extern boolean texmf_pack_write(const char *packname, const char **files, unsigned count);
+
 extern char *luatex_find_read_file(const char *s, int n, int callback_index);
 extern boolean luatex_open_input(FILE ** f_ptr, const char *fn, int filefmt,
                                  const_string fopen_mode, boolean must_exist);
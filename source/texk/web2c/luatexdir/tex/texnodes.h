@@ -240,6 +240,7 @@ typedef enum {
 
 #  define kern_node_size       5
 #  define ex_kern(a)           vinfo((a)+3)  /* expansion factor (hz) */
+#  define shaping_kern(a)      vlink((a)+3)  /* injected by a pair lookup */
 #  define synctex_tag_kern(a)  vinfo((a)+4)
 #  define synctex_line_kern(a) vlink((a)+4)
 
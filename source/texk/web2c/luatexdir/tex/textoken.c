@@ -19,6 +19,17 @@ LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 
 #include "ptexlib.h"
 
+#ifndef _WIN32
+#  include <sys/mman.h>
+#  ifndef MAP_ANONYMOUS
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+#  ifndef MAP_NORESERVE
+#    define MAP_NORESERVE 0
+#  endif
+#  define FIXMEM_RESERVE 1
+#endif
+
 #define detokenized_line() (line_catcode_table==NO_CAT_TABLE)
 
 #define do_get_cat_code(a,b) do { \
@@ -64,6 +75,116 @@ unsigned fix_mem_min;
 
 unsigned fix_mem_max;
 
+/*tex
+
+    Token lists can get huge, for instance when \LUA\ generated data is read
+    into macros. Growing |fixmem| with |realloc| copies the whole array and needs
+    both copies for a moment, so where we can we reserve address space for
+    |token_memory_reserve| words (a configuration value) once and make more of it
+    accessible when needed. Then growing never copies and |fixmem| doesn't move.
+    When there is no room for such a reservation, we take what we can get. When
+    the reservation is used up, and when there is no |mmap|, we fall back on
+    copying and |realloc|. The reservation is bounded because it counts against
+    address space limits.
+
+*/
+
+/*tex the number of words reserved, zero when |fixmem| is allocated */
+
+static size_t fix_mem_reserved = 0;
+
+/*tex how often |fixmem| has been grown */
+
+int fix_mem_growths = 0;
+
+#ifdef FIXMEM_RESERVE
+
+static size_t fixmem_bytes(size_t words)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    return (words * sizeof(smemory_word) + page - 1) / page * page;
+}
+
+#endif
+
+void allocate_fixmem(unsigned size)
+{
+#ifdef FIXMEM_RESERVE
+    size_t reserve = (size_t) token_memory_reserve;
+    if (reserve <= (size_t) size) {
+        /*tex A format can come with more tokens than the reserve. */
+        reserve = (size_t) size + size / 2 + 1;
+    }
+    if (reserve > (size_t) max_halfword + 1) {
+        reserve = (size_t) max_halfword + 1;
+    }
+    while (reserve > (size_t) size + 1) {
+        void *p = mmap(NULL, reserve * sizeof(smemory_word), PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            if (mprotect(p, fixmem_bytes((size_t) size + 1), PROT_READ | PROT_WRITE) == 0) {
+                /*tex Fresh pages are zero. */
+                fixmem = fixmemcast(p);
+                fix_mem_reserved = reserve;
+                fix_mem_max = size;
+                return;
+            }
+            munmap(p, reserve * sizeof(smemory_word));
+            break;
+        }
+        reserve /= 2;
+    }
+#endif
+    fixmem = xmallocarray(smemory_word, size + 1);
+    memset(voidcast(fixmem), 0, (size + 1) * sizeof(smemory_word));
+    fix_mem_reserved = 0;
+    fix_mem_max = size;
+}
+
+void free_fixmem(void)
+{
+#ifdef FIXMEM_RESERVE
+    if (fix_mem_reserved > 0) {
+        munmap(voidcast(fixmem), fix_mem_reserved * sizeof(smemory_word));
+    } else
+#endif
+    {
+        libcfree(fixmem);
+    }
+    fixmem = NULL;
+    fix_mem_reserved = 0;
+}
+
+static boolean grow_fixmem(unsigned size)
+{
+#ifdef FIXMEM_RESERVE
+    if (fix_mem_reserved > 0 && (size_t) size < fix_mem_reserved) {
+        if (mprotect(voidcast(fixmem), fixmem_bytes((size_t) size + 1), PROT_READ | PROT_WRITE) != 0)
+            return false;
+    } else if (fix_mem_reserved > 0) {
+        /*tex The reservation is used up, so we move to allocated memory. */
+        smemory_word *new_fixmem = fixmemcast(malloc(sizeof(smemory_word) * (size + 1)));
+        if (new_fixmem == NULL)
+            return false;
+        memcpy(voidcast(new_fixmem), voidcast(fixmem), (fix_mem_max + 1) * sizeof(smemory_word));
+        memset(voidcast(new_fixmem + fix_mem_max + 1), 0, (size - fix_mem_max) * sizeof(smemory_word));
+        munmap(voidcast(fixmem), fix_mem_reserved * sizeof(smemory_word));
+        fixmem = new_fixmem;
+        fix_mem_reserved = 0;
+    } else
+#endif
+    {
+        smemory_word *new_fixmem = fixmemcast(realloc(fixmem, sizeof(smemory_word) * (size + 1)));
+        if (new_fixmem == NULL)
+            return false;
+        fixmem = new_fixmem;
+        memset(voidcast(fixmem + fix_mem_max + 1), 0, (size - fix_mem_max) * sizeof(smemory_word));
+    }
+    fix_mem_max = size;
+    fix_mem_growths++;
+    return true;
+}
+
 /*tex
 
     In order to study the memory requirements of particular applications, it is
@@ -143,8 +264,8 @@ void initialize_tokens(void)
 
     If the available-space list is empty, i.e., if |avail=null|, we try first to
     increase |fix_mem_end|. If that cannot be done, i.e., if
-    |fix_mem_end=fix_mem_max|, we try to reallocate array |fixmem|. If, that
-    doesn't work, we have to quit.
+    |fix_mem_end=fix_mem_max|, we try to grow array |fixmem|. If, that doesn't
+    work, we have to quit.
 
     Single-word node allocation:
 */
@@ -153,7 +274,6 @@ halfword get_avail(void)
 {
     /*tex The new node being got: */
     unsigned p;
-    unsigned t;
     /*tex Get top location in the |avail| stack. */
     p = (unsigned) avail;
     if (p != null) {
@@ -165,18 +285,11 @@ halfword get_avail(void)
         p = fix_mem_end;
     } else {
         /*tex The big dynamic storage area. */
-        smemory_word *new_fixmem;
-        t = (fix_mem_max / 5);
-        new_fixmem = fixmemcast(realloc(fixmem, sizeof(smemory_word) * (fix_mem_max + t + 1)));
-        if (new_fixmem == NULL) {
+        if (!grow_fixmem(fix_mem_max + fix_mem_max / 5)) {
             /*tex If memory is exhausted, display possible runaway text. */
             runaway();
             overflow("token memory size", fix_mem_max);
-        } else {
-            fixmem = new_fixmem;
         }
-        memset(voidcast(fixmem + fix_mem_max + 1), 0, t * sizeof(smemory_word));
-        fix_mem_max += t;
         p = ++fix_mem_end;
     }
     /*tex Provide an oft-desired initialization of the new node. */
@@ -2019,6 +2132,8 @@ static boolean get_next_tokenlist(void)
             case out_param_cmd:
                 /*tex Insert macro parameter and |goto restart|. */
                 begin_token_list(param_stack[param_start + cur_chr - 1], parameter);
+                /*tex Skip the reference count. */
+                iloc = token_link(iloc);
                 return false;
                 break;
         }
@@ -56,6 +56,10 @@ typedef struct smemory_word_ {
 extern smemory_word *fixmem;
 extern unsigned fix_mem_min;
 extern unsigned fix_mem_max;
+extern int fix_mem_growths;
+
+extern void allocate_fixmem(unsigned size);
+extern void free_fixmem(void);
 
 extern halfword garbage;        /* head of a junk list, write only */
 extern halfword temp_token_head;        /* head of a temporary list of some kind */
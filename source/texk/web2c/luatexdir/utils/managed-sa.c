@@ -31,12 +31,26 @@ LuaTeX; if not, see <http://www.gnu.org/licenses/>.
 
 #include "ptexlib.h"
 
+/*tex
+
+    All sparse arrays share one high water mark: no stack entry anywhere has a
+    level above |sa_stack_level|. When a group ends above that mark nothing was
+    saved in it and |unsave| can skip walking the (catcode, text and math) trees
+    altogether, which is what happens for the majority of groups.
+
+*/
+
+int sa_stack_level = 0;
+
 static void store_sa_stack(sa_tree a, int n, sa_tree_item v, int gl)
 {
     sa_stack_item st;
     st.code = n;
     st.value = v;
     st.level = gl;
+    if (gl > sa_stack_level) {
+        sa_stack_level = gl;
+    }
     if (a->stack == NULL) {
         a->stack = Mxmalloc_array(sa_stack_item, a->stack_size);
     } else if (((a->stack_ptr) + 1) >= a->stack_size) {
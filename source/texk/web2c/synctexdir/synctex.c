@@ -378,14 +378,12 @@ static int fsyscp_remove(char *name);
 #   include "zlib.h"
 
 typedef void (*synctex_recorder_t) (halfword);  /* recorders know how to record a node */
-typedef int (*synctex_fprintf_t) (void *, const char *, ...);   /* print formatted to either FILE * or gzFile */
 
 #   define SYNCTEX_BITS_PER_BYTE 8
 
 /*  Here are all the local variables gathered in one "synchronization context"  */
 static struct {
     void *file;                 /*  the foo.synctex or foo.synctex.gz I/O identifier  */
-    synctex_fprintf_t fprintf;  /*  either fprintf or gzprintf */
     char *busy_name;            /*  the real "foo.synctex(busy)" or "foo.synctex.gz(busy)" name, with output_directory  */
     char *root_name;            /*  in general jobname.tex  */
     integer count;              /*  The number of interesting records in "foo.synctex"  */
@@ -416,7 +414,7 @@ static struct {
         unsigned int reserved:SYNCTEX_BITS_PER_BYTE*sizeof(int)-8; /* Align */
     } flags;
 } synctex_ctxt = {
-    NULL, NULL, NULL, NULL, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0, -1, 0, {0,0,0,0,0,0,0,0,0}}; /* last_v_recorded is initialized to -1. */
+    NULL, NULL, NULL, 0, 0, NULL, 0, 0, 0, 0, 0, 0, 0, 0, -1, 0, {0,0,0,0,0,0,0,0,0}}; /* last_v_recorded is initialized to -1. */
 
 #   define SYNCTEX_FILE synctex_ctxt.file
 #   define SYNCTEX_CONTENT_READY (synctex_ctxt.flags.content_ready)
@@ -424,7 +422,7 @@ static struct {
 #   define SYNCTEX_NO_GZ (synctex_ctxt.flags.no_gz)
 #   define SYNCTEX_NOT_VOID (synctex_ctxt.flags.not_void)
 #   define SYNCTEX_WARNING_DISABLE (synctex_ctxt.flags.warn)
-#   define SYNCTEX_fprintf (*synctex_ctxt.fprintf)
+#   define SYNCTEX_fprintf synctex_buffer_printf
 
 #   define SYNCTEX_IS_READY (synctex_ctxt.flags.ready)
 
@@ -433,6 +431,139 @@ static struct {
 #   define SYNCTEX_WITH_FORMS (((synctex_ctxt.options)&4)!=0)
 #   define SYNCTEX_H_COMPRESS (((synctex_ctxt.options)&8)!=0)
 
+/*  Records are not written one by one with fprintf or gzprintf: they are
+ *  formatted into a memory buffer that goes to the file with one fwrite or
+ *  gzwrite when full and when the file is closed. The bytes written are the
+ *  same, only the number of calls into stdio and zlib is reduced.
+ *  The formats used by the recorders only contain %i and %s directives,
+ *  so they are expanded here without going through vsnprintf. */
+#   define SYNCTEX_BUFFER_SIZE 65536
+
+static struct {
+    size_t used;
+    char data[SYNCTEX_BUFFER_SIZE];
+} synctex_buffer = { 0, { 0 } };
+
+static int synctex_buffer_flush(void)
+{
+    size_t used = synctex_buffer.used;
+    synctex_buffer.used = 0;
+    if (used == 0 || NULL == SYNCTEX_FILE) {
+        return 0;
+    }
+    if (SYNCTEX_NO_GZ) {
+        return fwrite(synctex_buffer.data, 1, used, (FILE *) SYNCTEX_FILE) == used ? 0 : -1;
+    } else {
+        return gzwrite((gzFile) SYNCTEX_FILE, synctex_buffer.data, (unsigned) used) == (int) used ? 0 : -1;
+    }
+}
+
+static int synctex_buffer_write(const char *s, size_t len)
+{
+    if (synctex_buffer.used + len > SYNCTEX_BUFFER_SIZE) {
+        if (synctex_buffer_flush() < 0) {
+            return -1;
+        }
+        if (len > SYNCTEX_BUFFER_SIZE) {
+            /*  a very long file name, not worth buffering */
+            if (SYNCTEX_NO_GZ) {
+                return fwrite(s, 1, len, (FILE *) SYNCTEX_FILE) == len ? 0 : -1;
+            } else {
+                return gzwrite((gzFile) SYNCTEX_FILE, s, (unsigned) len) == (int) len ? 0 : -1;
+            }
+        }
+    }
+    memcpy(synctex_buffer.data + synctex_buffer.used, s, len);
+    synctex_buffer.used += len;
+    return 0;
+}
+
+/*  Returns the number of bytes of the record, or -1 when writing failed,
+ *  like fprintf does. */
+static int synctex_buffer_printf(void *file __attribute__ ((unused)), const char *format, ...)
+{
+    va_list args;
+    int total = 0;
+    const char *p = format;
+    char digits[16];
+    va_start(args, format);
+    while (*p) {
+        const char *q = p;
+        size_t len;
+        while (*q && *q != '%') {
+            ++q;
+        }
+        len = (size_t) (q - p);
+        if (len > 0) {
+            if (synctex_buffer_write(p, len) < 0) {
+                goto FAILED;
+            }
+            total += (int) len;
+        }
+        if (*q == '\0') {
+            break;
+        }
+        switch (*++q) {
+            case 'i':
+            case 'd': {
+                int value = va_arg(args, int);
+                unsigned int u = value < 0 ? 0U - (unsigned int) value : (unsigned int) value;
+                char *d = digits + sizeof(digits);
+                do {
+                    *--d = (char) ('0' + u % 10);
+                    u /= 10;
+                } while (u > 0);
+                if (value < 0) {
+                    *--d = '-';
+                }
+                len = (size_t) (digits + sizeof(digits) - d);
+                if (synctex_buffer_write(d, len) < 0) {
+                    goto FAILED;
+                }
+                total += (int) len;
+                break;
+            }
+            case 's': {
+                const char *s = va_arg(args, const char *);
+                len = strlen(s);
+                if (synctex_buffer_write(s, len) < 0) {
+                    goto FAILED;
+                }
+                total += (int) len;
+                break;
+            }
+            case '\0':
+                --q;
+                break;
+            default:
+                /*  %% and anything unexpected is copied verbatim */
+                if (synctex_buffer_write(q, 1) < 0) {
+                    goto FAILED;
+                }
+                total += 1;
+                break;
+        }
+        p = q + 1;
+    }
+    va_end(args);
+    return total;
+  FAILED:
+    va_end(args);
+    return -1;
+}
+
+/*  Flush the buffer and close the file. */
+static void synctex_dot_close(void)
+{
+    synctex_buffer_flush();
+    if (SYNCTEX_NO_GZ) {
+        xfclose((FILE *) SYNCTEX_FILE, synctex_ctxt.busy_name);
+    } else {
+        gzclose((gzFile) SYNCTEX_FILE);
+    }
+    SYNCTEX_FILE = NULL;
+}
+
 static inline void _synctex_read_command_line_option(void) {
 #   if SYNCTEX_DEBUG
     printf("\nSynchronize DEBUG: _synctex_read_command_line_option\n");
@@ -490,12 +621,7 @@ void synctexabort(boolean log_opened __attribute__ ((unused)))
     printf("\nSynchronize DEBUG: synctex_abort\n");
 #   endif
     if (SYNCTEX_FILE) {
-        if (SYNCTEX_NO_GZ) {
-            xfclose((FILE *) SYNCTEX_FILE, synctex_ctxt.busy_name);
-        } else {
-            gzclose((gzFile) SYNCTEX_FILE);
-        }
-        SYNCTEX_FILE = NULL;
+        synctex_dot_close();
         remove(synctex_ctxt.busy_name);
         SYNCTEX_FREE(synctex_ctxt.busy_name);
         synctex_ctxt.busy_name = NULL;
@@ -660,11 +786,10 @@ static void *synctex_dot_open(void)
             strcat(the_busy_name, synctex_suffix_busy);
             if (SYNCTEX_NO_GZ) {
                 SYNCTEX_FILE = fopen(the_busy_name, FOPEN_W_MODE);
-                synctex_ctxt.fprintf = (synctex_fprintf_t) (&fprintf);
             } else {
                 SYNCTEX_FILE = gzopen(the_busy_name, FOPEN_WBIN_MODE);
-                synctex_ctxt.fprintf = (synctex_fprintf_t) (&gzprintf);
             }
+            synctex_buffer.used = 0;
 #   if SYNCTEX_DEBUG
             printf("\nwarning: Synchronize DEBUG: synctex_dot_open 2\n");
 #   endif
@@ -908,12 +1033,7 @@ void synctexterminate(boolean log_opened)
             if (SYNCTEX_NOT_VOID) {
                 synctex_record_postamble();
                 /* close the synctex file */
-                if (SYNCTEX_NO_GZ) {
-                    xfclose((FILE *) SYNCTEX_FILE, synctex_ctxt.busy_name);
-                } else {
-                    gzclose((gzFile) SYNCTEX_FILE);
-                }
-                SYNCTEX_FILE = NULL;
+                synctex_dot_close();
                 /*  renaming the working synctex file */
                 if (0 == rename(synctex_ctxt.busy_name, the_real_syncname)) {
                     if (log_opened) {
@@ -961,12 +1081,7 @@ void synctexterminate(boolean log_opened)
                 }
             } else {
                 /* close and remove the synctex file because there are no pages of output */
-                if (SYNCTEX_NO_GZ) {
-                    xfclose((FILE *) SYNCTEX_FILE, synctex_ctxt.busy_name);
-                } else {
-                    gzclose((gzFile) SYNCTEX_FILE);
-                }
-                SYNCTEX_FILE = NULL;
+                synctex_dot_close();
                 remove(synctex_ctxt.busy_name);
             }
         }
@@ -1012,12 +1127,7 @@ void synctexterminate(boolean log_opened)
         remove(the_real_syncname);
         if (SYNCTEX_FILE) {
             /* close the synctex file */
-            if (SYNCTEX_NO_GZ) {
-                xfclose((FILE *) SYNCTEX_FILE, synctex_ctxt.busy_name);
-            } else {
-                gzclose((gzFile) SYNCTEX_FILE);
-            }
-            SYNCTEX_FILE = NULL;
+            synctex_dot_close();
             /*  removing the working synctex file */
             remove(synctex_ctxt.busy_name);
         }